@@ -0,0 +1,60 @@
+// Prints how long shrinking a 4K capture to the windows selector's thumbnail size takes with the SSE2 halving, the
+// plain loop, and cairo's CAIRO_FILTER_GOOD. Needs no X server. Built when cmake is given -DBENCHMARKS=ON.
+
+#include "downscale.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+// option_width and option_height in windows_selector.cpp
+static const int thumbnail_width = 217 * 1.2;
+static const int thumbnail_height = 144 * 1.2;
+
+static void
+measure(const char *name, const std::function<void()> &run) {
+    const int runs = 20;
+    run(); // warm up
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++)
+        run();
+    auto total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin);
+    printf("%-58s %8.2f ms\n", name, total.count() / runs);
+}
+
+int main() {
+    // A 4K capture of noise, so nothing can take a shortcut on runs of the same color
+    const int width = 3840;
+    const int height = 2160;
+    std::vector<uint32_t> capture((size_t) width * height);
+    uint32_t seed = 1;
+    for (auto &pixel: capture) {
+        seed = seed * 1664525 + 1013904223;
+        pixel = seed | 0xff000000;
+    }
+    
+    printf("Shrinking a %dx%d capture to fit %dx%d, averaged over 20 runs\n", width, height, thumbnail_width,
+           thumbnail_height);
+    std::vector<uint32_t> half((size_t) (width / 2) * (height / 2));
+    measure("One halving, SSE2 when built with it", [&] {
+        downscale_half(capture.data(), width, height, half.data());
+    });
+    measure("One halving, plain loop", [&] {
+        downscale_half_plain(capture.data(), width, height, half.data());
+    });
+    
+    std::vector<uint32_t> scaled;
+    measure("The whole capture with cairo CAIRO_FILTER_GOOD (the old way)", [&] {
+        scale_to(capture.data(), width, height, thumbnail_width, thumbnail_height, &scaled);
+    });
+    measure("Halvings, then cairo CAIRO_FILTER_GOOD the rest of the way", [&] {
+        int shrunk_width = width;
+        int shrunk_height = height;
+        std::vector<uint32_t> shrunk;
+        if (shrink_by_halves(capture.data(), &shrunk_width, &shrunk_height, thumbnail_width, thumbnail_height,
+                             &shrunk))
+            scale_to(shrunk.data(), shrunk_width, shrunk_height, thumbnail_width, thumbnail_height, &scaled);
+    });
+    return 0;
+}
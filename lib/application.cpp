@@ -13,6 +13,7 @@
 #include <algorithm>
 #include <iostream>
 #include <set>
+#include <unordered_map>
 #include <unistd.h>
 #include <xcb/xcb_event.h>
 #include <xcb/xcb_cursor.h>
@@ -63,21 +64,21 @@ update_keymap(struct ClientKeyboard *kbd) {
 }
 
 void timeout_stop_and_remove_timeout(App *app, Timeout *timeout) {
-    for (int timeout_index = 0; timeout_index < app->timeouts.size(); timeout_index++) {
-        Timeout *t = app->timeouts[timeout_index];
-        if (t == timeout) {
-            if (t->client) {
-                // printf("Timeout Removed: client = %s, fd = %d\n", t->client->name.data(), t->file_descriptor);
-            } else {
-                // printf("Timeout Removed: noclient, fd = %d\n", t->file_descriptor);
-            }
-            app->timeouts.erase(app->timeouts.begin() + timeout_index);
-            epoll_ctl(app->epoll_fd, EPOLL_CTL_DEL, timeout->file_descriptor, NULL);
-            close(timeout->file_descriptor);
-            delete timeout;
+    {
+        std::lock_guard lock(app->registration_mutex);
+        auto it = std::find(app->timeouts.begin(), app->timeouts.end(), timeout);
+        if (it == app->timeouts.end())
             return;
-        }
+        app->timeouts.erase(it);
     }
+    if (timeout->client) {
+        // printf("Timeout Removed: client = %s, fd = %d\n", timeout->client->name.data(), timeout->file_descriptor);
+    } else {
+        // printf("Timeout Removed: noclient, fd = %d\n", timeout->file_descriptor);
+    }
+    epoll_ctl(app->epoll_fd, EPOLL_CTL_DEL, timeout->file_descriptor, NULL);
+    close(timeout->file_descriptor);
+    delete timeout;
 }
 
 void timeout_add(App *app, Timeout *t) {
@@ -87,6 +88,7 @@ void timeout_add(App *app, Timeout *t) {
         // printf("Timeout added: noclient, fd = %d\n", t->file_descriptor);
     }
 
+    std::lock_guard lock(app->registration_mutex);
     app->timeouts.push_back(t);
 }
 
@@ -279,7 +281,10 @@ bool poll_descriptor(App *app, int file_descriptor, int events, void function(Ap
     if (!app || !app->running) return false;
     
     PolledDescriptor polled = {file_descriptor, function};
-    app->descriptors_being_polled.push_back(polled);
+    {
+        std::lock_guard lock(app->registration_mutex);
+        app->descriptors_being_polled.push_back(polled);
+    }
     
     epoll_event event = {};
     event.events = events;
@@ -294,6 +299,21 @@ bool poll_descriptor(App *app, int file_descriptor, int events, void function(Ap
     return true;
 }
 
+void unpoll_descriptor(App *app, int file_descriptor) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    if (!app || file_descriptor == -1)
+        return;
+    epoll_ctl(app->epoll_fd, EPOLL_CTL_DEL, file_descriptor, NULL);
+    
+    std::lock_guard lock(app->registration_mutex);
+    auto &polled = app->descriptors_being_polled;
+    polled.erase(std::remove_if(polled.begin(), polled.end(), [file_descriptor](const PolledDescriptor &p) {
+        return p.file_descriptor == file_descriptor;
+    }), polled.end());
+}
+
 static xcb_visualtype_t *
 get_alpha_visualtype(xcb_screen_t *s) {
 #ifdef TRACY_ENABLE
@@ -335,24 +355,28 @@ void xcb_poll_wakeup(App *app, int fd);
 void timeout_poll_wakeup(App *app, int fd) {
     std::lock_guard lock(app->thread_mutex);
     
-    bool keep_running = false;
-    for (int timeout_index = 0; timeout_index < app->timeouts.size(); timeout_index++) {
-        Timeout *timeout = app->timeouts[timeout_index];
-        if (timeout->file_descriptor == fd) {
-            if (timeout->kill) {
-                keep_running = false;
-                timeout_stop_and_remove_timeout(app, timeout);
+    // Other threads can be adding timeouts, so the list is only looked at under registration_mutex
+    Timeout *timeout = nullptr;
+    {
+        std::lock_guard registration_lock(app->registration_mutex);
+        for (auto t: app->timeouts) {
+            if (t->file_descriptor == fd) {
+                timeout = t;
                 break;
             }
-            
+        }
+    }
+    
+    bool keep_running = false;
+    if (timeout) {
+        if (timeout->kill) {
+            timeout_stop_and_remove_timeout(app, timeout);
+        } else {
             if (timeout->function) {
                 timeout->function(app, timeout->client, timeout, timeout->user_data);
             }
-            if ((keep_running = timeout->keep_running))
-                break;
-            
-            timeout_stop_and_remove_timeout(app, timeout);
-            break;
+            if (!(keep_running = timeout->keep_running))
+                timeout_stop_and_remove_timeout(app, timeout);
         }
     }
     
@@ -363,6 +387,7 @@ void timeout_poll_wakeup(App *app, int fd) {
     if (keep_running)
         return;
     
+    std::lock_guard registration_lock(app->registration_mutex);
     for (int i = 0; i < app->descriptors_being_polled.size(); i++) {
         if (app->descriptors_being_polled[i].file_descriptor == fd) {
             app->descriptors_being_polled.erase(app->descriptors_being_polled.begin() + i);
@@ -406,21 +431,10 @@ App *app_new() {
     
     poll_descriptor(app, xcb_get_file_descriptor(app->connection), EPOLLIN, xcb_poll_wakeup);
     
-    auto atom_cookie = xcb_intern_atom(app->connection, 1, strlen("WM_PROTOCOLS"), "WM_PROTOCOLS");
-    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(app->connection, atom_cookie, NULL);
-    app->protocols_atom = reply->atom;
-    free(reply);
-    
-    atom_cookie =
-            xcb_intern_atom(app->connection, 0, strlen("WM_DELETE_WINDOW"), "WM_DELETE_WINDOW");
-    reply = xcb_intern_atom_reply(app->connection, atom_cookie, NULL);
-    app->delete_window_atom = reply->atom;
-    free(reply);
-    
-    atom_cookie = xcb_intern_atom(app->connection, 0, strlen("_MOTIF_WM_HINTS"), "_MOTIF_WM_HINTS");
-    reply = xcb_intern_atom_reply(app->connection, atom_cookie, NULL);
-    app->MOTIF_WM_HINTS = reply->atom;
-    free(reply);
+    intern_known_atoms(app);
+    app->protocols_atom = get_cached_atom(app, KnownAtom::WM_PROTOCOLS);
+    app->delete_window_atom = get_cached_atom(app, KnownAtom::WM_DELETE_WINDOW);
+    app->MOTIF_WM_HINTS = get_cached_atom(app, KnownAtom::MOTIF_WM_HINTS);
     
     dpi_setup(app);
     
@@ -465,6 +479,169 @@ xcb_screen_t *get_screen_from_screen_info(ScreenInformation *screen_info, App *a
     return nullptr;
 }
 
+// Popups are opened and closed constantly, so instead of destroying their windows
+// they're unmapped and parked here along with everything else that's expensive to
+// make (colormap, cairo surface, cursor, keyboard state). The next client_new with
+// the same name and window properties gets the parked window back, moved and resized.
+struct PooledWindow {
+    std::string name;
+    Settings settings;
+    xcb_window_t window = 0;
+    xcb_colormap_t colormap = 0;
+    cairo_t *cr = nullptr;
+    xcb_cursor_context_t *ctx = nullptr;
+    xcb_cursor_t cursor = -1;
+    ClientKeyboard *keyboard = nullptr;
+};
+
+static std::vector<PooledWindow> window_pool;
+
+// The settings every window was created with so we know if it can be pooled and reused
+static std::unordered_map<xcb_window_t, Settings> window_settings;
+
+// Everything that was baked into the window when it was created (geometry isn't)
+static bool
+same_window_properties(const Settings &a, const Settings &b) {
+    return a.background == b.background &&
+           a.force_position == b.force_position &&
+           a.decorations == b.decorations &&
+           a.reserve_side == b.reserve_side &&
+           a.skip_taskbar == b.skip_taskbar &&
+           a.no_input_focus == b.no_input_focus &&
+           a.dock == b.dock &&
+           a.sticky == b.sticky &&
+           a.window_transparent == b.window_transparent &&
+           a.override_redirect == b.override_redirect &&
+           a.keep_above == b.keep_above &&
+           a.slide == b.slide;
+}
+
+static void
+destroy_pooled_window(App *app, PooledWindow &pooled) {
+    window_settings.erase(pooled.window);
+    xcb_destroy_window(app->connection, pooled.window);
+    cairo_destroy(pooled.cr);
+    xcb_free_colormap(app->connection, pooled.colormap);
+    xcb_cursor_context_free(pooled.ctx);
+    if (pooled.keyboard) {
+        xkb_state_unref(pooled.keyboard->state);
+        xkb_keymap_unref(pooled.keyboard->keymap);
+        xkb_context_unref(pooled.keyboard->ctx);
+        delete pooled.keyboard;
+    }
+}
+
+// Returns true if the client's window was parked instead of needing to be destroyed
+static bool
+pool_window(App *app, AppClient *client) {
+    auto settings = window_settings.find(client->window);
+    if (settings == window_settings.end())
+        return false;
+    for (auto &pooled: window_pool)
+        if (pooled.name == client->name)
+            return false;
+    
+    PooledWindow pooled;
+    pooled.name = client->name;
+    pooled.settings = settings->second;
+    pooled.window = client->window;
+    pooled.colormap = client->colormap;
+    pooled.cr = client->cr;
+    pooled.ctx = client->ctx;
+    pooled.cursor = client->cursor;
+    pooled.keyboard = client->keyboard;
+    window_pool.push_back(pooled);
+    
+    delete client->bounds;
+    delete client->root;
+    return true;
+}
+
+static AppClient *
+client_from_pool(App *app, const PooledWindow &pooled, const Settings &settings) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    const uint32_t geometry[] = {(uint32_t) (int32_t) settings.x, (uint32_t) (int32_t) settings.y,
+                                 settings.w, settings.h};
+    xcb_configure_window(app->connection, pooled.window,
+                         XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+                         XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
+                         geometry);
+    if (settings.force_position) {
+        xcb_size_hints_t sizeHints;
+        sizeHints.flags = XCB_ICCCM_SIZE_HINT_US_POSITION;
+        sizeHints.x = settings.x;
+        sizeHints.y = settings.y;
+        xcb_icccm_set_wm_normal_hints(app->connection, pooled.window, &sizeHints);
+    }
+    if (settings.slide) {
+        xcb_atom_t atom = get_cached_atom(app, KnownAtom::KDE_SLIDE);
+        xcb_change_property(app->connection,
+                            XCB_PROP_MODE_REPLACE,
+                            pooled.window,
+                            atom,
+                            atom,
+                            32,
+                            5,
+                            &settings.slide_data);
+    }
+    cairo_xcb_surface_set_size(cairo_get_target(pooled.cr), settings.w, settings.h);
+    window_settings[pooled.window] = settings;
+    
+    AppClient *client = new AppClient();
+    init_client(client);
+    
+    client->app = app;
+    client->name = pooled.name;
+    client->window = pooled.window;
+    client->creation_time = get_current_time_in_ms();
+    client->from_pool = true;
+    
+    client->root->wanted_bounds.w = FILL_SPACE;
+    client->root->wanted_bounds.h = FILL_SPACE;
+    
+    client->bounds->x = settings.x;
+    client->bounds->y = settings.y;
+    client->bounds->w = settings.w;
+    client->bounds->h = settings.h;
+    client->colormap = pooled.colormap;
+    client->cr = pooled.cr;
+    client->ctx = pooled.ctx;
+    client->cursor = pooled.cursor;
+    client->keyboard = pooled.keyboard;
+    client->window_supports_transparency = settings.window_transparent;
+    
+    app->clients.push_back(client);
+    
+    return client;
+}
+
+void client_prewarm(App *app, Settings settings, const std::string &name) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    for (auto &pooled: window_pool)
+        if (pooled.name == name)
+            return;
+    if (auto client = client_new(app, settings, name)) {
+        for (int i = 0; i < app->clients.size(); i++) {
+            if (app->clients[i] == client) {
+                app->clients.erase(app->clients.begin() + i);
+            }
+        }
+        pool_window(app, client);
+        delete client;
+    }
+}
+
+void client_pool_clear(App *app) {
+    for (auto &pooled: window_pool)
+        destroy_pooled_window(app, pooled);
+    window_pool.clear();
+    xcb_flush(app->connection);
+}
+
 AppClient *
 client_new(App *app, Settings settings, const std::string &name) {
 #ifdef TRACY_ENABLE
@@ -475,6 +652,14 @@ client_new(App *app, Settings settings, const std::string &name) {
         return nullptr;
     }
     
+    for (int i = 0; i < window_pool.size(); i++) {
+        if (window_pool[i].name == name && same_window_properties(window_pool[i].settings, settings)) {
+            PooledWindow pooled = window_pool[i];
+            window_pool.erase(window_pool.begin() + i);
+            return client_from_pool(app, pooled, settings);
+        }
+    }
+    
     xcb_screen_t *screen = xcb_setup_roots_iterator(xcb_get_setup(app->connection)).data;
     
     ScreenInformation *primary_screen_info = nullptr;
@@ -552,20 +737,20 @@ client_new(App *app, Settings settings, const std::string &name) {
     
     if (settings.sticky) {
         long every_desktop = 0xFFFFFFFF;
-        xcb_atom_t atom = get_cached_atom(app, "_NET_WM_STATE_SKIP_PAGER");
+        xcb_atom_t atom = get_cached_atom(app, KnownAtom::NET_WM_STATE_SKIP_PAGER);
         xcb_change_property(app->connection,
                             XCB_PROP_MODE_APPEND,
                             window,
-                            get_cached_atom(app, "_NET_WM_DESKTOP"),
+                            get_cached_atom(app, KnownAtom::NET_WM_DESKTOP),
                             XCB_ATOM_CARDINAL,
                             32,
                             1,
                             &every_desktop);
-        atom = get_cached_atom(app, "_NET_WM_STATE");
+        atom = get_cached_atom(app, KnownAtom::NET_WM_STATE);
         xcb_change_property(app->connection,
                             XCB_PROP_MODE_APPEND,
                             window,
-                            get_cached_atom(app, "_NET_WM_STATE_ABOVE"),
+                            get_cached_atom(app, KnownAtom::NET_WM_STATE_ABOVE),
                             XCB_ATOM_ATOM,
                             32,
                             1,
@@ -573,7 +758,7 @@ client_new(App *app, Settings settings, const std::string &name) {
         xcb_change_property(app->connection,
                             XCB_PROP_MODE_APPEND,
                             window,
-                            get_cached_atom(app, "_NET_WM_STATE_STICKY"),
+                            get_cached_atom(app, KnownAtom::NET_WM_STATE_STICKY),
                             XCB_ATOM_ATOM,
                             32,
                             1,
@@ -582,21 +767,21 @@ client_new(App *app, Settings settings, const std::string &name) {
     
     // This is so we don't show up on our own taskbar
     if (settings.skip_taskbar) {
-        xcb_atom_t atom = get_cached_atom(app, "_NET_WM_STATE_SKIP_TASKBAR");
+        xcb_atom_t atom = get_cached_atom(app, KnownAtom::NET_WM_STATE_SKIP_TASKBAR);
         xcb_change_property(app->connection,
                             XCB_PROP_MODE_APPEND,
                             window,
-                            get_cached_atom(app, "_NET_WM_STATE"),
+                            get_cached_atom(app, KnownAtom::NET_WM_STATE),
                             XCB_ATOM_ATOM,
                             32,
                             1,
                             &atom);
         
-        atom = get_cached_atom(app, "_NET_WM_STATE_SKIP_PAGER");
+        atom = get_cached_atom(app, KnownAtom::NET_WM_STATE_SKIP_PAGER);
         xcb_change_property(app->connection,
                             XCB_PROP_MODE_APPEND,
                             window,
-                            get_cached_atom(app, "_NET_WM_STATE"),
+                            get_cached_atom(app, KnownAtom::NET_WM_STATE),
                             XCB_ATOM_ATOM,
                             32,
                             1,
@@ -614,16 +799,16 @@ client_new(App *app, Settings settings, const std::string &name) {
     }
     
     if (settings.dock) {
-        xcb_atom_t atom = get_cached_atom(app, "_NET_WM_WINDOW_TYPE_DOCK");
+        xcb_atom_t atom = get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_DOCK);
         xcb_ewmh_set_wm_window_type(&app->ewmh, window, 1, &atom);
     } else {
-        xcb_atom_t atom = get_cached_atom(app, "_NET_WM_WINDOW_TYPE_NORMAL");
+        xcb_atom_t atom = get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_NORMAL);
         xcb_ewmh_set_wm_window_type(&app->ewmh, window, 1, &atom);
     }
     
     if (settings.keep_above) {
-        xcb_atom_t atoms_state[2] = {get_cached_atom(app, "_NET_WM_STATE_ABOVE"),
-                                     get_cached_atom(app, "_NET_WM_STATE_STAYS_ON_TOP")};
+        xcb_atom_t atoms_state[2] = {get_cached_atom(app, KnownAtom::NET_WM_STATE_ABOVE),
+                                     get_cached_atom(app, KnownAtom::NET_WM_STATE_STAYS_ON_TOP)};
         xcb_ewmh_set_wm_state(&app->ewmh, window, 2, atoms_state);
     }
     
@@ -662,7 +847,7 @@ client_new(App *app, Settings settings, const std::string &name) {
     xcb_change_property_checked(app->connection,
                                 XCB_PROP_MODE_REPLACE,
                                 window,
-                                get_cached_atom(app, "_KDE_NET_WM_BLUR_BEHIND_REGION"),
+                                get_cached_atom(app, KnownAtom::KDE_NET_WM_BLUR_BEHIND_REGION),
                                 XCB_ATOM_CARDINAL,
                                 32,
                                 1,
@@ -689,7 +874,7 @@ client_new(App *app, Settings settings, const std::string &name) {
     }
     
     if (settings.slide) {
-        xcb_atom_t atom = get_cached_atom(app, "_KDE_SLIDE");
+        xcb_atom_t atom = get_cached_atom(app, KnownAtom::KDE_SLIDE);
         xcb_change_property(app->connection,
                             XCB_PROP_MODE_REPLACE,
                             window,
@@ -708,11 +893,14 @@ client_new(App *app, Settings settings, const std::string &name) {
         printf("Couldn't set the WM_CLASS property for client: %s\n", name.c_str());
     }
     
+    window_settings[window] = settings;
+    
     AppClient *client = new AppClient();
     init_client(client);
     
     client->app = app;
     client->name = name;
+    client->creation_time = get_current_time_in_ms();
     
     client->window = window;
 //    client->override_redirect = settings.override_redirect;
@@ -824,6 +1012,18 @@ void client_show(App *app, AppClient *client) {
     xcb_flush(app->connection);
     
     client_paint(app, client, true);
+    
+    if (client->popup_info.is_popup && client->creation_time != 0) {
+#ifdef TRACY_ENABLE
+        long open_time = get_current_time_in_ms() - client->creation_time;
+        if (client->from_pool) {
+            TracyPlot("Pooled popup open to first frame (ms)", open_time);
+        } else {
+            TracyPlot("Cold popup open to first frame (ms)", open_time);
+        }
+#endif
+        client->creation_time = 0;
+    }
 }
 
 void client_hide(App *app, AppClient *client) {
@@ -932,30 +1132,31 @@ void client_close(App *app, AppClient *client) {
         }
     }
     
-    app->timeouts.erase(std::remove_if(app->timeouts.begin(),
-                                       app->timeouts.end(),
-                                       [client](Timeout *timeout) {
-                                           auto *timeout_client = (AppClient *) timeout->client;
-                                           bool remove = timeout_client == client;
-                                           
-                                           if (remove) {
-                                               epoll_ctl(client->app->epoll_fd, EPOLL_CTL_DEL, timeout->file_descriptor,
-                                                         NULL);
-                                               close(timeout->file_descriptor);
-                                               delete timeout;
-                                           }
-                                           if (remove != (timeout_client == client)) {
-                                               // printf("----> Previously would've resulted in an error\n");
-                                           }
-                                           return remove;
-                                       }), app->timeouts.end());
+    {
+        std::lock_guard lock(app->registration_mutex);
+        app->timeouts.erase(std::remove_if(app->timeouts.begin(),
+                                           app->timeouts.end(),
+                                           [client](Timeout *timeout) {
+                                               auto *timeout_client = (AppClient *) timeout->client;
+                                               bool remove = timeout_client == client;
+                                               
+                                               if (remove) {
+                                                   epoll_ctl(client->app->epoll_fd, EPOLL_CTL_DEL,
+                                                             timeout->file_descriptor, NULL);
+                                                   close(timeout->file_descriptor);
+                                                   delete timeout;
+                                               }
+                                               if (remove != (timeout_client == client)) {
+                                                   // printf("----> Previously would've resulted in an error\n");
+                                               }
+                                               return remove;
+                                           }), app->timeouts.end());
+    }
     
     client->animations.clear();
     client->animations.shrink_to_fit();
     
     xcb_unmap_window(app->connection, client->window);
-    xcb_destroy_window(app->connection, client->window);
-    xcb_flush(app->connection);
     
     for (int i = 0; i < app->clients.size(); i++) {
         if (app->clients[i] == client) {
@@ -963,7 +1164,12 @@ void client_close(App *app, AppClient *client) {
         }
     }
     
-    destroy_client(app, client);
+    if (!client->popup_info.is_popup || !pool_window(app, client)) {
+        window_settings.erase(client->window);
+        xcb_destroy_window(app->connection, client->window);
+        destroy_client(app, client);
+    }
+    xcb_flush(app->connection);
     
     if (app->clients.empty()) {
         std::lock_guard m(app->running_mutex);
@@ -1087,6 +1293,29 @@ void client_paint(App *app, AppClient *client) {
     client_paint(app, client, false);
 }
 
+void client_paint_region(App *app, AppClient *client, Bounds region) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    if (valid_client(app, client)) {
+        if (client->cr && client->root) {
+            cairo_save(client->cr);
+            set_rect(client->cr, region);
+            cairo_clip(client->cr);
+            cairo_push_group(client->cr);
+            
+            paint_container(app, client, client->root);
+            
+            cairo_pop_group_to_source(client->cr);
+            cairo_set_operator(client->cr, CAIRO_OPERATOR_SOURCE);
+            cairo_paint(client->cr);
+            cairo_restore(client->cr);
+            
+            xcb_flush(app->connection);
+        }
+    }
+}
+
 Container *
 hovered_container(App *app, Container *root, int x, int y) {
     if (root == nullptr)
@@ -1809,6 +2038,14 @@ void handle_xcb_event(App *app, xcb_window_t window_number, xcb_generic_event_t
                     }
                 }
             }
+            // Parked keyboards have to keep up too so they're correct when reused
+            for (auto &pooled: window_pool) {
+                if (pooled.keyboard) {
+                    if (event->response_type == pooled.keyboard->first_xkb_event) {
+                        process_xkb_event(event, pooled.keyboard);
+                    }
+                }
+            }
             
             break;
         }
@@ -1817,6 +2054,33 @@ void handle_xcb_event(App *app, xcb_window_t window_number, xcb_generic_event_t
     client_paint(app, client_by_window(app, window_number), true);
 }
 
+// Calls back every pending reply that has come in. A callback can send requests of its own (whose replies may be
+// read in while polling for the others), so this keeps going until a whole pass finds nothing new.
+static void
+drain_pending_replies(App *app) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (int i = 0; i < app->pending_replies.size();) {
+            void *reply = nullptr;
+            xcb_generic_error_t *error = nullptr;
+            if (!xcb_poll_for_reply(app->connection, app->pending_replies[i].sequence, &reply, &error)) {
+                i++;
+                continue;
+            }
+            PendingReply pending = app->pending_replies[i];
+            app->pending_replies.erase(app->pending_replies.begin() + i);
+            free(error);
+            pending.function(app, reply, pending.user_data);
+            free(reply);
+            progress = true;
+        }
+    }
+}
+
 void handle_xcb_event(App *app) {
     if (app == nullptr)
         return;
@@ -1870,6 +2134,19 @@ void handle_xcb_event(App *app) {
         
         free(event);
     }
+    
+    // Reading events reads whatever replies came in with them, which won't wake epoll again
+    drain_pending_replies(app);
+}
+
+void app_when_reply(App *app, unsigned int sequence, void function(App *, void *reply, void *user_data),
+                    void *user_data) {
+    PendingReply pending;
+    pending.sequence = sequence;
+    pending.function = function;
+    pending.user_data = user_data;
+    app->pending_replies.push_back(pending);
+    xcb_flush(app->connection);
 }
 
 void xcb_poll_wakeup(App *app, int fd) {
@@ -1892,22 +2169,33 @@ void app_main(App *app) {
         app->loop++;
         
         for (int event_index = 0; event_index < event_count; event_index++) {
-            bool found = false;
-            for (auto polled: app->descriptors_being_polled) {
-                if (events[event_index].data.fd == polled.file_descriptor) {
-                    found = true;
-                    if (polled.function) {
-                        polled.function(app, polled.file_descriptor);
-                    }
+            int fd = events[event_index].data.fd;
+            // Looked up again for every event since an earlier callback could have unpolled this descriptor, and
+            // other threads can be adding descriptors, so it's done under registration_mutex
+            std::vector<PolledDescriptor> matching;
+            {
+                std::lock_guard lock(app->registration_mutex);
+                for (const auto &polled: app->descriptors_being_polled)
+                    if (polled.file_descriptor == fd)
+                        matching.push_back(polled);
+            }
+            for (const auto &polled: matching) {
+                if (polled.function) {
+                    polled.function(app, polled.file_descriptor);
                 }
             }
-            if (!found) {
+            if (matching.empty()) {
                 // printf("Epoll was awoke by a file descriptor that is not in our descriptors_being_polled anymore\n");
-                epoll_ctl(app->epoll_fd, EPOLL_CTL_DEL, events[event_index].data.fd, NULL);
-                close(events[event_index].data.fd);
+                // Not closed: it was unpolled by whoever owns it, who may have closed it and had the number reused
+                epoll_ctl(app->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
             }
         }
         
+        // Timeouts and descriptor callbacks can make xcb read in replies too (by waiting on a reply of their own),
+        // and nothing would wake us up for those. Whatever events got read in with them are handled as well.
+        if (!app->pending_replies.empty())
+            handle_xcb_event(app);
+        
         // TODO: we can't delete while we iterate.
         for (AppClient *client: app->clients) {
             if (client->marked_to_close) {
@@ -1933,6 +2221,9 @@ void app_clean(App *app) {
     app->clients.clear();
     app->clients.shrink_to_fit();
     
+    client_pool_clear(app);
+    window_settings.clear();
+    
     for (auto handler: app->handlers) {
         delete handler;
     }
@@ -2132,6 +2423,7 @@ void app_create_custom_event_handler(App *app, xcb_window_t window,
     auto *custom_event_handler = new Handler;
     custom_event_handler->event_handler = custom_handler;
     custom_event_handler->target_window = window;
+    std::lock_guard lock(app->registration_mutex);
     app->handlers.push_back(custom_event_handler);
 }
 
@@ -98,6 +98,15 @@ struct PolledDescriptor {
     void (*function)(App *, int fd);
 };
 
+// A request sent without waiting for its reply, see app_when_reply
+struct PendingReply {
+    unsigned int sequence;
+    
+    void (*function)(App *, void *reply, void *user_data);
+    
+    void *user_data = nullptr;
+};
+
 struct DBusConnection;
 
 struct App {
@@ -129,8 +138,15 @@ struct App {
     int epoll_fd = -1;
     std::vector<PolledDescriptor> descriptors_being_polled;
     
+    // Timeouts and polled descriptors can be added from other threads (startup tasks, the pulseaudio callbacks)
+    // while the main loop is running, so they're only read or changed while this is held. Handlers are only added
+    // from other threads during startup_run, before the main loop starts dispatching to them.
+    std::mutex registration_mutex;
+    
     std::vector<Timeout *> timeouts;
     
+    std::vector<PendingReply> pending_replies;
+    
     int loop = 0;
     
     // TODO: move atoms into their own things
@@ -167,6 +183,13 @@ void handle_xcb_event(App *app, xcb_window_t window_number, xcb_generic_event_t
 AppClient *
 client_new(App *app, Settings settings, const std::string &name);
 
+// Creates the window for a client ahead of time and parks it unmapped so the
+// first client_new with the same name and settings doesn't have to
+void client_prewarm(App *app, Settings settings, const std::string &name);
+
+// Destroys every parked popup window
+void client_pool_clear(App *app);
+
 AppClient *
 client_by_name(App *app, const std::string &target_name);
 
@@ -214,6 +237,9 @@ void client_paint(App *app, AppClient *client_entity);
 
 void client_paint(App *app, AppClient *client, bool force_repaint);
 
+// Repaints only what falls inside region (in window coordinates), for when a single container changed
+void client_paint_region(App *app, AppClient *client, Bounds region);
+
 void client_replace_root(App *app, AppClient *client_entity, Container *new_root);
 
 void client_layout(App *app, AppClient *client_entity);
@@ -275,4 +301,14 @@ void paint_container(App *app, AppClient *client, Container *container);
 
 bool poll_descriptor(App *app, int file_descriptor, int events, void function(App *, int fd));
 
+// Stops polling file_descriptor. Has to be called before the descriptor is closed, otherwise whatever is opened
+// next with the same number gets its events handed to the old function.
+void unpoll_descriptor(App *app, int file_descriptor);
+
+// Calls function (on the main thread) with the reply to the request once it arrives, instead of blocking on it.
+// The reply is nullptr if the request failed, and is freed after function returns.
+// Has to be called from the main thread and the request has to be a checked one.
+void app_when_reply(App *app, unsigned int sequence, void function(App *, void *reply, void *user_data),
+                    void *user_data = nullptr);
+
 #endif
\ No newline at end of file
@@ -209,6 +209,11 @@ struct AppClient {
     
     long last_repaint_time;
     
+    // When client_new handed this client out, cleared after its first frame
+    long creation_time = 0;
+    // If it was handed out from the pool of parked popup windows instead of being created
+    bool from_pool = false;
+    
     // Variables to limit how often we handle motion notify events
     float motion_events_per_second = 30;
     int motion_event_x = 0;
@@ -16,6 +16,9 @@
 #include <cassert>
 #include <sys/wait.h>
 #include <xcb/xcb_aux.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 void dye_surface(cairo_surface_t *surface, ArgbColor argb_color) {
 #ifdef TRACY_ENABLE
@@ -237,12 +240,125 @@ get_cached_pango_font(cairo_t *cr, std::string name, int pixel_height, PangoWeig
     return font->layout;
 }
 
+struct TextLayoutKey {
+    std::string text;
+    std::string font;
+    int size;
+    PangoWeight weight;
+    int width;
+    PangoWrapMode wrap;
+    PangoEllipsizeMode ellipsize;
+    bool markup;
+    std::string (*markup_fallback)(const std::string &text);
+    
+    bool operator==(const TextLayoutKey &other) const {
+        return size == other.size && weight == other.weight && width == other.width && wrap == other.wrap &&
+               ellipsize == other.ellipsize && markup == other.markup && markup_fallback == other.markup_fallback &&
+               text == other.text && font == other.font;
+    }
+};
+
+struct TextLayoutKeyHash {
+    size_t operator()(const TextLayoutKey &key) const {
+        size_t hash = std::hash<std::string>()(key.text);
+        for (size_t part: {std::hash<std::string>()(key.font), (size_t) key.size, (size_t) key.weight,
+                           (size_t) key.width, (size_t) key.wrap, (size_t) key.ellipsize, (size_t) key.markup,
+                           (size_t) key.markup_fallback})
+            hash ^= part + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+};
+
+struct StoredTextLayout {
+    CachedTextLayout cached;
+    std::list<TextLayoutKey>::iterator lru_position;
+};
+
+static std::unordered_map<TextLayoutKey, StoredTextLayout, TextLayoutKeyHash> text_layouts;
+static std::list<TextLayoutKey> text_layout_lru; // most recently used first
+static long text_layout_hits = 0;
+static long text_layout_misses = 0;
+
+// Enough for every row of a long menu and then some, at a few kilobytes each
+static const size_t text_layout_limit = 1024;
+
+const CachedTextLayout *
+get_cached_text_layout(cairo_t *cr, const std::string &text, const std::string &font, int pixel_height,
+                       PangoWeight weight, int width, PangoWrapMode wrap, PangoEllipsizeMode ellipsize, bool markup,
+                       std::string (*markup_fallback)(const std::string &text)) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    TextLayoutKey key{text, font, pixel_height, weight, width, wrap, ellipsize, markup, markup_fallback};
+    auto it = text_layouts.find(key);
+    if (it != text_layouts.end()) {
+        text_layout_hits++;
+#ifdef TRACY_ENABLE
+        TracyPlot("Text layout cache hit rate (%)", 100.0 * text_layout_hits / (text_layout_hits + text_layout_misses));
+#endif
+        text_layout_lru.splice(text_layout_lru.begin(), text_layout_lru, it->second.lru_position);
+        return &it->second.cached;
+    }
+    text_layout_misses++;
+    
+    PangoLayout *layout = pango_cairo_create_layout(cr);
+    PangoFontDescription *desc = pango_font_description_new();
+    pango_font_description_set_size(desc, pixel_height * PANGO_SCALE);
+    pango_font_description_set_family(desc, font.c_str());
+    pango_font_description_set_weight(desc, weight);
+    pango_layout_set_font_description(layout, desc);
+    pango_font_description_free(desc);
+    
+    pango_layout_set_width(layout, width == -1 ? -1 : width * PANGO_SCALE);
+    pango_layout_set_wrap(layout, wrap);
+    pango_layout_set_ellipsize(layout, ellipsize);
+    
+    PangoAttrList *attrs = nullptr;
+    char *parsed_text = nullptr;
+    if (markup && pango_parse_markup(text.data(), text.length(), 0, &attrs, &parsed_text, nullptr, nullptr)) {
+        pango_layout_set_text(layout, parsed_text, -1);
+        pango_layout_set_attributes(layout, attrs);
+        pango_attr_list_unref(attrs);
+        g_free(parsed_text);
+    } else if (markup && markup_fallback) {
+        const std::string &fallback = markup_fallback(text);
+        pango_layout_set_text(layout, fallback.data(), fallback.length());
+    } else {
+        // Text that isn't valid markup is shown as is
+        pango_layout_set_text(layout, text.data(), text.length());
+    }
+    
+    if (text_layouts.size() >= text_layout_limit) {
+        auto oldest = text_layouts.find(text_layout_lru.back());
+        g_object_unref(oldest->second.cached.layout);
+        text_layouts.erase(oldest);
+        text_layout_lru.pop_back();
+    }
+    
+    text_layout_lru.push_front(key);
+    StoredTextLayout &stored = text_layouts[std::move(key)];
+    stored.lru_position = text_layout_lru.begin();
+    stored.cached.layout = layout;
+    pango_layout_get_extents(layout, &stored.cached.ink, &stored.cached.logical);
+    return &stored.cached;
+}
+
+void text_layout_cache_stats(long *hits, long *misses) {
+    *hits = text_layout_hits;
+    *misses = text_layout_misses;
+}
+
 void cleanup_cached_fonts() {
     for (auto font: cached_fonts) {
         delete font;
     }
     cached_fonts.clear();
     cached_fonts.shrink_to_fit();
+    
+    for (auto &text_layout: text_layouts)
+        g_object_unref(text_layout.second.cached.layout);
+    text_layouts.clear();
+    text_layout_lru.clear();
 }
 
 #define get_window_from_casted_event__explicit_member(X, Y, W) \
@@ -310,38 +426,61 @@ intern_atom(xcb_connection_t *conn, const char *atom) {
     return result;
 }
 
-struct CachedAtom {
-    std::string name;
-    xcb_atom_t atom;
-    
-    ~CachedAtom() {}
+static const char *known_atom_names[] = {
+#define KNOWN_ATOM_NAME(id, name) name,
+        KNOWN_ATOMS(KNOWN_ATOM_NAME)
+#undef KNOWN_ATOM_NAME
 };
 
-std::vector<CachedAtom *> cached_atoms;
+static xcb_atom_t known_atoms[(int) KnownAtom::COUNT] = {};
+
+// Can be asked for from the startup threads
+static std::mutex cached_atoms_mutex;
+static std::unordered_map<std::string, xcb_atom_t> cached_atoms;
+
+void intern_known_atoms(App *app) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    const int count = (int) KnownAtom::COUNT;
+    xcb_intern_atom_cookie_t cookies[count];
+    for (int i = 0; i < count; i++)
+        cookies[i] = xcb_intern_atom(app->connection, 0, strlen(known_atom_names[i]), known_atom_names[i]);
+    
+    std::lock_guard lock(cached_atoms_mutex);
+    for (int i = 0; i < count; i++) {
+        xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(app->connection, cookies[i], nullptr);
+        known_atoms[i] = reply ? reply->atom : XCB_NONE;
+        free(reply);
+        cached_atoms[known_atom_names[i]] = known_atoms[i];
+    }
+}
+
+xcb_atom_t
+get_cached_atom(App *app, KnownAtom atom) {
+    return known_atoms[(int) atom];
+}
 
 xcb_atom_t
-get_cached_atom(App *app, std::string name) {
+get_cached_atom(App *app, const std::string &name) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    for (auto cached_atom: cached_atoms) {
-        if (cached_atom->name == name) {
-            return cached_atom->atom;
-        }
+    {
+        std::lock_guard lock(cached_atoms_mutex);
+        auto it = cached_atoms.find(name);
+        if (it != cached_atoms.end())
+            return it->second;
     }
-    auto *cached_atom = new CachedAtom;
-    cached_atom->name = name;
-    cached_atom->atom = intern_atom(app->connection, name.c_str());
-    cached_atoms.push_back(cached_atom);
-    return cached_atom->atom;
+    xcb_atom_t atom = intern_atom(app->connection, name.c_str());
+    std::lock_guard lock(cached_atoms_mutex);
+    cached_atoms[name] = atom;
+    return atom;
 }
 
 void cleanup_cached_atoms() {
-    for (auto cached_atom: cached_atoms) {
-        delete cached_atom;
-    }
+    std::lock_guard lock(cached_atoms_mutex);
     cached_atoms.clear();
-    cached_atoms.shrink_to_fit();
 }
 
 void launch_command(std::string command) {
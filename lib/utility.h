@@ -87,11 +87,85 @@ get_cached_pango_font(cairo_t *cr, std::string name, int pixel_height, PangoWeig
 
 void cleanup_cached_fonts();
 
+// A layout that already has its text set and shaped, along with its extents in pango units
+struct CachedTextLayout {
+    PangoLayout *layout = nullptr;
+    PangoRectangle ink{};
+    PangoRectangle logical{};
+};
+
+// Text that's painted every frame (menu rows, labels) is only shaped the first time it's asked for, and the least
+// recently used layouts are thrown out past a limit. width is in pixels, -1 for none. With markup, tags in the text
+// (like <b>) become attributes, and text that isn't valid markup is shown as whatever markup_fallback turns it into
+// (as is when there's none). The layout is shared so it mustn't be changed, and the pointer is only good until the
+// next call.
+const CachedTextLayout *
+get_cached_text_layout(cairo_t *cr, const std::string &text, const std::string &font, int pixel_height,
+                       PangoWeight weight, int width = -1, PangoWrapMode wrap = PANGO_WRAP_WORD,
+                       PangoEllipsizeMode ellipsize = PANGO_ELLIPSIZE_NONE, bool markup = false,
+                       std::string (*markup_fallback)(const std::string &text) = nullptr);
+
+// How many times get_cached_text_layout found what it was asked for, and how many times it had to shape it
+void text_layout_cache_stats(long *hits, long *misses);
+
 xcb_window_t
 get_window(xcb_generic_event_t *event);
 
+// Every atom whose name is known ahead of time, interned all at once by intern_known_atoms
+#define KNOWN_ATOMS(X) \
+        X(GTK_APPLICATION_ID, "_GTK_APPLICATION_ID") \
+        X(GTK_FRAME_EXTENTS, "_GTK_FRAME_EXTENTS") \
+        X(KDE_NET_WM_BLUR_BEHIND_REGION, "_KDE_NET_WM_BLUR_BEHIND_REGION") \
+        X(KDE_SLIDE, "_KDE_SLIDE") \
+        X(MANAGER, "MANAGER") \
+        X(MOTIF_WM_HINTS, "_MOTIF_WM_HINTS") \
+        X(NET_ACTIVE_WINDOW, "_NET_ACTIVE_WINDOW") \
+        X(NET_CLIENT_LIST_STACKING, "_NET_CLIENT_LIST_STACKING") \
+        X(NET_SHOWING_DESKTOP, "_NET_SHOWING_DESKTOP") \
+        X(NET_SYSTEM_TRAY_OPCODE, "_NET_SYSTEM_TRAY_OPCODE") \
+        X(NET_WM_CLASS, "_NET_WM_CLASS") \
+        X(NET_WM_DESKTOP, "_NET_WM_DESKTOP") \
+        X(NET_WM_NAME, "_NET_WM_NAME") \
+        X(NET_WM_STATE, "_NET_WM_STATE") \
+        X(NET_WM_STATE_ABOVE, "_NET_WM_STATE_ABOVE") \
+        X(NET_WM_STATE_DEMANDS_ATTENTION, "_NET_WM_STATE_DEMANDS_ATTENTION") \
+        X(NET_WM_STATE_SKIP_PAGER, "_NET_WM_STATE_SKIP_PAGER") \
+        X(NET_WM_STATE_SKIP_TASKBAR, "_NET_WM_STATE_SKIP_TASKBAR") \
+        X(NET_WM_STATE_STAYS_ON_TOP, "_NET_WM_STATE_STAYS_ON_TOP") \
+        X(NET_WM_STATE_STICKY, "_NET_WM_STATE_STICKY") \
+        X(NET_WM_WINDOW_TYPE, "_NET_WM_WINDOW_TYPE") \
+        X(NET_WM_WINDOW_TYPE_COMBO, "_NET_WM_WINDOW_TYPE_COMBO") \
+        X(NET_WM_WINDOW_TYPE_DESKTOP, "_NET_WM_WINDOW_TYPE_DESKTOP") \
+        X(NET_WM_WINDOW_TYPE_DND, "_NET_WM_WINDOW_TYPE_DND") \
+        X(NET_WM_WINDOW_TYPE_DOCK, "_NET_WM_WINDOW_TYPE_DOCK") \
+        X(NET_WM_WINDOW_TYPE_DROPDOWN_MENU, "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU") \
+        X(NET_WM_WINDOW_TYPE_NORMAL, "_NET_WM_WINDOW_TYPE_NORMAL") \
+        X(NET_WM_WINDOW_TYPE_NOTIFICATION, "_NET_WM_WINDOW_TYPE_NOTIFICATION") \
+        X(NET_WM_WINDOW_TYPE_POPUP_MENU, "_NET_WM_WINDOW_TYPE_POPUP_MENU") \
+        X(NET_WM_WINDOW_TYPE_TOOLTIP, "_NET_WM_WINDOW_TYPE_TOOLTIP") \
+        X(WM_CHANGE_STATE, "WM_CHANGE_STATE") \
+        X(WM_CLASS, "WM_CLASS") \
+        X(WM_DELETE_WINDOW, "WM_DELETE_WINDOW") \
+        X(WM_NAME, "WM_NAME") \
+        X(WM_PROTOCOLS, "WM_PROTOCOLS") \
+        X(WM_STATE, "WM_STATE")
+
+enum class KnownAtom {
+#define KNOWN_ATOM_ID(id, name) id,
+    KNOWN_ATOMS(KNOWN_ATOM_ID)
+#undef KNOWN_ATOM_ID
+    COUNT
+};
+
+// Sends every intern request before reading any of the replies, so it costs one round trip
+void intern_known_atoms(App *app);
+
+xcb_atom_t
+get_cached_atom(App *app, KnownAtom atom);
+
+// For names only known at runtime, interned (blocking) the first time they're asked for
 xcb_atom_t
-get_cached_atom(App *app, std::string name);
+get_cached_atom(App *app, const std::string &name);
 
 void cleanup_cached_atoms();
 
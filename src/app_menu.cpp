@@ -8,7 +8,6 @@
 
 #endif
 
-#include "INIReader.h"
 #include "application.h"
 #include "components.h"
 #include "config.h"
@@ -17,6 +16,7 @@
 #include "search_menu.h"
 #include "taskbar.h"
 #include "globals.h"
+#include "launcher_sort.h"
 
 #include <cmath>
 #include <pango/pangocairo.h>
@@ -25,13 +25,24 @@
 #include <xcb/xcb_aux.h>
 #include <hsluv.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/inotify.h>
 #include "functional"
 
 std::vector<Launcher *> launchers;
 
 class ItemData : public HoverableButton {
 public:
-    Launcher *launcher = nullptr;
+    int row = -1;
 };
 
 class ButtonData : public IconButton {
@@ -39,6 +50,26 @@ public:
     std::string text;
 };
 
+// The app list is laid out as a flat list of rows with fixed heights, but only the
+// rows that intersect the scroll pane are given containers. Those come from a pool
+// where row r is always bound to slot r % pool size, so a row keeps its container
+// (and hover state) for as long as it stays on screen while scrolling.
+struct AppMenuRow {
+    Launcher *launcher = nullptr; // nullptr for section titles
+    std::string title;
+    int y = 0;
+    int h = 0;
+};
+
+static std::vector<AppMenuRow> app_menu_rows;
+static std::vector<Container *> row_pool;
+static int bound_first_row = -1;
+static int bound_last_row = -1;
+
+static const int item_row_height = 36;
+static const int title_row_height = 34;
+static const int row_spacing = 2;
+
 // the scrollbar should only open if the mouse is in the scrollbar
 static double scrollbar_openess = 0;
 // the scrollbar should only be visible if the mouse is in the container
@@ -191,6 +222,14 @@ clicked_title(AppClient *client, cairo_t *cr, Container *container) {
     }
 }
 
+static int
+title_row(const std::string &title) {
+    for (int i = 0; i < app_menu_rows.size(); i++)
+        if (!app_menu_rows[i].launcher && app_menu_rows[i].title == title)
+            return i;
+    return -1;
+}
+
 static void
 clicked_grid(AppClient *client, cairo_t *cr, Container *container) {
 #ifdef TRACY_ENABLE
@@ -198,9 +237,10 @@ clicked_grid(AppClient *client, cairo_t *cr, Container *container) {
 #endif
     // Set the correct scroll offset
     auto data = (ButtonData *) container->user_data;
-    if (auto c = container_by_name(data->text, client->root)) {
+    int row = title_row(data->text);
+    if (row != -1) {
         if (auto scroll_pane = container_by_name("scroll_pane", client->root)) {
-            int offset = get_offset(c, scroll_pane) + scroll_pane->children_bounds.y;
+            int offset = app_menu_rows[row].y + scroll_pane->children_bounds.y;
             scroll_pane->scroll_v_real = -offset;
             scroll_pane->scroll_v_visual = scroll_pane->scroll_v_real;
             ::layout(client, cr, scroll_pane->parent, scroll_pane->real_bounds);
@@ -217,8 +257,10 @@ clicked_item(AppClient *client, cairo_t *cr, Container *container) {
 #endif
     
     auto *data = (ItemData *) container->user_data;
+    if (data->row < 0 || data->row >= app_menu_rows.size())
+        return;
     set_textarea_inactive();
-    launch_command(data->launcher->exec);
+    launch_command(app_menu_rows[data->row].launcher->exec);
     client_close_threaded(app, client);
     xcb_flush(app->connection);
     app->grab_window = -1;
@@ -234,6 +276,7 @@ paint_item(AppClient *client, cairo_t *cr, Container *container) {
     }
     
     auto *data = (ItemData *) container->user_data;
+    Launcher *launcher = app_menu_rows[data->row].launcher;
     
     if (container->state.mouse_pressing || container->state.mouse_hovering) {
         if (container->state.mouse_pressing) {
@@ -251,25 +294,18 @@ paint_item(AppClient *client, cairo_t *cr, Container *container) {
         cairo_fill(cr);
     }
     
-    PangoLayout *layout =
-            get_cached_pango_font(cr, config->font, 9, PangoWeight::PANGO_WEIGHT_NORMAL);
-    std::string text = data->launcher->name;
-    pango_layout_set_text(layout, text.c_str(), text.size());
-    
-    PangoRectangle ink;
-    PangoRectangle logical;
-    pango_layout_get_extents(layout, &ink, &logical);
+    auto text_layout = get_cached_text_layout(cr, launcher->name, config->font, 9, PangoWeight::PANGO_WEIGHT_NORMAL);
     
     set_argb(cr, config->color_apps_text);
     cairo_move_to(cr,
                   container->real_bounds.x + 44,
                   container->real_bounds.y + container->real_bounds.h / 2 -
-                  ((logical.height / PANGO_SCALE) / 2));
-    pango_cairo_show_layout(cr, layout);
+                  ((text_layout->logical.height / PANGO_SCALE) / 2));
+    pango_cairo_show_layout(cr, text_layout->layout);
     
-    if (data->launcher->icon_24) {
+    if (launcher->icon_24) {
         cairo_set_source_surface(cr,
-                                 data->launcher->icon_24,
+                                 launcher->icon_24,
                                  (int) (container->real_bounds.x + 4 + 4),
                                  (int) (container->real_bounds.y + 2 + 4));
         cairo_paint(cr);
@@ -291,7 +327,7 @@ paint_item_title(AppClient *client, cairo_t *cr, Container *container) {
         return;
     }
     
-    auto *data = (ButtonData *) container->user_data;
+    auto *data = (ItemData *) container->user_data;
     
     if (container->state.mouse_hovering || container->state.mouse_pressing) {
         if (container->state.mouse_pressing) {
@@ -303,26 +339,85 @@ paint_item_title(AppClient *client, cairo_t *cr, Container *container) {
         cairo_fill(cr);
     }
     
-    PangoLayout *layout =
-            get_cached_pango_font(cr, config->font, 9, PangoWeight::PANGO_WEIGHT_NORMAL);
-    std::string text(data->text);
-    pango_layout_set_text(layout, text.c_str(), text.size());
-    
-    PangoRectangle ink;
-    PangoRectangle logical;
-    pango_layout_get_extents(layout, &ink, &logical);
+    auto text_layout = get_cached_text_layout(cr, app_menu_rows[data->row].title, config->font, 9,
+                                              PangoWeight::PANGO_WEIGHT_NORMAL);
     
     set_argb(cr, config->color_apps_text);
     cairo_move_to(cr,
                   container->real_bounds.x + 3,
                   container->real_bounds.y + container->real_bounds.h / 2 -
-                  ((logical.height / PANGO_SCALE) / 2));
-    pango_cairo_show_layout(cr, layout);
+                  ((text_layout->logical.height / PANGO_SCALE) / 2));
+    pango_cairo_show_layout(cr, text_layout->layout);
+}
+
+// Binds pool containers to the rows that intersect the scroll pane and lays them out
+static void
+bind_visible_rows(AppClient *client, cairo_t *cr, Container *content) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    Container *content_area = content->parent;
+    
+    int needed = (int) std::ceil(content_area->real_bounds.h / (title_row_height + row_spacing)) + 2;
+    if (needed > row_pool.size()) {
+        while (row_pool.size() < needed) {
+            auto *slot = new Container(FILL_SPACE, item_row_height);
+            slot->parent = content;
+            slot->user_data = new ItemData;
+            slot->exists = false;
+            content->children.push_back(slot);
+            row_pool.push_back(slot);
+        }
+        // The modulo changed so every row needs to be rebound
+        for (auto slot: row_pool)
+            ((ItemData *) slot->user_data)->row = -1;
+        bound_first_row = -1;
+    }
     
-    if (data->surface) {
-        cairo_set_source_surface(cr, data->surface, container->real_bounds.x, container->real_bounds.y);
-        cairo_paint(cr);
+    double top = content_area->real_bounds.y - content->real_bounds.y;
+    double bottom = top + content_area->real_bounds.h;
+    auto first = std::upper_bound(app_menu_rows.begin(), app_menu_rows.end(), top,
+                                  [](double y, const AppMenuRow &row) { return y < row.y + row.h; });
+    auto last = std::lower_bound(first, app_menu_rows.end(), bottom,
+                                 [](const AppMenuRow &row, double y) { return row.y < y; });
+    int first_row = first - app_menu_rows.begin();
+    int last_row = std::min((int) (last - app_menu_rows.begin()), first_row + (int) row_pool.size());
+    if (first_row == bound_first_row && last_row == bound_last_row)
+        return;
+    bound_first_row = first_row;
+    bound_last_row = last_row;
+    
+    content->children.clear();
+    for (int r = first_row; r < last_row; r++) {
+        Container *slot = row_pool[r % row_pool.size()];
+        auto *data = (ItemData *) slot->user_data;
+        if (data->row != r) {
+            data->row = r;
+            bool is_title = app_menu_rows[r].launcher == nullptr;
+            slot->when_paint = is_title ? paint_item_title : paint_item;
+            slot->when_clicked = is_title ? clicked_title : clicked_item;
+            slot->wanted_bounds.h = app_menu_rows[r].h;
+        }
+        slot->exists = true;
+        content->children.push_back(slot);
+    }
+    // Unused slots stay children so they are freed with the rest of the tree
+    for (auto slot: row_pool) {
+        auto *data = (ItemData *) slot->user_data;
+        if (data->row < first_row || data->row >= last_row) {
+            data->row = -1;
+            slot->exists = false;
+            content->children.push_back(slot);
+        }
     }
+    
+    content->wanted_pad.y = first_row < app_menu_rows.size() ? app_menu_rows[first_row].y : 0;
+    ::layout(client, cr, content, content->real_bounds);
+}
+
+static void
+paint_app_list(AppClient *client, cairo_t *cr, Container *container) {
+    bind_visible_rows(client, cr, container);
 }
 
 static void
@@ -549,6 +644,7 @@ void scrolled_content_area(AppClient *client,
     }
     
     scrollpane_scrolled(client, cr, container, scroll_x, scroll_y);
+    bind_visible_rows(client, cr, container->children[0]);
 }
 
 static void
@@ -881,7 +977,24 @@ fill_root(AppClient *client) {
     content_area->wanted_pad = Bounds(13, 8, settings.right_width + 1, 54);
     
     Container *content = content_area->child(FILL_SPACE, 0);
-    content->spacing = 2;
+    content->spacing = row_spacing;
+    content->when_paint = paint_app_list;
+    
+    app_menu_rows.clear();
+    row_pool.clear();
+    bound_first_row = -1;
+    bound_last_row = -1;
+    
+    int rows_offset = 0;
+    auto add_row = [&rows_offset](Launcher *launcher, const std::string &title) {
+        AppMenuRow row;
+        row.launcher = launcher;
+        row.title = title;
+        row.y = rows_offset;
+        row.h = launcher ? item_row_height : title_row_height;
+        rows_offset += row.h + row_spacing;
+        app_menu_rows.push_back(row);
+    };
     
     char previous_char = '\0';
     int previous_priority = 0;
@@ -892,53 +1005,23 @@ fill_root(AppClient *client) {
             char new_char = std::tolower(l->name.at(0));
             if (previous_char != new_char) {
                 previous_char = new_char;
-                
-                auto *data = new ButtonData();
-                data->text = std::toupper(new_char);
-                auto *title = new Container();
-                title->parent = content;
-                title->name = data->text;
-                content->children.push_back(title);
-                
-                title->wanted_bounds.w = FILL_SPACE;
-                title->wanted_bounds.h = 34;
-                title->when_paint = paint_item_title;
-                title->when_clicked = clicked_title;
-                
-                title->user_data = data;
+                add_row(nullptr, std::string(1, (char) std::toupper(new_char)));
             }
         } else if (previous_priority != l->app_menu_priority) {
             previous_priority = l->app_menu_priority;
             
-            auto *title = new Container();
-            title->parent = content;
-            content->children.push_back(title);
-            
-            title->wanted_bounds.w = FILL_SPACE;
-            title->wanted_bounds.h = 34;
-            title->when_paint = paint_item_title;
-            title->when_clicked = clicked_title;
-            
-            auto *data = new ButtonData();
             if (l->app_menu_priority == 1) {
-                title->name = "Recently added";
-                data->text = "Recently added";
+                add_row(nullptr, "Recently added");
             } else if (l->app_menu_priority == 2) {
-                title->name = "&";
-                data->text = "&";
+                add_row(nullptr, "&");
             } else if (l->app_menu_priority == 3) {
-                title->name = "#";
-                data->text = "#";
+                add_row(nullptr, "#");
+            } else {
+                add_row(nullptr, "");
             }
-            title->user_data = data;
         }
         
-        auto *child = content->child(FILL_SPACE, 36);
-        auto *data = new ItemData;
-        data->launcher = l;
-        child->user_data = data;
-        child->when_paint = paint_item;
-        child->when_clicked = clicked_item;
+        add_row(l, "");
     }
     
     int count = 0;
@@ -956,25 +1039,25 @@ fill_root(AppClient *client) {
             auto data = new ButtonData;
             c->user_data = data;
             if (count == 1) { // Recent
-                if (!container_by_name("Recently added", root)) {
+                if (title_row("Recently added") == -1) {
                     c->interactable = false;
                 }
                 data->surface = accelerated_surface(app, client, 20, 20);
                 paint_png_to_surface(data->surface, as_resource_path("recent.png"), 20);
                 data->text = "Recently added";
             } else if (count == 2) { // &
-                if (!container_by_name("&", root)) {
+                if (title_row("&") == -1) {
                     c->interactable = false;
                 }
                 data->text = "&";
             } else if (count == 3) { // Numbers
-                if (!container_by_name("#", root)) {
+                if (title_row("#") == -1) {
                     c->interactable = false;
                 }
                 data->text = "#";
             } else { // ASCII
                 data->text = (char) (61 + count);
-                if (!container_by_name(data->text, root)) {
+                if (title_row(data->text) == -1) {
                     c->interactable = false;
                 }
             }
@@ -983,7 +1066,8 @@ fill_root(AppClient *client) {
     }
     grid->child(FILL_SPACE, FILL_SPACE);
     
-    content->wanted_bounds.h = true_height(content_area) + true_height(content);
+    int rows_height = app_menu_rows.empty() ? 0 : rows_offset - row_spacing;
+    content->wanted_bounds.h = true_height(content_area) + rows_height;
 }
 
 static void
@@ -992,14 +1076,14 @@ app_menu_closed(AppClient *client) {
 }
 
 static void
-paint_desktop_files() {
+paint_desktop_files(const std::vector<Launcher *> &to_paint) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
     std::lock_guard m(app->running_mutex); // No one is allowed to stop Winbar until this function finishes
     
     std::vector<IconTarget> targets;
-    for (auto *launcher: launchers) {
+    for (auto *launcher: to_paint) {
         launcher->icon = c3ic_fix_desktop_file_icon(launcher->name, launcher->wmclass, launcher->icon, launcher->icon);
         if (!launcher->icon.empty()) {
             targets.emplace_back(IconTarget(launcher->icon, launcher));
@@ -1126,173 +1210,768 @@ void eraseSubStrings(std::string &mainStr, const std::vector<std::string> &strLi
     std::for_each(strList.begin(), strList.end(), std::bind(eraseAllSubStr, std::ref(mainStr), std::placeholders::_1));
 }
 
-void load_desktop_files(std::string directory) {
-    auto c = getenv("XDG_CURRENT_DESKTOP");
-    std::string paths;
-    if (c) paths = std::string(c);
-    std::stringstream input(paths);
+// The keys we care about from a .desktop file, stored raw so that filtering by
+// XDG_CURRENT_DESKTOP can be redone against cached entries
+struct DesktopEntry {
+    std::string path;
+    int64_t mtime_sec = 0;
+    int64_t mtime_nsec = 0;
+    
+    std::string name;
+    std::string wmclass;
+    std::string exec;
+    std::string icon;
+    std::string no_display;
+    std::string not_show_in;
+    std::string only_show_in;
+};
+
+static const char *desktop_cache_header = "winbar_desktop_cache 2";
+
+static std::string
+desktop_cache_path() {
+    const char *home = getenv("HOME");
+    std::string path(home);
+    path += "/.cache/winbar_desktop_cache/desktop.cache";
+    return path;
+}
+
+// Cache layout: header, locale the names were picked for, then for every entry: path, mtime seconds,
+// mtime nanoseconds, name, wmclass, exec, icon, no_display, not_show_in and only_show_in.
+// Every field is terminated by a '\0'.
+static std::unordered_map<std::string, DesktopEntry>
+read_desktop_cache(const std::string &locale) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::unordered_map<std::string, DesktopEntry> cached;
+    
+    int file_descriptor = open(desktop_cache_path().c_str(), O_RDONLY);
+    if (file_descriptor == -1)
+        return cached;
+    struct stat sb{};
+    if (fstat(file_descriptor, &sb) == -1 || sb.st_size == 0) {
+        close(file_descriptor);
+        return cached;
+    }
+    char *data = (char *) mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+    if (data == MAP_FAILED)
+        return cached;
+    
+    const char *position = data;
+    const char *end = data + sb.st_size;
+    auto next_field = [&position, end](std::string *field) {
+        auto *terminator = (const char *) memchr(position, '\0', end - position);
+        if (!terminator)
+            return false;
+        field->assign(position, terminator - position);
+        position = terminator + 1;
+        return true;
+    };
+    
+    std::string field;
+    std::string cached_locale;
+    if (next_field(&field) && field == desktop_cache_header && next_field(&cached_locale) && cached_locale == locale) {
+        std::string sec, nsec;
+        while (position < end) {
+            DesktopEntry entry;
+            if (!next_field(&entry.path) || !next_field(&sec) || !next_field(&nsec) ||
+                !next_field(&entry.name) || !next_field(&entry.wmclass) || !next_field(&entry.exec) ||
+                !next_field(&entry.icon) || !next_field(&entry.no_display) ||
+                !next_field(&entry.not_show_in) || !next_field(&entry.only_show_in)) {
+                break;
+            }
+            entry.mtime_sec = strtoll(sec.c_str(), nullptr, 10);
+            entry.mtime_nsec = strtoll(nsec.c_str(), nullptr, 10);
+            cached[entry.path] = std::move(entry);
+        }
+    }
+    
+    munmap(data, sb.st_size);
+    return cached;
+}
+
+static void
+write_desktop_cache(const std::vector<DesktopEntry> &entries, const std::string &locale) {
+    std::string path = desktop_cache_path();
+    std::string directory = path.substr(0, path.find_last_of('/'));
+    std::string cache_directory = directory.substr(0, directory.find_last_of('/'));
+    for (const auto &dir: {cache_directory, directory}) {
+        if (mkdir(dir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
+            if (errno != EEXIST) {
+                printf("Couldn't mkdir %s\n", dir.c_str());
+                return;
+            }
+        }
+    }
+    
+    std::string temp_path = path + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return;
+    file << desktop_cache_header << '\0' << locale << '\0';
+    for (const auto &e: entries) {
+        file << e.path << '\0' << e.mtime_sec << '\0' << e.mtime_nsec << '\0' << e.name << '\0'
+             << e.wmclass << '\0' << e.exec << '\0' << e.icon << '\0' << e.no_display << '\0'
+             << e.not_show_in << '\0' << e.only_show_in << '\0';
+    }
+    file.close();
+    rename(temp_path.c_str(), path.c_str());
+}
+
+// The message locale, without encoding, e.g. "sr_RS@latin"
+static std::string
+current_locale() {
+    for (const char *variable: {"LC_ALL", "LC_MESSAGES", "LANG"}) {
+        const char *value = getenv(variable);
+        if (value && value[0] != '\0') {
+            std::string locale(value);
+            auto dot = locale.find('.');
+            if (dot != std::string::npos) {
+                auto at = locale.find('@', dot);
+                locale.erase(dot, at == std::string::npos ? std::string::npos : at - dot);
+            }
+            if (locale == "C" || locale == "POSIX")
+                return "";
+            return locale;
+        }
+    }
+    return "";
+}
+
+// The Name[...] keys we accept, best match first, as described by the desktop entry spec
+static std::vector<std::string>
+locale_matches(const std::string &locale) {
+    std::vector<std::string> matches;
+    if (locale.empty())
+        return matches;
+    auto at = locale.find('@');
+    std::string modifier = at == std::string::npos ? "" : locale.substr(at);
+    std::string lang_country = locale.substr(0, at);
+    auto underscore = lang_country.find('_');
+    std::string lang = lang_country.substr(0, underscore);
+    
+    if (!modifier.empty() && underscore != std::string::npos)
+        matches.push_back(lang_country + modifier);
+    if (underscore != std::string::npos)
+        matches.push_back(lang_country);
+    if (!modifier.empty())
+        matches.push_back(lang + modifier);
+    matches.push_back(lang);
+    return matches;
+}
+
+static std::string
+unescape_desktop_value(std::string_view value) {
+    std::string result;
+    result.reserve(value.size());
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '\\' && i + 1 < value.size()) {
+            char c = value[++i];
+            if (c == 's') result += ' ';
+            else if (c == 'n') result += '\n';
+            else if (c == 't') result += '\t';
+            else if (c == 'r') result += '\r';
+            else if (c == '\\') result += '\\';
+            else {
+                // Leave escapes we don't know (like "\;" in lists) for whoever reads the value
+                result += '\\';
+                result += c;
+            }
+        } else {
+            result += value[i];
+        }
+    }
+    return result;
+}
+
+// Reads the file in one go and walks it once, picking out only the keys we need from the
+// [Desktop Entry] group and stopping as soon as that group ends
+static void
+parse_desktop_file(DesktopEntry *entry, const std::vector<std::string> &locales) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    int file_descriptor = open(entry->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file_descriptor == -1)
+        return; // Leaving exec empty means we'll skip it, and remember to skip it until it changes
+    std::string contents;
+    char buffer[4096];
+    ssize_t amount;
+    while ((amount = read(file_descriptor, buffer, sizeof(buffer))) > 0)
+        contents.append(buffer, amount);
+    close(file_descriptor);
+    
+    std::string_view remaining(contents);
+    bool in_desktop_entry = false;
+    size_t best_name_rank = SIZE_MAX;
+    
+    while (!remaining.empty()) {
+        auto newline = remaining.find('\n');
+        std::string_view line = remaining.substr(0, newline);
+        remaining = newline == std::string_view::npos ? std::string_view() : remaining.substr(newline + 1);
+        
+        while (!line.empty() && isspace((unsigned char) line.front()))
+            line.remove_prefix(1);
+        while (!line.empty() && isspace((unsigned char) line.back()))
+            line.remove_suffix(1);
+        if (line.empty() || line[0] == '#')
+            continue;
+        
+        if (line[0] == '[') {
+            if (in_desktop_entry)
+                break;
+            in_desktop_entry = line == "[Desktop Entry]";
+            continue;
+        }
+        if (!in_desktop_entry)
+            continue;
+        
+        auto equals = line.find('=');
+        if (equals == std::string_view::npos)
+            continue;
+        std::string_view key = line.substr(0, equals);
+        std::string_view value = line.substr(equals + 1);
+        while (!key.empty() && isspace((unsigned char) key.back()))
+            key.remove_suffix(1);
+        while (!value.empty() && isspace((unsigned char) value.front()))
+            value.remove_prefix(1);
+        
+        std::string_view locale;
+        auto bracket = key.find('[');
+        if (bracket != std::string_view::npos && key.back() == ']') {
+            locale = key.substr(bracket + 1, key.size() - bracket - 2);
+            key = key.substr(0, bracket);
+        }
+        
+        if (key == "Name") {
+            size_t rank = locales.size();
+            if (!locale.empty()) {
+                rank = SIZE_MAX;
+                for (size_t i = 0; i < locales.size(); i++) {
+                    if (locales[i] == locale) {
+                        rank = i;
+                        break;
+                    }
+                }
+            }
+            if (rank < best_name_rank) {
+                best_name_rank = rank;
+                entry->name = unescape_desktop_value(value);
+            }
+        } else if (!locale.empty()) {
+            continue;
+        } else if (key == "Exec") {
+            entry->exec = unescape_desktop_value(value);
+        } else if (key == "Icon") {
+            entry->icon = unescape_desktop_value(value);
+        } else if (key == "StartupWMClass") {
+            entry->wmclass = unescape_desktop_value(value);
+        } else if (key == "NoDisplay") {
+            entry->no_display = unescape_desktop_value(value);
+        } else if (key == "NotShowIn") {
+            entry->not_show_in = unescape_desktop_value(value);
+        } else if (key == "OnlyShowIn") {
+            entry->only_show_in = unescape_desktop_value(value);
+        }
+    }
+}
+
+static Launcher *
+launcher_from_entry(const DesktopEntry &entry, const std::vector<std::string> &current_desktop, time_t now) {
     std::string parsed;
-    std::vector<std::string> current_desktop;
-    if (getline(input, parsed, ';')) {
-        current_desktop.push_back(parsed);
+    std::string name = entry.name;
+    std::string exec = entry.exec;
+    const std::string &display = entry.no_display;
+    
+    if (exec.empty() || display == "True" ||
+        display == "true") // If we find no exec entry then there's nothing to run
+        return nullptr;
+    
+    if (!current_desktop.empty()) {
+        if (!entry.only_show_in.empty()) {
+            std::stringstream only_input(entry.only_show_in);
+            bool found = false;
+            if (getline(only_input, parsed, ';')) {
+                for (const auto &s: current_desktop) {
+                    if (s == parsed)
+                        found = true;
+                }
+            }
+            if (!found)
+                return nullptr;
+        } else if (!entry.not_show_in.empty()) {
+            std::stringstream not_input(entry.not_show_in);
+            bool found = false;
+            if (getline(not_input, parsed, ';')) {
+                for (const auto &s: current_desktop) {
+                    if (s == parsed)
+                        found = true;
+                }
+            }
+            if (found)
+                return nullptr;
+        }
     }
     
+    // Remove all field codes
+    // https://specifications.freedesktop.org/desktop-entry-spec/desktop-entry-spec-latest.html#exec-variables
+    eraseSubStrings(exec, {"%f", "%F", "%u", "%U", "%d", "%D", "%n", "%N", "%i", "%c", "%k", "%v", "%m"});
+    
+    if (name.empty())// If no name was set, just give it the exec name
+        name = exec;
+    
+    auto *launcher = new Launcher();
+    launcher->name = name;
+    launcher->lowercase_name = launcher->name;
+    std::transform(launcher->lowercase_name.begin(),
+                   launcher->lowercase_name.end(),
+                   launcher->lowercase_name.begin(),
+                   ::tolower);
+    launcher->exec = exec;
+    launcher->wmclass = entry.wmclass;
+    launcher->icon = entry.icon;
+    launcher->time_modified = entry.mtime_sec;
+    launcher->desktop_file = entry.path;
+    launcher->collation_key = collation_key(launcher->lowercase_name);
+    assign_app_menu_priority(launcher, now);
+    return launcher;
+}
+
+// Lists the .desktop files in directory, taking entries from the cache when their mtime hasn't changed.
+// The indexes of entries that still need to be parsed are added to needs_parsing.
+static void
+collect_desktop_files(const std::string &directory,
+                      std::unordered_map<std::string, DesktopEntry> *cached,
+                      std::vector<DesktopEntry> *entries,
+                      std::vector<size_t> *needs_parsing) {
     DIR *dir;
     struct dirent *ent;
     if ((dir = opendir(directory.c_str())) != NULL) {
+        int dir_fd = dirfd(dir);
         while ((ent = readdir(dir)) != NULL) {
             if (!ends_with(ent->d_name, ".desktop")) {
                 continue;
             }
-            std::string path = directory + ent->d_name;
             struct stat buffer{};
-            if (stat(path.c_str(), &buffer) != 0) {
+            if (fstatat(dir_fd, ent->d_name, &buffer, 0) != 0) {
                 continue;
             }
+            std::string path = directory + ent->d_name;
             
-            // Parse desktop file
-            INIReader desktop_application(path);
-            if (desktop_application.ParseError() != 0) {
-                continue;
-            }
-            
-            std::string name = desktop_application.Get("Desktop Entry", "Name", "");
-            std::string wmclass = desktop_application.Get("Desktop Entry", "StartupWMClass", "");
-            std::string exec = desktop_application.Get("Desktop Entry", "Exec", "");
-            std::string icon = desktop_application.Get("Desktop Entry", "Icon", "");
-            std::string display = desktop_application.Get("Desktop Entry", "NoDisplay", "");
-            std::string not_show_in = desktop_application.Get("Desktop Entry", "NotShowIn", "");
-            std::string only_show_in = desktop_application.Get("Desktop Entry", "OnlyShowIn", "");
-            
-            if (exec.empty() || display == "True" ||
-                display == "true") // If we find no exec entry then there's nothing to run
-                continue;
-            
-            if (!current_desktop.empty()) {
-                if (!only_show_in.empty()) {
-                    std::stringstream only_input(only_show_in);
-                    bool found = false;
-                    if (getline(only_input, parsed, ';')) {
-                        for (const auto &s: current_desktop) {
-                            if (s == parsed)
-                                found = true;
-                        }
-                    }
-                    if (!found)
-                        continue;
-                } else if (!not_show_in.empty()) {
-                    std::stringstream not_input(not_show_in);
-                    bool found = false;
-                    if (getline(not_input, parsed, ';')) {
-                        for (const auto &s: current_desktop) {
-                            if (s == parsed)
-                                found = true;
-                        }
-                    }
-                    if (found)
-                        continue;
-                }
+            auto it = cached->find(path);
+            if (it != cached->end() &&
+                it->second.mtime_sec == buffer.st_mtim.tv_sec &&
+                it->second.mtime_nsec == buffer.st_mtim.tv_nsec) {
+                entries->push_back(std::move(it->second));
+                cached->erase(it);
+            } else {
+                DesktopEntry entry;
+                entry.path = path;
+                entry.mtime_sec = buffer.st_mtim.tv_sec;
+                entry.mtime_nsec = buffer.st_mtim.tv_nsec;
+                needs_parsing->push_back(entries->size());
+                entries->push_back(std::move(entry));
             }
-            
-            // Remove all field codes
-            // https://specifications.freedesktop.org/desktop-entry-spec/desktop-entry-spec-latest.html#exec-variables
-            eraseSubStrings(exec, {"%f", "%F", "%u", "%U", "%d", "%D", "%n", "%N", "%i", "%c", "%k", "%v", "%m"});
-            
-            if (name.empty())// If no name was set, just give it the exec name
-                name = exec;
-            
-            auto *launcher = new Launcher();
-            launcher->name = name;
-            launcher->lowercase_name = launcher->name;
-            std::transform(launcher->lowercase_name.begin(),
-                           launcher->lowercase_name.end(),
-                           launcher->lowercase_name.begin(),
-                           ::tolower);
-            launcher->exec = exec;
-            launcher->wmclass = wmclass;
-            launcher->icon = icon;
-            launcher->time_modified = buffer.st_mtim.tv_sec;
-            
-            launchers.push_back(launcher);
         }
+        closedir(dir);
     }
 }
 
-void load_all_desktop_files() {
+// Splits the parsing between a few workers which each grab the next unparsed file until none are left
+static void
+parse_desktop_files(std::vector<DesktopEntry> *entries,
+                    const std::vector<size_t> &needs_parsing,
+                    const std::vector<std::string> &locales) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    
-    for (auto *l: launchers) {
-        delete l;
+    std::atomic<size_t> next = 0;
+    auto work = [&]() {
+        for (size_t i = next++; i < needs_parsing.size(); i = next++)
+            parse_desktop_file(&(*entries)[needs_parsing[i]], locales);
+    };
+    
+    size_t files_per_worker = 16;
+    size_t worker_count = std::min((size_t) std::max(1u, std::thread::hardware_concurrency()),
+                                   (needs_parsing.size() + files_per_worker - 1) / files_per_worker);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < worker_count; i++)
+        workers.emplace_back(work);
+    work();
+    for (auto &worker: workers)
+        worker.join();
+}
+
+static std::thread desktop_files_loader;
+static std::atomic<bool> desktop_files_loaded = false;
+
+static int desktop_inotify_fd = -1;
+static std::unordered_map<int, std::string> watched_application_directories;
+
+// An application directory that doesn't exist yet (the flatpak ones, until flatpak is used) is waited on by watching
+// its closest existing parent for awaited_name (the next directory down) to be made
+struct AwaitedApplicationDirectory {
+    std::string directory;
+    std::string awaited_name;
+    int watch_descriptor = -1;
+};
+static std::vector<AwaitedApplicationDirectory> awaited_application_directories;
+static std::unordered_set<std::string> changed_desktop_files;
+static Timeout *desktop_changes_timeout = nullptr;
+
+// Changed .desktop files are parsed and their icons loaded on desktop_changes_loader. What it made waits here
+// until swap_in_desktop_file_changes can put it into launchers on the main thread.
+static std::thread desktop_changes_loader;
+static std::atomic<bool> desktop_changes_loading = false;
+static std::mutex loaded_desktop_changes_mutex;
+static std::vector<std::string> loaded_changed_paths;
+static std::vector<Launcher *> loaded_launchers;
+
+static std::vector<std::string>
+current_desktops() {
+    auto c = getenv("XDG_CURRENT_DESKTOP");
+    std::string paths;
+    if (c) paths = std::string(c);
+    std::stringstream input(paths);
+    std::string parsed;
+    std::vector<std::string> current_desktop;
+    if (getline(input, parsed, ';')) {
+        current_desktop.push_back(parsed);
     }
-    launchers.clear();
-    launchers.shrink_to_fit();
-    
-    load_desktop_files("/usr/share/applications/");
+    return current_desktop;
+}
+
+static std::vector<std::string>
+application_directories() {
     std::string local_desktop_files = getenv("HOME");
     local_desktop_files += "/.local/share/applications/";
-    load_desktop_files(local_desktop_files);
-    load_desktop_files("/var/lib/flatpak/exports/share/applications/");
     std::string local_flatpak_files = getenv("HOME");
     local_flatpak_files += "/.local/share/flatpak/exports/share/applications/";
-    load_desktop_files(local_flatpak_files);
+    return {"/usr/share/applications/",
+            local_desktop_files,
+            "/var/lib/flatpak/exports/share/applications/",
+            local_flatpak_files};
+}
+
+// Runs on its own thread so the taskbar can show while applications are still being read
+static void
+load_all_desktop_files_thread() {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::vector<std::string> current_desktop = current_desktops();
+    std::string locale = current_locale();
+    auto cached = read_desktop_cache(locale);
+    std::vector<DesktopEntry> entries;
+    std::vector<size_t> needs_parsing;
+    for (const auto &directory: application_directories()) {
+        collect_desktop_files(directory, &cached, &entries, &needs_parsing);
+    }
+    parse_desktop_files(&entries, needs_parsing, locale_matches(locale));
+    
+    // Anything left over in the cache was deleted or moved
+    if (!needs_parsing.empty() || !cached.empty())
+        write_desktop_cache(entries, locale);
     
     time_t now;
     time(&now);
+    std::vector<Launcher *> loaded;
+    for (const auto &entry: entries)
+        if (auto *launcher = launcher_from_entry(entry, current_desktop, now))
+            loaded.push_back(launcher);
+    sort_launchers(&loaded);
+    
+    {
+        std::lock_guard lock(app->thread_mutex);
+        launchers.swap(loaded);
+    }
+    for (auto *l: loaded) {
+        delete l;
+    }
     
-    auto recently_added_threshold = 86400 * 2; // two days  in seconds
-    for (auto l: launchers) {
-        double diff = difftime(now, l->time_modified);
-        if (diff < recently_added_threshold) { // less than two days old
-            l->app_menu_priority = 1;
-        } else if (!l->name.empty()) {
-            if (!isalnum(l->name[0])) { // is symbol
-                l->app_menu_priority = 2;
-            } else if (isdigit(l->name[0])) { // is number
-                l->app_menu_priority = 3;
-            } else { // is ascii
-                l->app_menu_priority = 4;
-            }
+    paint_desktop_files(launchers);
+    desktop_files_loaded = true;
+}
+
+// Replaces the launchers of the changed .desktop files with the ones desktop_changes_loader made
+static void
+swap_in_desktop_file_changes(App *app, AppClient *, Timeout *, void *) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    // The open menus point straight at launchers, so we wait until they're closed to swap any out
+    if (client_by_name(app, "app_menu") || client_by_name(app, "search_menu")) {
+        app_timeout_create(app, nullptr, 1000, swap_in_desktop_file_changes, nullptr);
+        return;
+    }
+    
+    std::vector<std::string> changed_paths;
+    std::vector<Launcher *> added;
+    {
+        std::lock_guard lock(loaded_desktop_changes_mutex);
+        changed_paths.swap(loaded_changed_paths);
+        added.swap(loaded_launchers);
+    }
+    
+    std::unordered_set<std::string> changed(changed_paths.begin(), changed_paths.end());
+    for (int i = launchers.size() - 1; i >= 0; i--) {
+        if (changed.count(launchers[i]->desktop_file)) {
+            delete launchers[i];
+            launchers.erase(launchers.begin() + i);
         }
     }
+    launchers.insert(launchers.end(), added.begin(), added.end());
+    sort_launchers(&launchers);
+    desktop_changes_loading = false;
+}
+
+// Re-reads only the .desktop files inotify told us about, loads their icons, and updates desktop.cache with them
+static void
+load_desktop_file_changes_thread(std::vector<std::string> changed_paths) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::vector<std::string> current_desktop = current_desktops();
+    std::string locale = current_locale();
+    std::vector<std::string> locales = locale_matches(locale);
+    time_t now;
+    time(&now);
+    
+    std::vector<DesktopEntry> parsed;
+    std::vector<Launcher *> added;
+    for (const auto &path: changed_paths) {
+        struct stat buffer{};
+        if (stat(path.c_str(), &buffer) != 0)
+            continue;
+        DesktopEntry entry;
+        entry.path = path;
+        entry.mtime_sec = buffer.st_mtim.tv_sec;
+        entry.mtime_nsec = buffer.st_mtim.tv_nsec;
+        parse_desktop_file(&entry, locales);
+        if (auto *launcher = launcher_from_entry(entry, current_desktop, now))
+            added.push_back(launcher);
+        parsed.push_back(std::move(entry));
+    }
+    // Nothing else can see these launchers yet, so their icons can be loaded here
+    paint_desktop_files(added);
+    
+    // So the next start doesn't have to parse them again (or bring back deleted ones)
+    auto cached = read_desktop_cache(locale);
+    for (const auto &path: changed_paths)
+        cached.erase(path);
+    for (auto &entry: parsed)
+        cached[entry.path] = std::move(entry);
+    std::vector<DesktopEntry> entries;
+    entries.reserve(cached.size());
+    for (auto &[path, entry]: cached)
+        entries.push_back(std::move(entry));
+    write_desktop_cache(entries, locale);
+    
+    {
+        std::lock_guard lock(loaded_desktop_changes_mutex);
+        loaded_changed_paths = std::move(changed_paths);
+        loaded_launchers = std::move(added);
+    }
+    app_timeout_create(app, nullptr, 0, swap_in_desktop_file_changes, nullptr);
+}
+
+static void
+apply_desktop_file_changes(App *app, AppClient *, Timeout *, void *) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    desktop_changes_timeout = nullptr;
+    // One batch at a time, and only on top of the full load
+    if (!desktop_files_loaded || desktop_changes_loading) {
+        desktop_changes_timeout = app_timeout_create(app, nullptr, 1000, apply_desktop_file_changes, nullptr);
+        return;
+    }
+    if (desktop_changes_loader.joinable())
+        desktop_changes_loader.join();
     
-    // TODO: sort in order latest, &, #, A...Z
-    std::sort(launchers.begin(), launchers.end(), [](const auto &lhs, const auto &rhs) {
-        if (lhs->app_menu_priority == rhs->app_menu_priority) {
-            if (lhs->app_menu_priority == 1) { // time based
-                return lhs->time_modified > rhs->time_modified;
+    std::vector<std::string> changed_paths(changed_desktop_files.begin(), changed_desktop_files.end());
+    changed_desktop_files.clear();
+    desktop_changes_loading = true;
+    desktop_changes_loader = std::thread(load_desktop_file_changes_thread, std::move(changed_paths));
+}
+
+// IN_MASK_ADD because two awaited directories can have the same closest parent
+static int
+watch_closest_parent(const std::string &directory, std::string *awaited_name) {
+    std::string path = directory;
+    while (path.length() > 1 && path[path.length() - 1] == '/')
+        path.erase(path.length() - 1);
+    while (path != "/") {
+        auto slash = path.rfind('/');
+        if (slash == std::string::npos)
+            return -1;
+        *awaited_name = path.substr(slash + 1);
+        path = slash == 0 ? "/" : path.substr(0, slash);
+        if (awaited_name->empty())
+            continue;
+        int watch = inotify_add_watch(desktop_inotify_fd, path.c_str(),
+                                      IN_CREATE | IN_MOVED_TO | IN_ONLYDIR | IN_MASK_ADD);
+        if (watch != -1)
+            return watch;
+    }
+    return -1;
+}
+
+// Returns false if the directory doesn't exist, in which case it's awaited instead
+static bool
+watch_application_directory(const std::string &directory) {
+    int watch = inotify_add_watch(desktop_inotify_fd, directory.c_str(),
+                                  IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+    if (watch != -1) {
+        watched_application_directories[watch] = directory;
+        return true;
+    }
+    AwaitedApplicationDirectory awaited;
+    awaited.directory = directory;
+    awaited.watch_descriptor = watch_closest_parent(directory, &awaited.awaited_name);
+    if (awaited.watch_descriptor != -1)
+        awaited_application_directories.push_back(std::move(awaited));
+    return false;
+}
+
+// A directory that was just made can already have .desktop files in it (from before its watch was added)
+static void
+queue_desktop_files_in(const std::string &directory) {
+    if (DIR *dir = opendir(directory.c_str())) {
+        while (struct dirent *ent = readdir(dir))
+            if (ends_with(ent->d_name, ".desktop"))
+                changed_desktop_files.insert(directory + ent->d_name);
+        closedir(dir);
+    }
+}
+
+// Moves every awaited directory's watch as far down as it can go, the ones that exist now are watched themselves
+static void
+watch_awaited_application_directories() {
+    auto awaited = std::move(awaited_application_directories);
+    awaited_application_directories.clear();
+    for (const auto &a: awaited)
+        if (watch_application_directory(a.directory))
+            queue_desktop_files_in(a.directory);
+    
+    for (const auto &a: awaited) {
+        bool in_use = watched_application_directories.count(a.watch_descriptor) > 0;
+        for (const auto &still_awaited: awaited_application_directories)
+            if (still_awaited.watch_descriptor == a.watch_descriptor)
+                in_use = true;
+        if (!in_use)
+            inotify_rm_watch(desktop_inotify_fd, a.watch_descriptor);
+    }
+}
+
+static void
+desktop_inotify_wakeup(App *app, int fd) {
+    char buf[4096]
+            __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    bool rewatch = false;
+    
+    for (;;) {
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0)
+            break;
+        
+        for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *) ptr;
+            if (event->mask & IN_IGNORED) {
+                // The directory was deleted, so it's waited on until it's made again
+                auto directory = watched_application_directories.find(event->wd);
+                if (directory != watched_application_directories.end()) {
+                    std::string path = directory->second;
+                    watched_application_directories.erase(directory);
+                    if (watch_application_directory(path))
+                        queue_desktop_files_in(path);
+                }
+                // Or an awaited directory's parent was
+                for (const auto &awaited: awaited_application_directories)
+                    if (awaited.watch_descriptor == event->wd)
+                        rewatch = true;
+                continue;
             }
-            
-            // alphabetical order
-            std::string first_name = lhs->name;
-            std::string second_name = rhs->name;
-            std::for_each(first_name.begin(), first_name.end(), [](char &c) { c = std::tolower(c); });
-            std::for_each(second_name.begin(), second_name.end(), [](char &c) { c = std::tolower(c); });
-            
-            return first_name < second_name;
+            if (event->len && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                for (const auto &awaited: awaited_application_directories)
+                    if (awaited.watch_descriptor == event->wd && awaited.awaited_name == event->name)
+                        rewatch = true;
+            }
+            if (!event->len || !ends_with(event->name, ".desktop"))
+                continue;
+            auto directory = watched_application_directories.find(event->wd);
+            if (directory == watched_application_directories.end())
+                continue;
+            changed_desktop_files.insert(directory->second + event->name);
+        }
+    }
+    if (rewatch)
+        watch_awaited_application_directories();
+    
+    // Installs tend to write a bunch of files in a row, so we wait for things to settle down
+    if (!changed_desktop_files.empty()) {
+        if (desktop_changes_timeout == nullptr) {
+            desktop_changes_timeout = app_timeout_create(app, nullptr, 500, apply_desktop_file_changes, nullptr);
         } else {
-            return lhs->app_menu_priority < rhs->app_menu_priority;
+            app_timeout_replace(app, nullptr, desktop_changes_timeout, 500, apply_desktop_file_changes, nullptr);
         }
-    });
-    std::thread(paint_desktop_files).detach();
+    }
 }
 
-void start_app_menu() {
-    scrollbar_openess = 0;
-    scrollbar_visible = 0;
-    if (auto *c = client_by_name(app, "search_menu")) {
-        client_close(app, c);
+static void
+watch_application_directories() {
+    desktop_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (desktop_inotify_fd == -1)
+        return;
+    for (const auto &directory: application_directories())
+        watch_application_directory(directory);
+    poll_descriptor(app, desktop_inotify_fd, EPOLLIN, desktop_inotify_wakeup);
+}
+
+void load_all_desktop_files() {
+    unload_all_desktop_files();
+    // Watching starts before loading so nothing that changes in between is missed
+    watch_application_directories();
+    desktop_files_loader = std::thread(load_all_desktop_files_thread);
+}
+
+void unload_all_desktop_files() {
+    if (desktop_files_loader.joinable())
+        desktop_files_loader.join();
+    desktop_files_loaded = false;
+    if (desktop_changes_loader.joinable())
+        desktop_changes_loader.join();
+    desktop_changes_loading = false;
+    {
+        std::lock_guard lock(loaded_desktop_changes_mutex);
+        for (auto *l: loaded_launchers)
+            delete l;
+        loaded_launchers.clear();
+        loaded_changed_paths.clear();
     }
-    if (auto *client = client_by_name(app, "taskbar")) {
-        if (auto *container = container_by_name("main_text_area", client->root)) {
-            auto *text_data = (TextAreaData *) container->user_data;
-            delete text_data->state;
-            text_data->state = new TextState;
-        }
-        request_refresh(client->app, client);
+    
+    if (desktop_inotify_fd != -1) {
+        unpoll_descriptor(app, desktop_inotify_fd);
+        close(desktop_inotify_fd);
     }
+    desktop_inotify_fd = -1;
+    watched_application_directories.clear();
+    awaited_application_directories.clear();
+    changed_desktop_files.clear();
+    desktop_changes_timeout = nullptr;
     
+    for (auto *l: launchers) {
+        delete l;
+    }
+    launchers.clear();
+    launchers.shrink_to_fit();
+}
+
+static Settings
+app_menu_settings() {
     Settings settings;
     settings.force_position = true;
     settings.w = 320;
@@ -1312,6 +1991,25 @@ void start_app_menu() {
     settings.slide_data[2] = 160;
     settings.slide_data[3] = 100;
     settings.slide_data[4] = 80;
+    return settings;
+}
+
+void start_app_menu() {
+    scrollbar_openess = 0;
+    scrollbar_visible = 0;
+    if (auto *c = client_by_name(app, "search_menu")) {
+        client_close(app, c);
+    }
+    if (auto *client = client_by_name(app, "taskbar")) {
+        if (auto *container = container_by_name("main_text_area", client->root)) {
+            auto *text_data = (TextAreaData *) container->user_data;
+            delete text_data->state;
+            text_data->state = new TextState;
+        }
+        request_refresh(client->app, client);
+    }
+    
+    Settings settings = app_menu_settings();
     
     if (auto taskbar = client_by_name(app, "taskbar")) {
         PopupSettings popup_settings;
@@ -1326,6 +2024,9 @@ void start_app_menu() {
         set_textarea_active();
         xcb_set_input_focus(app->connection, XCB_NONE, client->window, XCB_CURRENT_TIME);
         xcb_flush(app->connection);
-        xcb_aux_sync(app->connection);
     }
 }
+
+void prewarm_app_menu() {
+    client_prewarm(app, app_menu_settings(), "app_menu");
+}
@@ -14,6 +14,7 @@ public:
     std::string icon;
     std::string exec;
     std::string wmclass;
+    std::string desktop_file;
     
     cairo_surface_t *icon_16 = nullptr;
     cairo_surface_t *icon_32 = nullptr;
@@ -25,6 +26,9 @@ public:
     
     int app_menu_priority = 0;
     
+    // strxfrm of lowercase_name so the app menu can be sorted with plain comparisons
+    std::string collation_key;
+    
     ~Launcher() {
         if (icon_16)
             cairo_surface_destroy(icon_16);
@@ -41,6 +45,10 @@ extern std::vector<Launcher *> launchers;
 
 void start_app_menu();
 
+void prewarm_app_menu();
+
 void load_all_desktop_files();
 
+void unload_all_desktop_files();
+
 #endif// APP_MENU_H
@@ -5,11 +5,11 @@
 #include "battery_menu.h"
 #include "config.h"
 #include "main.h"
+#include "power_supply.h"
 #include "simple_dbus.h"
 
 #include <application.h>
 #include <cassert>
-#include <fstream>
 #include <iostream>
 #include <math.h>
 #include <pango/pangocairo.h>
@@ -26,28 +26,11 @@ paint_battery_bar(AppClient *client_entity, cairo_t *cr, Container *container) {
     assert(!data->normal_surfaces.empty());
     assert(!data->charging_surfaces.empty());
     
-    std::string line;
-    std::ifstream status("/sys/class/power_supply/BAT0/status");
-    if (status.is_open()) {
-        if (getline(status, line)) {
-            data->status = line;
-        }
-        status.close();
-    } else {
-        data->status = "Missing BAT0";
-    }
+    const BatteryState &state = power_supply_state();
+    data->status = state.status;
+    data->capacity = std::to_string(state.capacity);
     
-    std::ifstream capacity("/sys/class/power_supply/BAT0/capacity");
-    if (capacity.is_open()) {
-        if (getline(capacity, line)) {
-            data->capacity = line;
-        }
-        capacity.close();
-    } else {
-        data->capacity = "0";
-    }
-    
-    int capacity_index = std::floor(((double) (std::stoi(data->capacity))) / 10.0);
+    int capacity_index = std::floor(((double) state.capacity) / 10.0);
     
     if (capacity_index > 9)
         capacity_index = 9;
@@ -333,11 +316,8 @@ fill_root(Container *root) {
     root->children.push_back(make_brightness_slider(root));
 }
 
-void start_battery_menu() {
-    if (valid_client(app, battery_entity)) {
-        client_close(app, battery_entity);
-    }
-    
+static Settings
+battery_menu_settings() {
     Settings settings;
     settings.w = 360;
     settings.h = 164;
@@ -357,6 +337,15 @@ void start_battery_menu() {
     settings.slide_data[2] = 160;
     settings.slide_data[3] = 100;
     settings.slide_data[4] = 80;
+    return settings;
+}
+
+void start_battery_menu() {
+    if (valid_client(app, battery_entity)) {
+        client_close(app, battery_entity);
+    }
+    
+    Settings settings = battery_menu_settings();
     
     if (auto taskbar = client_by_name(app, "taskbar")) {
         PopupSettings popup_settings;
@@ -377,4 +366,8 @@ void start_battery_menu() {
         
         client_show(app, battery_entity);
     }
+}
+
+void prewarm_battery_menu() {
+    client_prewarm(app, battery_menu_settings(), "battery_menu");
 }
\ No newline at end of file
@@ -35,4 +35,6 @@ struct data_battery_surfaces : public IconButton {
 
 void start_battery_menu();
 
+void prewarm_battery_menu();
+
 #endif// APP_BATTERY_MENU_H
@@ -12,7 +12,9 @@
 
 #include "utility.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 #include <pango/pangocairo.h>
 
 static int scroll_amount = 30;
@@ -613,48 +615,259 @@ make_scrollpane(Container *parent, ScrollPaneSettings settings) {
     return content_container;
 }
 
+TextBuffer &TextBuffer::operator=(const std::string &text) {
+    buffer.assign(text.begin(), text.end());
+    gap_start = buffer.size();
+    gap_end = buffer.size();
+    changes++;
+    return *this;
+}
+
+std::string TextBuffer::substr(size_t pos, size_t length) const {
+    length = std::min(length, size() - pos);
+    size_t end = pos + length;
+    std::string result;
+    result.reserve(length);
+    if (pos < gap_start)
+        result.append(buffer.data() + pos, std::min(end, gap_start) - pos);
+    if (end > gap_start) {
+        size_t from = std::max(pos, gap_start);
+        result.append(buffer.data() + from + (gap_end - gap_start), end - from);
+    }
+    return result;
+}
+
+void TextBuffer::move_gap(size_t pos) {
+    if (pos < gap_start) {
+        size_t amount = gap_start - pos;
+        memmove(buffer.data() + gap_end - amount, buffer.data() + pos, amount);
+        gap_start -= amount;
+        gap_end -= amount;
+    } else if (pos > gap_start) {
+        size_t amount = pos - gap_start;
+        memmove(buffer.data() + gap_start, buffer.data() + gap_end, amount);
+        gap_start += amount;
+        gap_end += amount;
+    }
+}
+
+void TextBuffer::insert(size_t pos, const std::string &text) {
+    move_gap(pos);
+    if (gap_end - gap_start < text.size()) {
+        // At least doubling, so that a long run of typing costs about what appending to a string does
+        size_t after_gap = buffer.size() - gap_end;
+        buffer.resize(buffer.size() + std::max(text.size(), std::max(buffer.size(), (size_t) 64)));
+        memmove(buffer.data() + buffer.size() - after_gap, buffer.data() + gap_end, after_gap);
+        gap_end = buffer.size() - after_gap;
+    }
+    memcpy(buffer.data() + gap_start, text.data(), text.size());
+    gap_start += text.size();
+    changes++;
+}
+
+void TextBuffer::erase(size_t pos, size_t length) {
+    move_gap(pos);
+    gap_end = std::min(gap_end + length, buffer.size());
+    changes++;
+}
+
+const std::string &TextBuffer::str() const {
+    if (joined_version != changes) {
+        joined.assign(buffer.data(), gap_start);
+        joined.append(buffer.data() + gap_end, buffer.size() - gap_end);
+        joined_version = changes;
+    }
+    return joined;
+}
+
+// The line a byte index falls on. An index right before a newline is on the line that newline ends.
+static int
+line_at(TextState *state, int index) {
+    auto it = std::upper_bound(state->lines.begin(), state->lines.end(), index,
+                               [](int index, const TextLine &line) { return index < line.start; });
+    if (it == state->lines.begin())
+        return 0;
+    return (it - state->lines.begin()) - 1;
+}
+
+// Replaces the lines from first to last with however many lines the text from the start of first up to end now
+// splits into. The lines after last have to already be shifted by however much the text grew or shrunk.
 static void
-update_preffered_x(AppClient *client, Container *textarea) {
+split_lines(TextState *state, int first, int last, int end) {
+    PangoLayout *reused_layout = state->lines[first].layout;
+    for (int i = first + 1; i <= last; i++) {
+        if (state->lines[i].layout)
+            g_object_unref(state->lines[i].layout);
+    }
+    
+    std::vector<TextLine> replacement;
+    int start = state->lines[first].start;
+    for (int i = start; i <= end; i++) {
+        if (i == end || state->text.at(i) == '\n') {
+            TextLine line;
+            line.start = start;
+            line.length = i - start;
+            replacement.push_back(line);
+            start = i + 1;
+        }
+    }
+    replacement[0].layout = reused_layout;
+    
+    state->lines.erase(state->lines.begin() + first, state->lines.begin() + last + 1);
+    state->lines.insert(state->lines.begin() + first, replacement.begin(), replacement.end());
+}
+
+// Every edit the textarea makes goes through text_insert and text_erase so that only the lines the edit touched
+// have to be laid out again
+static void
+text_insert(TextState *state, int pos, const std::string &text) {
+    bool lines_in_step = state->lines_version == state->text.version();
+    state->text.insert(pos, text);
+    if (!lines_in_step)
+        return;
+    
+    int first = line_at(state, pos);
+    int end = state->lines[first].start + state->lines[first].length + text.size();
+    for (int i = first + 1; i < state->lines.size(); i++)
+        state->lines[i].start += text.size();
+    split_lines(state, first, first, end);
+    state->lines_version = state->text.version();
+}
+
+static void
+text_erase(TextState *state, int pos, int length) {
+    bool lines_in_step = state->lines_version == state->text.version();
+    state->text.erase(pos, length);
+    if (!lines_in_step)
+        return;
+    
+    int first = line_at(state, pos);
+    int last = line_at(state, pos + length);
+    int end = state->lines[last].start + state->lines[last].length - length;
+    for (int i = last + 1; i < state->lines.size(); i++)
+        state->lines[i].start -= length;
+    split_lines(state, first, last, end);
+    state->lines_version = state->text.version();
+}
+
+// Lays out the lines that changed since the last time, or all of them if the font or the wrap width changed
+static void
+layout_lines(AppClient *client, Container *textarea) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
     auto *data = (TextAreaData *) textarea->user_data;
+    auto *state = data->state;
+    
+    int wrap_width = data->wrap ? textarea->real_bounds.w * PANGO_SCALE : -1;
+    bool font_changed = state->lines_font != data->font || state->lines_font_size != data->font_size;
+    if (font_changed || state->lines_version != state->text.version()) {
+        for (auto &line: state->lines) {
+            if (line.layout)
+                g_object_unref(line.layout);
+        }
+        state->lines.clear();
+        state->lines.emplace_back();
+        split_lines(state, 0, 0, state->text.size());
+        state->lines_version = state->text.version();
+        state->lines_font = data->font;
+        state->lines_font_size = data->font_size;
+    } else if (state->lines_wrap_width != wrap_width) {
+        for (auto &line: state->lines)
+            line.dirty = true;
+    }
+    state->lines_wrap_width = wrap_width;
     
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-    if (data->wrap) {
-        pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_width(layout, textarea->real_bounds.w * PANGO_SCALE);
+    PangoLayout *font_layout = nullptr;
+    int y = 0;
+    int width = 0;
+    for (auto &line: state->lines) {
+        if (line.dirty) {
+            if (!line.layout) {
+                if (!font_layout)
+                    font_layout = get_cached_pango_font(
+                            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
+                line.layout = pango_layout_copy(font_layout);
+                pango_layout_set_attributes(line.layout, nullptr);
+                pango_layout_set_alignment(line.layout, PangoAlignment::PANGO_ALIGN_LEFT);
+                pango_layout_set_ellipsize(line.layout, PANGO_ELLIPSIZE_NONE);
+                pango_layout_set_wrap(line.layout, PANGO_WRAP_WORD_CHAR);
+            }
+            pango_layout_set_width(line.layout, wrap_width);
+            std::string text = state->text.substr(line.start, line.length);
+            pango_layout_set_text(line.layout, text.data(), text.length());
+            
+            PangoRectangle ink;
+            PangoRectangle logical;
+            pango_layout_get_extents(line.layout, &ink, &logical);
+            line.width = logical.width;
+            line.height = logical.height;
+            line.dirty = false;
+        }
+        line.y = y;
+        y += line.height;
+        width = std::max(width, line.width);
     }
+    state->lines_width = width;
+    state->lines_height = y;
+}
+
+// Where the cursor goes for a byte index, in pango units relative to the textarea
+static PangoRectangle
+cursor_rect(AppClient *client, Container *textarea, int index) {
+    layout_lines(client, textarea);
+    auto *state = ((TextAreaData *) textarea->user_data)->state;
     
+    TextLine &line = state->lines[line_at(state, index)];
     PangoRectangle strong_pos;
     PangoRectangle weak_pos;
-    pango_layout_get_cursor_pos(layout, data->state->cursor, &strong_pos, &weak_pos);
+    pango_layout_get_cursor_pos(
+            line.layout, std::max(0, std::min(index - line.start, line.length)), &strong_pos, &weak_pos);
+    strong_pos.y += line.y;
+    return strong_pos;
+}
+
+// The byte index closest to a point, in pango units relative to the textarea
+static int
+index_at(AppClient *client, Container *textarea, int x, int y) {
+    layout_lines(client, textarea);
+    auto *state = ((TextAreaData *) textarea->user_data)->state;
+    
+    auto it = std::upper_bound(state->lines.begin(), state->lines.end(), y,
+                               [](int y, const TextLine &line) { return y < line.y; });
+    TextLine &line = it == state->lines.begin() ? *it : *(it - 1);
     
-    data->state->preferred_x = strong_pos.x;
+    int index;
+    int trailing;
+    pango_layout_xy_to_index(line.layout, x, y - line.y, &index, &trailing);
+    return line.start + index + trailing;
 }
 
+// The textarea's size only matters to the scroll pane it's in, so there's no need to lay out the whole client
 static void
-put_cursor_on_screen(AppClient *client, Container *textarea) {
+layout_scrollpane(AppClient *client, Container *textarea) {
+    Container *scrollpane = textarea->parent->parent;
+    ::layout(client, client->cr, scrollpane, scrollpane->real_bounds);
+}
+
+static void
+update_preffered_x(AppClient *client, Container *textarea) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
     auto *data = (TextAreaData *) textarea->user_data;
     
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-    if (data->wrap) {
-        pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_width(layout, textarea->real_bounds.w * PANGO_SCALE);
-    }
+    data->state->preferred_x = cursor_rect(client, textarea, data->state->cursor).x;
+}
+
+static void
+put_cursor_on_screen(AppClient *client, Container *textarea) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto *data = (TextAreaData *) textarea->user_data;
     
-    PangoRectangle strong_pos;
-    PangoRectangle weak_pos;
-    pango_layout_get_cursor_pos(layout, data->state->cursor, &strong_pos, &weak_pos);
+    PangoRectangle strong_pos = cursor_rect(client, textarea, data->state->cursor);
     
     Container *content_area = textarea->parent;
     
@@ -677,8 +890,7 @@ put_cursor_on_screen(AppClient *client, Container *textarea) {
                 -(y_pos + strong_pos.height / PANGO_SCALE - content_area->real_bounds.h);
     }
     
-    // ::layout(content_area, content_area->real_bounds, false);
-    client_layout(client->app, client);
+    layout_scrollpane(client, textarea);
     
     client_create_animation(client->app,
                             client,
@@ -703,23 +915,15 @@ update_bounds(AppClient *client, Container *container) {
 #endif
     auto *data = (TextAreaData *) container->user_data;
     
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-    
-    PangoRectangle text_ink;
-    PangoRectangle text_logical;
-    pango_layout_get_extents(layout, &text_ink, &text_logical);
+    layout_lines(client, container);
     
-    int width = text_logical.width / PANGO_SCALE;
-    int height = text_logical.height / PANGO_SCALE;
+    int width = data->state->lines_width / PANGO_SCALE;
+    int height = data->state->lines_height / PANGO_SCALE;
     
     if (data->wrap) {
         if (container->real_bounds.h != height) {
             container->wanted_bounds.h = height;
-            // ::layout(container->parent->parent, container->parent->parent->real_bounds, false);
-            client_layout(client->app, client);
+            layout_scrollpane(client, container);
             
             client_create_animation(client->app,
                                     client,
@@ -742,8 +946,7 @@ update_bounds(AppClient *client, Container *container) {
         if (container->real_bounds.h != height || container->wanted_bounds.w != width) {
             container->wanted_bounds.w = width;
             container->wanted_bounds.h = height;
-            client_layout(client->app, client);
-            // ::layout(container->parent->parent, container->parent->parent->real_bounds, false);
+            layout_scrollpane(client, container);
             
             client_create_animation(client->app,
                                     client,
@@ -781,32 +984,15 @@ paint_textarea(AppClient *client, cairo_t *cr, Container *container) {
     // DEBUG
     // paint_show(client, cr, container);
     
-    // TEXT
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    pango_layout_set_width(layout, -1);
-    pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-    pango_layout_set_alignment(layout, PangoAlignment::PANGO_ALIGN_LEFT);
-    if (data->wrap) {
-        pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_width(layout, container->real_bounds.w * PANGO_SCALE);
-    }
-    
     set_rect(cr, container->parent->real_bounds);
     cairo_clip(cr);
     
-    PangoRectangle cursor_strong_pos;
-    PangoRectangle cursor_weak_pos;
-    pango_layout_get_cursor_pos(layout, data->state->cursor, &cursor_strong_pos, &cursor_weak_pos);
+    PangoRectangle cursor_strong_pos = cursor_rect(client, container, data->state->cursor);
     
     // SELECTION BACKGROUND
     if (data->state->selection_x != -1) {
         set_argb(cr, ArgbColor(.2, .5, .8, 1));
-        PangoRectangle selection_strong_pos;
-        PangoRectangle selection_weak_pos;
-        pango_layout_get_cursor_pos(
-                layout, data->state->selection_x, &selection_strong_pos, &selection_weak_pos);
+        PangoRectangle selection_strong_pos = cursor_rect(client, container, data->state->selection_x);
         
         bool cursor_first = false;
         if (cursor_strong_pos.y == selection_strong_pos.y) {
@@ -878,8 +1064,17 @@ paint_textarea(AppClient *client, cairo_t *cr, Container *container) {
     // SHOW TEXT LAYOUT
     set_argb(cr, data->color);
     
-    cairo_move_to(cr, container->real_bounds.x, container->real_bounds.y);
-    pango_cairo_show_layout(cr, layout);
+    // Only the lines that can be seen through the scroll pane
+    double visible_top = (container->parent->real_bounds.y - container->real_bounds.y) * PANGO_SCALE;
+    double visible_bottom = visible_top + container->parent->real_bounds.h * PANGO_SCALE;
+    for (auto &line: data->state->lines) {
+        if (line.y + line.height < visible_top)
+            continue;
+        if (line.y > visible_bottom)
+            break;
+        cairo_move_to(cr, container->real_bounds.x, container->real_bounds.y + line.y / PANGO_SCALE);
+        pango_cairo_show_layout(cr, line.layout);
+    }
     
     if (container->parent->active == false && data->state->text.empty()) {
         cairo_save(cr);
@@ -918,8 +1113,6 @@ paint_textarea(AppClient *client, cairo_t *cr, Container *container) {
         cairo_fill(cr);
     }
     cairo_restore(cr);
-    
-    pango_layout_set_alignment(layout, PangoAlignment::PANGO_ALIGN_LEFT);
 }
 
 static void
@@ -953,29 +1146,16 @@ clicked_textarea(AppClient *client, cairo_t *cr, Container *container) {
     }
     data->state->last_time_mouse_press = get_current_time_in_ms();
     
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    set_argb(cr, data->color);
-    pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-    if (data->wrap) {
-        pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_width(layout, container->real_bounds.w * PANGO_SCALE);
-    }
-    
-    int index;
-    int trailing;
     int x = client->mouse_current_x - container->real_bounds.x;
     int y = client->mouse_current_y - container->real_bounds.y;
-    bool inside =
-            pango_layout_xy_to_index(layout, x * PANGO_SCALE, y * PANGO_SCALE, &index, &trailing);
+    int index = index_at(client, container, x * PANGO_SCALE, y * PANGO_SCALE);
     
     auto cookie = xcb_xkb_get_state(client->app->connection, client->keyboard->device_id);
     auto reply = xcb_xkb_get_state_reply(client->app->connection, cookie, nullptr);
     
     bool shift = reply->mods & XKB_KEY_Shift_L;
     
-    move_cursor(data, index + trailing, shift);
+    move_cursor(data, index, shift);
     update_preffered_x(client, container);
 }
 
@@ -988,24 +1168,6 @@ drag_timeout(App *app, AppClient *client, Timeout *, void *data) {
     blink_on(client->app, client, container);
     
     if (dragging.load()) {
-        auto *data = (TextAreaData *) container->user_data;
-        
-        PangoLayout *layout = get_cached_pango_font(
-                client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-        
-        pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-        if (data->wrap) {
-            pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-            pango_layout_set_width(layout, container->real_bounds.w * PANGO_SCALE);
-        }
-        
-        int index;
-        int trailing;
-        int lx = client->mouse_current_x - container->real_bounds.x;
-        int ly = client->mouse_current_y - container->real_bounds.y;
-        bool inside = pango_layout_xy_to_index(
-                layout, lx * PANGO_SCALE, ly * PANGO_SCALE, &index, &trailing);
-        
         Bounds bounds = container->parent->real_bounds;
         int x = client->mouse_current_x;
         int y = client->mouse_current_y;
@@ -1072,22 +1234,9 @@ drag_start_textarea(AppClient *client, cairo_t *cr, Container *container) {
     container = container->children[0];
     auto *data = (TextAreaData *) container->user_data;
     
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    set_argb(cr, data->color);
-    pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-    if (data->wrap) {
-        pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_width(layout, container->real_bounds.w * PANGO_SCALE);
-    }
-    
-    int index;
-    int trailing;
     int x = client->mouse_current_x - container->real_bounds.x;
     int y = client->mouse_current_y - container->real_bounds.y;
-    bool inside =
-            pango_layout_xy_to_index(layout, x * PANGO_SCALE, y * PANGO_SCALE, &index, &trailing);
+    int index = index_at(client, container, x * PANGO_SCALE, y * PANGO_SCALE);
     
     dragging = true;
     app_timeout_create(client->app, client, 0, drag_timeout, container);
@@ -1098,7 +1247,7 @@ drag_start_textarea(AppClient *client, cairo_t *cr, Container *container) {
     
     bool shift = reply->mods & XKB_KEY_Shift_L;
     
-    move_cursor(data, index + trailing, shift);
+    move_cursor(data, index, shift);
 }
 
 static void
@@ -1109,29 +1258,16 @@ mouse_down_textarea(AppClient *client, cairo_t *cr, Container *container) {
     container = container->children[0];
     auto *data = (TextAreaData *) container->user_data;
     
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    set_argb(cr, data->color);
-    pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-    if (data->wrap) {
-        pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_width(layout, container->real_bounds.w * PANGO_SCALE);
-    }
-    
-    int index;
-    int trailing;
     int x = client->mouse_initial_x - container->real_bounds.x;
     int y = client->mouse_initial_y - container->real_bounds.y;
-    bool inside =
-            pango_layout_xy_to_index(layout, x * PANGO_SCALE, y * PANGO_SCALE, &index, &trailing);
+    int index = index_at(client, container, x * PANGO_SCALE, y * PANGO_SCALE);
     
     auto cookie = xcb_xkb_get_state(client->app->connection, client->keyboard->device_id);
     auto reply = xcb_xkb_get_state_reply(client->app->connection, cookie, nullptr);
     
     bool shift = reply->mods & XKB_KEY_Shift_L;
     
-    move_cursor(data, index + trailing, shift);
+    move_cursor(data, index, shift);
 }
 
 static void
@@ -1142,24 +1278,11 @@ drag_textarea(AppClient *client, cairo_t *cr, Container *container) {
     container = container->children[0];
     auto *data = (TextAreaData *) container->user_data;
     
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    set_argb(cr, data->color);
-    pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-    if (data->wrap) {
-        pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_width(layout, container->real_bounds.w * PANGO_SCALE);
-    }
-    
-    int index;
-    int trailing;
     int x = client->mouse_current_x - container->real_bounds.x;
     int y = client->mouse_current_y - container->real_bounds.y;
-    bool inside =
-            pango_layout_xy_to_index(layout, x * PANGO_SCALE, y * PANGO_SCALE, &index, &trailing);
+    int index = index_at(client, container, x * PANGO_SCALE, y * PANGO_SCALE);
     
-    move_cursor(data, index + trailing, true);
+    move_cursor(data, index, true);
 }
 
 static void
@@ -1170,24 +1293,11 @@ drag_end_textarea(AppClient *client, cairo_t *cr, Container *container) {
     container = container->children[0];
     auto *data = (TextAreaData *) container->user_data;
     
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    set_argb(cr, data->color);
-    pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-    if (data->wrap) {
-        pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_width(layout, container->real_bounds.w * PANGO_SCALE);
-    }
-    
-    int index;
-    int trailing;
     int x = client->mouse_current_x - container->real_bounds.x;
     int y = client->mouse_current_y - container->real_bounds.y;
-    bool inside =
-            pango_layout_xy_to_index(layout, x * PANGO_SCALE, y * PANGO_SCALE, &index, &trailing);
+    int index = index_at(client, container, x * PANGO_SCALE, y * PANGO_SCALE);
     
-    move_cursor(data, index + trailing, true);
+    move_cursor(data, index, true);
     
     dragging = false;
 }
@@ -1255,83 +1365,182 @@ make_textarea(App *app, AppClient *client, Container *parent, TextAreaSettings s
     return textarea;
 }
 
+// Typing (or deleting) that stops for longer than this starts a new undo step
+static const long undo_burst_ms = 1000;
+
+UndoAction *UndoHistory::last() {
+    if (actions.empty() || position != actions.size())
+        return nullptr;
+    return &actions.back();
+}
+
+void UndoHistory::forget_redo() {
+    if (position == actions.size())
+        return;
+    arena.resize(actions[position].text_offset - arena_base);
+    actions.resize(position);
+}
+
+void UndoHistory::push(UndoAction action, const std::string &replaced, const std::string &inserted) {
+    forget_redo();
+    action.text_offset = arena_base + arena.size();
+    action.replaced_length = replaced.size();
+    action.inserted_length = inserted.size();
+    action.time = get_current_time_in_ms();
+    arena.append(replaced);
+    arena.append(inserted);
+    actions.push_back(action);
+    position = actions.size();
+    keep_to_budget();
+}
+
+// The newest action's text is always at the end of the arena, so adding to it is an append
+void UndoHistory::append_inserted(const std::string &text) {
+    arena.append(text);
+    actions.back().inserted_length += text.size();
+    actions.back().time = get_current_time_in_ms();
+    keep_to_budget();
+}
+
+void UndoHistory::append_replaced(const std::string &text) {
+    arena.append(text);
+    actions.back().replaced_length += text.size();
+    actions.back().time = get_current_time_in_ms();
+    keep_to_budget();
+}
+
+void UndoHistory::prepend_replaced(const std::string &text) {
+    arena.insert(actions.back().text_offset - arena_base, text);
+    actions.back().replaced_length += text.size();
+    actions.back().time = get_current_time_in_ms();
+    keep_to_budget();
+}
+
+std::string UndoHistory::replaced(const UndoAction &action) const {
+    return arena.substr(action.text_offset - arena_base, action.replaced_length);
+}
+
+std::string UndoHistory::inserted(const UndoAction &action) const {
+    return arena.substr(action.text_offset - arena_base + action.replaced_length, action.inserted_length);
+}
+
+char UndoHistory::last_inserted_char(const UndoAction &action) const {
+    if (action.inserted_length == 0)
+        return '\0';
+    return arena[action.text_offset - arena_base + action.replaced_length + action.inserted_length - 1];
+}
+
+void UndoHistory::keep_to_budget() {
+    // The newest action is always kept, even when it's bigger than the whole budget by itself
+    size_t forgotten = actions.front().text_offset - arena_base;
+    while (actions.size() > 1 && arena.size() - forgotten + actions.size() * sizeof(UndoAction) > budget) {
+        actions.pop_front();
+        position--;
+        forgotten = actions.front().text_offset - arena_base;
+    }
+    // The text of forgotten actions is only let go of once it's most of the arena, so moving what's left down
+    // happens rarely
+    if (forgotten > arena.size() / 2) {
+        arena.erase(0, forgotten);
+        arena_base += forgotten;
+    }
+}
+
 void
 insert_action(AppClient *client, Container *textarea, TextAreaData *data, std::string text) {
+    UndoHistory &history = data->state->history;
+    history.forget_redo();
+    
     // Try to merge with the previous
     bool merged = false;
     
-    if (!data->state->undo_stack.empty()) {
-        UndoAction *previous_action = data->state->undo_stack.back();
-        
+    if (UndoAction *previous_action = history.last()) {
         if (previous_action->type == UndoType::INSERT) {
             if (previous_action->cursor_end == data->state->cursor) {
-                char last_char = previous_action->inserted_text.back();
+                char last_char = history.last_inserted_char(*previous_action);
                 
                 bool text_is_split_token = text == " " || text == "\n" || text == "\r";
+                bool same_burst = get_current_time_in_ms() - previous_action->time < undo_burst_ms;
                 
-                if (text_is_split_token && last_char == text.back() && text.size() == 1) {
-                    previous_action->inserted_text.append(text);
+                // A run of typing ends at the start of a new word (but not in the middle of a run of spaces or
+                // newlines) or when the typing stopped for a while
+                if (same_burst && (!text_is_split_token || last_char == text.back())) {
                     previous_action->cursor_end += text.size();
+                    history.append_inserted(text);
                     merged = true;
-                } else {
-                    if (!text_is_split_token) {
-                        previous_action->inserted_text.append(text);
-                        previous_action->cursor_end += text.size();
-                        merged = true;
-                    }
                 }
             } else {
-                auto undo_action = new UndoAction;
-                undo_action->type = UndoType::CURSOR;
-                undo_action->cursor_start = previous_action->cursor_end;
-                undo_action->cursor_end = data->state->cursor;
-                data->state->undo_stack.push_back(undo_action);
+                UndoAction undo_action;
+                undo_action.type = UndoType::CURSOR;
+                undo_action.cursor_start = previous_action->cursor_end;
+                undo_action.cursor_end = data->state->cursor;
+                history.push(undo_action, "", "");
             }
         }
     }
     
     if (!merged) {
-        auto undo_action = new UndoAction;
-        undo_action->type = UndoType::INSERT;
+        UndoAction undo_action;
+        undo_action.type = UndoType::INSERT;
         
-        undo_action->inserted_text = text;
-        undo_action->cursor_start = data->state->cursor;
-        undo_action->cursor_end = data->state->cursor + text.size();
-        data->state->undo_stack.push_back(undo_action);
+        undo_action.cursor_start = data->state->cursor;
+        undo_action.cursor_end = data->state->cursor + text.size();
+        history.push(undo_action, "", text);
     }
     
-    data->state->text.insert(data->state->cursor, text);
+    text_insert(data->state, data->state->cursor, text);
     move_cursor(data, data->state->cursor + text.size(), false);
     update_preffered_x(client, textarea);
     update_bounds(client, textarea);
     put_cursor_on_screen(client, textarea);
-    
-    data->state->redo_stack.clear();
-    data->state->redo_stack.shrink_to_fit();
 }
 
 static void
 delete_action(AppClient *client, Container *textarea, TextAreaData *data, int amount) {
-    auto undo_action = new UndoAction;
-    undo_action->type = UndoType::DELETE;
+    UndoHistory &history = data->state->history;
+    history.forget_redo();
+    
+    // Characters deleted one at a time, one after the other, in the same direction, are undone together
+    UndoAction *previous_action = history.last();
+    bool same_run = previous_action && previous_action->type == UndoType::DELETE && std::abs(amount) == 1 &&
+                    previous_action->cursor_end == data->state->cursor &&
+                    get_current_time_in_ms() - previous_action->time < undo_burst_ms;
     
+    int cursor_end;
     if (amount > 0) {
-        undo_action->replaced_text = data->state->text.substr(data->state->cursor, amount);
-        undo_action->cursor_start = data->state->cursor;
-        undo_action->cursor_end = data->state->cursor;
+        std::string replaced = data->state->text.substr(data->state->cursor, amount);
+        cursor_end = data->state->cursor;
         
-        data->state->text.erase(data->state->cursor, amount);
+        if (same_run && previous_action->cursor_start == previous_action->cursor_end) {
+            history.append_replaced(replaced);
+        } else {
+            UndoAction undo_action;
+            undo_action.type = UndoType::DELETE;
+            undo_action.cursor_start = data->state->cursor;
+            undo_action.cursor_end = cursor_end;
+            history.push(undo_action, replaced, "");
+        }
+        
+        text_erase(data->state, data->state->cursor, amount);
     } else {
-        undo_action->replaced_text =
-                data->state->text.substr(data->state->cursor + amount, -amount);
-        undo_action->cursor_start = data->state->cursor;
-        undo_action->cursor_end = data->state->cursor + amount;
+        std::string replaced = data->state->text.substr(data->state->cursor + amount, -amount);
+        cursor_end = data->state->cursor + amount;
         
-        data->state->text.erase(data->state->cursor + amount, -amount);
+        if (same_run && previous_action->cursor_end < previous_action->cursor_start) {
+            previous_action->cursor_end = cursor_end;
+            history.prepend_replaced(replaced);
+        } else {
+            UndoAction undo_action;
+            undo_action.type = UndoType::DELETE;
+            undo_action.cursor_start = data->state->cursor;
+            undo_action.cursor_end = cursor_end;
+            history.push(undo_action, replaced, "");
+        }
+        
+        text_erase(data->state, data->state->cursor + amount, -amount);
     }
-    data->state->undo_stack.push_back(undo_action);
     
-    move_cursor(data, undo_action->cursor_end, false);
+    move_cursor(data, cursor_end, false);
     update_preffered_x(client, textarea);
     update_bounds(client, textarea);
     put_cursor_on_screen(client, textarea);
@@ -1339,25 +1548,22 @@ delete_action(AppClient *client, Container *textarea, TextAreaData *data, int am
 
 static void
 replace_action(AppClient *client, Container *textarea, TextAreaData *data, std::string text) {
-    auto undo_action = new UndoAction;
-    undo_action->type = UndoType::REPLACE;
+    UndoAction undo_action;
+    undo_action.type = UndoType::REPLACE;
     
     int min_pos = std::min(data->state->cursor, data->state->selection_x);
     int max_pos = std::max(data->state->cursor, data->state->selection_x);
     
-    undo_action->inserted_text = text;
-    undo_action->replaced_text = data->state->text.substr(min_pos, max_pos - min_pos);
-    
-    undo_action->cursor_start = data->state->cursor;
-    undo_action->cursor_end = min_pos + text.size();
-    undo_action->selection_start = data->state->selection_x;
-    undo_action->selection_end = -1;
-    data->state->undo_stack.push_back(undo_action);
+    undo_action.cursor_start = data->state->cursor;
+    undo_action.cursor_end = min_pos + text.size();
+    undo_action.selection_start = data->state->selection_x;
+    undo_action.selection_end = -1;
+    data->state->history.push(undo_action, data->state->text.substr(min_pos, max_pos - min_pos), text);
     
-    data->state->text.erase(min_pos, max_pos - min_pos);
-    data->state->text.insert(min_pos, text);
+    text_erase(data->state, min_pos, max_pos - min_pos);
+    text_insert(data->state, min_pos, text);
     
-    move_cursor(data, undo_action->cursor_end, false);
+    move_cursor(data, undo_action.cursor_end, false);
     update_preffered_x(client, textarea);
     update_bounds(client, textarea);
     put_cursor_on_screen(client, textarea);
@@ -1522,30 +1728,17 @@ move_vertically_lines(AppClient *client,
                       Container *textarea,
                       bool shift,
                       int multiplier) {
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, data->font, data->font_size, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    pango_layout_set_text(layout, data->state->text.c_str(), data->state->text.length());
-    if (data->wrap) {
-        pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_width(layout, textarea->real_bounds.w * PANGO_SCALE);
-    }
+    PangoRectangle strong_pos = cursor_rect(client, textarea, data->state->cursor);
     
-    PangoRectangle strong_pos;
-    PangoRectangle weak_pos;
-    pango_layout_get_cursor_pos(layout, data->state->cursor, &strong_pos, &weak_pos);
-    
-    PangoLayoutLine *line = pango_layout_get_line(layout, 0);
+    PangoLayoutLine *line = pango_layout_get_line(data->state->lines[0].layout, 0);
     PangoRectangle ink_rect;
     PangoRectangle logical_rect;
     pango_layout_line_get_extents(line, &ink_rect, &logical_rect);
     
-    int index;
-    int trailing;
     int x = data->state->preferred_x;
     int y = strong_pos.y + (logical_rect.height * multiplier);
-    bool inside = pango_layout_xy_to_index(layout, x, y, &index, &trailing);
-    move_cursor(data, index + trailing, shift);
+    int index = index_at(client, textarea, x, y);
+    move_cursor(data, index, shift);
     put_cursor_on_screen(client, textarea);
 }
 
@@ -1638,17 +1831,16 @@ textarea_handle_keypress(AppClient *client, Container *textarea, bool is_string,
         } else if (keysym == XKB_KEY_z) {
             if (control) {
                 // undo
-                if (!data->state->undo_stack.empty()) {
-                    UndoAction *action = data->state->undo_stack.back();
-                    data->state->undo_stack.pop_back();
-                    data->state->redo_stack.push_back(action);
+                UndoHistory &history = data->state->history;
+                if (history.position > 0) {
+                    UndoAction *action = &history.actions[--history.position];
                     
                     if (action->type == UndoType::INSERT) {
                         int cursor_start = action->cursor_start;
                         int cursor_end = action->cursor_end;
-                        std::string text = action->inserted_text;
+                        std::string text = history.inserted(*action);
                         
-                        data->state->text.erase(cursor_start, text.size());
+                        text_erase(data->state, cursor_start, text.size());
                         
                         data->state->cursor = cursor_start;
                         data->state->selection_x = -1;
@@ -1659,9 +1851,9 @@ textarea_handle_keypress(AppClient *client, Container *textarea, bool is_string,
                         int min = std::min(cursor_start, cursor_end);
                         int max = std::max(cursor_start, cursor_end);
                         
-                        std::string text = action->replaced_text;
+                        std::string text = history.replaced(*action);
                         
-                        data->state->text.insert(min, text);
+                        text_insert(data->state, min, text);
                         
                         data->state->cursor = cursor_start;
                         data->state->selection_x = -1;
@@ -1671,12 +1863,11 @@ textarea_handle_keypress(AppClient *client, Container *textarea, bool is_string,
                         int cursor_end = action->cursor_end;
                         int selection_start = action->selection_start;
                         int selection_end = action->selection_end;
-                        std::string replaced = action->replaced_text;
-                        std::string inserted = action->inserted_text;
+                        std::string replaced = history.replaced(*action);
+                        std::string inserted = history.inserted(*action);
                         
-                        data->state->text.erase(cursor_end - inserted.size(),
-                                                inserted.size());
-                        data->state->text.insert(cursor_end - inserted.size(), replaced);
+                        text_erase(data->state, cursor_end - inserted.size(), inserted.size());
+                        text_insert(data->state, cursor_end - inserted.size(), replaced);
                         
                         data->state->cursor = cursor_start;
                         data->state->selection_x = selection_start;
@@ -1691,18 +1882,17 @@ textarea_handle_keypress(AppClient *client, Container *textarea, bool is_string,
         } else if (keysym == XKB_KEY_Z) {
             if (control) {
                 // redo
-                if (!data->state->redo_stack.empty()) {
-                    UndoAction *action = data->state->redo_stack.back();
-                    data->state->redo_stack.pop_back();
-                    data->state->undo_stack.push_back(action);
+                UndoHistory &history = data->state->history;
+                if (history.position < history.actions.size()) {
+                    UndoAction *action = &history.actions[history.position++];
                     
                     if (action->type == UndoType::INSERT) {
                         // do an insert
                         int cursor_start = action->cursor_start;
                         int cursor_end = action->cursor_end;
-                        std::string text = action->inserted_text;
+                        std::string text = history.inserted(*action);
                         
-                        data->state->text.insert(cursor_start, text);
+                        text_insert(data->state, cursor_start, text);
                         
                         data->state->cursor = cursor_end;
                         data->state->selection_x = -1;
@@ -1714,9 +1904,9 @@ textarea_handle_keypress(AppClient *client, Container *textarea, bool is_string,
                         int min = std::min(cursor_start, cursor_end);
                         int max = std::max(cursor_start, cursor_end);
                         
-                        std::string text = action->replaced_text;
+                        std::string text = history.replaced(*action);
                         
-                        data->state->text.erase(min, text.size());
+                        text_erase(data->state, min, text.size());
                         
                         data->state->cursor = cursor_end;
                         data->state->selection_x = -1;
@@ -1726,13 +1916,13 @@ textarea_handle_keypress(AppClient *client, Container *textarea, bool is_string,
                         int cursor_end = action->cursor_end;
                         int selection_start = action->selection_start;
                         int selection_end = action->selection_end;
-                        std::string replaced = action->replaced_text;
-                        std::string inserted = action->inserted_text;
+                        std::string replaced = history.replaced(*action);
+                        std::string inserted = history.inserted(*action);
                         
                         int min = std::min(cursor_start, selection_start);
                         int max = std::max(cursor_start, selection_start);
-                        data->state->text.erase(min, max - min);
-                        data->state->text.insert(min, inserted);
+                        text_erase(data->state, min, max - min);
+                        text_insert(data->state, min, inserted);
                         
                         data->state->cursor = cursor_end;
                         data->state->selection_x = -1;
@@ -6,6 +6,7 @@
 #define SCROLL_COMPONENTS_H
 
 #include <application.h>
+#include <deque>
 #include <stack>
 #include <utility.h>
 
@@ -42,6 +43,56 @@ void scrollpane_scrolled(AppClient *client,
                          int scroll_x,
                          int scroll_y);
 
+// The text of a textarea, stored with a gap at the place it was last edited so that typing in the middle of a long
+// note only moves the bytes between the previous edit and this one instead of everything after the cursor
+class TextBuffer {
+public:
+    TextBuffer &operator=(const std::string &text);
+    
+    size_t size() const { return buffer.size() - (gap_end - gap_start); }
+    
+    bool empty() const { return size() == 0; }
+    
+    char at(size_t pos) const { return buffer[pos < gap_start ? pos : pos + (gap_end - gap_start)]; }
+    
+    std::string substr(size_t pos, size_t length) const;
+    
+    void insert(size_t pos, const std::string &text);
+    
+    void erase(size_t pos, size_t length);
+    
+    // The whole text in one piece, only put together again when it was edited since the last time it was asked for
+    const std::string &str() const;
+    
+    // Goes up with every change, so anything worked out from the text can tell that it's out of date
+    long version() const { return changes; }
+
+private:
+    void move_gap(size_t pos);
+    
+    std::vector<char> buffer;
+    size_t gap_start = 0;
+    size_t gap_end = 0;
+    long changes = 0;
+    
+    mutable std::string joined;
+    mutable long joined_version = 0;
+};
+
+// One paragraph of the text (everything between two newlines) with a layout of its own, so that an edit only has to
+// lay out again the paragraphs it touched
+struct TextLine {
+    int start = 0;// byte offset into the text
+    int length = 0;// not counting the newline
+    PangoLayout *layout = nullptr;
+    bool dirty = true;
+    
+    // In pango units
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
 enum UndoType {
     INSERT,
     DELETE,
@@ -49,23 +100,67 @@ enum UndoType {
     CURSOR,
 };
 
-class UndoAction {
-public:
+// An undoable edit, or a run of them folded together. Its text lives in the history's arena.
+struct UndoAction {
     UndoType type;
     
-    std::string inserted_text;
-    std::string replaced_text;
+    // Where the replaced text starts in the arena (counting bytes the arena already let go of), directly followed by
+    // the inserted text
+    size_t text_offset = 0;
+    size_t replaced_length = 0;
+    size_t inserted_length = 0;
     
     int cursor_start = -1;
     int cursor_end = -1;
     
     int selection_start = -1;
     int selection_end = -1;
+    
+    long time = 0;// of the last edit folded into it
+};
+
+// Everything a textarea can undo and redo. Actions sit side by side in one deque and their text in one arena
+// instead of a heap allocation and two strings per keystroke, and when the history grows past its budget the oldest
+// actions are forgotten.
+class UndoHistory {
+public:
+    // Actions before position can be undone, the ones after it redone
+    std::deque<UndoAction> actions;
+    size_t position = 0;
+    
+    size_t budget = 256 * 1024;
+    
+    // The newest action if it can still be added to, which it can't once something was undone
+    UndoAction *last();
+    
+    // Starting a new edit throws away whatever could have been redone
+    void forget_redo();
+    
+    void push(UndoAction action, const std::string &replaced, const std::string &inserted);
+    
+    // Only for the newest action
+    void append_inserted(const std::string &text);
+    
+    void append_replaced(const std::string &text);
+    
+    void prepend_replaced(const std::string &text);
+    
+    std::string replaced(const UndoAction &action) const;
+    
+    std::string inserted(const UndoAction &action) const;
+    
+    char last_inserted_char(const UndoAction &action) const;
+
+private:
+    void keep_to_budget();
+    
+    std::string arena;
+    size_t arena_base = 0;// offset of arena[0], which goes up as the front of the arena is let go of
 };
 
 class TextState : public UserData {
 public:
-    std::string text;
+    TextBuffer text;
     std::string prompt;
     
     Timeout *cursor_blink = nullptr;
@@ -77,17 +172,24 @@ public:
     int preferred_x = 0;
     
     int selection_x = -1;// when -1 means there is no selection
-    std::vector<UndoAction *> redo_stack;
-    std::vector<UndoAction *> undo_stack;
+    UndoHistory history;
     
     bool first_bounds_update = true;
     
+    // Kept in step with text by the textarea's edits. Anything else that changes the text (like assigning to it)
+    // leaves lines_version behind and the lines are split up again from scratch the next time they're needed.
+    std::vector<TextLine> lines;
+    long lines_version = -1;
+    std::string lines_font;
+    int lines_font_size = 0;
+    int lines_wrap_width = -1;
+    int lines_width = 0;
+    int lines_height = 0;
+    
     ~TextState() {
-        for (auto *a: redo_stack) {
-            delete a;
-        }
-        for (auto *a: undo_stack) {
-            delete a;
+        for (auto &line: lines) {
+            if (line.layout)
+                g_object_unref(line.layout);
         }
     }
 };
@@ -860,7 +860,7 @@ write_agenda_to_disk(AppClient *client) {
             myfile.open(calendarPath +
                         std::string(std::to_string(ds->day) + "_" + std::to_string(ds->month) +
                                     "_" + std::to_string(ds->year) + ".txt"));
-            myfile << ds->state->text;
+            myfile << ds->state->text.str();
             myfile.close();
         }
     }
@@ -991,7 +991,8 @@ static void paint_date_menu(App *app, AppClient *client, Timeout *timeout, void
     }
 }
 
-void start_date_menu() {
+static Settings
+date_menu_settings() {
     Settings settings;
     settings.w = 360;
     if (agenda_showing) {
@@ -1016,6 +1017,11 @@ void start_date_menu() {
     settings.slide_data[2] = 160;
     settings.slide_data[3] = 100;
     settings.slide_data[4] = 80;
+    return settings;
+}
+
+void start_date_menu() {
+    Settings settings = date_menu_settings();
     
     if (auto taskbar = client_by_name(app, "taskbar")) {
         PopupSettings popup_settings;
@@ -1035,3 +1041,7 @@ void start_date_menu() {
         client_show(app, client);
     }
 }
+
+void prewarm_date_menu() {
+    client_prewarm(app, date_menu_settings(), "date_menu");
+}
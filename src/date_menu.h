@@ -5,4 +5,6 @@
 
 void start_date_menu();
 
+void prewarm_date_menu();
+
 #endif// DATE_MENU_H
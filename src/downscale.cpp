@@ -0,0 +1,117 @@
+#include "downscale.h"
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/Tracy.hpp"
+
+#endif
+
+#include <cairo.h>
+#include <cstddef>
+
+#if defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#endif
+
+static inline uint32_t
+average_four(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    uint32_t pixel = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t sum = ((a >> shift) & 0xff) + ((b >> shift) & 0xff) + ((c >> shift) & 0xff) + ((d >> shift) & 0xff);
+        pixel |= ((sum + 2) >> 2) << shift;
+    }
+    return pixel;
+}
+
+// Output pixels x to dst_width of one row, from the two source rows under it
+static inline void
+downscale_row_plain(const uint32_t *top, const uint32_t *bottom, uint32_t *out, int x, int dst_width) {
+    for (; x < dst_width; x++)
+        out[x] = average_four(top[x * 2], top[x * 2 + 1], bottom[x * 2], bottom[x * 2 + 1]);
+}
+
+void downscale_half_plain(const uint32_t *src, int src_width, int src_height, uint32_t *dst) {
+    int dst_width = src_width / 2;
+    int dst_height = src_height / 2;
+    for (int y = 0; y < dst_height; y++) {
+        const uint32_t *top = src + (size_t) (y * 2) * src_width;
+        downscale_row_plain(top, top + src_width, dst + (size_t) y * dst_width, 0, dst_width);
+    }
+}
+
+void downscale_half(const uint32_t *src, int src_width, int src_height, uint32_t *dst) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+#if defined(__SSE2__)
+    int dst_width = src_width / 2;
+    int dst_height = src_height / 2;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    for (int y = 0; y < dst_height; y++) {
+        const uint32_t *top = src + (size_t) (y * 2) * src_width;
+        const uint32_t *bottom = top + src_width;
+        uint32_t *out = dst + (size_t) y * dst_width;
+        int x = 0;
+        for (; x + 2 <= dst_width; x += 2) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (top + x * 2));
+            __m128i b = _mm_loadu_si128((const __m128i *) (bottom + x * 2));
+            // Widen to 16 bits per channel and add the rows, then add the neighbouring columns
+            __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            left = _mm_add_epi16(left, _mm_srli_si128(left, 8));
+            right = _mm_add_epi16(right, _mm_srli_si128(right, 8));
+            __m128i sum = _mm_unpacklo_epi64(left, right);
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+            _mm_storel_epi64((__m128i *) (out + x), _mm_packus_epi16(sum, zero));
+        }
+        downscale_row_plain(top, bottom, out, x, dst_width);
+    }
+#else
+    downscale_half_plain(src, src_width, src_height, dst);
+#endif
+}
+
+bool shrink_by_halves(const uint32_t *pixels, int *width, int *height, int target_width, int target_height,
+                      std::vector<uint32_t> *shrunk) {
+    std::vector<uint32_t> levels[2];
+    const uint32_t *level = pixels;
+    int next = 0;
+    while (*width / 2 >= target_width && *height / 2 >= target_height) {
+        levels[next].resize((size_t) (*width / 2) * (*height / 2));
+        downscale_half(level, *width, *height, levels[next].data());
+        level = levels[next].data();
+        *width /= 2;
+        *height /= 2;
+        next = 1 - next;
+    }
+    if (level == pixels)
+        return false;
+    *shrunk = std::move(levels[1 - next]);
+    return true;
+}
+
+void scale_to(const uint32_t *pixels, int width, int height, int target_width, int target_height,
+              std::vector<uint32_t> *scaled) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    scaled->assign((size_t) target_width * target_height, 0);
+    auto source = cairo_image_surface_create_for_data((unsigned char *) pixels, CAIRO_FORMAT_ARGB32, width, height,
+                                                      width * sizeof(uint32_t));
+    auto target = cairo_image_surface_create_for_data((unsigned char *) scaled->data(), CAIRO_FORMAT_ARGB32,
+                                                      target_width, target_height,
+                                                      target_width * sizeof(uint32_t));
+    cairo_t *cr = cairo_create(target);
+    cairo_scale(cr, (double) target_width / width, (double) target_height / height);
+    cairo_set_source_surface(cr, source, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(target);
+    cairo_surface_destroy(target);
+    cairo_surface_destroy(source);
+}
@@ -0,0 +1,24 @@
+#ifndef WINBAR_DOWNSCALE_H
+#define WINBAR_DOWNSCALE_H
+
+#include <cstdint>
+#include <vector>
+
+// Box filters src down to half its size (odd last rows and columns are dropped).
+// Two output pixels at a time with SSE2 when built with it, otherwise the same as downscale_half_plain.
+void downscale_half(const uint32_t *src, int src_width, int src_height, uint32_t *dst);
+
+// The scalar loop downscale_half falls back on for what SSE2 doesn't cover
+void downscale_half_plain(const uint32_t *src, int src_width, int src_height, uint32_t *dst);
+
+// Halves pixels until the next half would be smaller than the target size, so the result is never more than twice
+// that size on each side. Returns false, leaving shrunk alone, if there was nothing to halve.
+bool shrink_by_halves(const uint32_t *pixels, int *width, int *height, int target_width, int target_height,
+                      std::vector<uint32_t> *shrunk);
+
+// The last, less than half, step down to the target size with cairo's CAIRO_FILTER_GOOD.
+// Image surfaces don't need the X connection so this is fine off the main thread.
+void scale_to(const uint32_t *pixels, int width, int height, int target_width, int target_height,
+              std::vector<uint32_t> *scaled);
+
+#endif //WINBAR_DOWNSCALE_H
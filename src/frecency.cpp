@@ -0,0 +1,316 @@
+#include "frecency.h"
+#include "globals.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// The log is a small header followed by records, each immediately followed by
+// its name bytes. A launch appends one record with count 1 and score 1.
+// Compaction rewrites the log with one record per entry carrying its totals,
+// and since replay folds records into entries with the same decay formula
+// either kind of record is replayed the same way.
+//
+// Each record carries a checksum so a write torn by a crash is detected on the
+// next load, at which point everything after the last good record is dropped.
+
+static const char frecency_magic[4] = {'W', 'B', 'F', 'R'};
+static const uint32_t frecency_version = 1;
+
+// How long it takes for a launch to be worth half as much
+static const float half_life_in_seconds = 60 * 60 * 24 * 14;
+
+// Compacted entries whose decayed score falls below this are forgotten
+static const float forget_below_score = 0.05;
+
+struct FrecencyHeader {
+    char magic[4];
+    uint32_t version;
+};
+
+struct FrecencyRecord {
+    uint32_t checksum; // fnv1a of the rest of the record and the name bytes
+    uint8_t kind;
+    uint8_t unused;
+    uint16_t name_length;
+    uint32_t count;
+    float score;
+    int64_t when;
+};
+
+static std::string log_path;
+static std::string pending;
+static long pending_records = 0;
+static long records_in_log = 0;
+static bool directories_made = false;
+
+float HistoryIndex::score(const std::string &lowercase_name, int64_t now) const {
+    auto it = entries.find(lowercase_name);
+    if (it == entries.end())
+        return 0;
+    return frecency_decay(it->second.score, it->second.last_used, now);
+}
+
+void HistoryIndex::add(const std::string &lowercase_name, uint32_t count, float score, int64_t when) {
+    HistoryEntry &entry = entries[lowercase_name];
+    if (when >= entry.last_used) {
+        entry.score = frecency_decay(entry.score, entry.last_used, when) + score;
+        entry.last_used = when;
+    } else {
+        entry.score += frecency_decay(score, when, entry.last_used);
+    }
+    entry.count += count;
+}
+
+float frecency_decay(float score, int64_t from, int64_t now) {
+    if (score == 0 || now <= from)
+        return score;
+    return score * std::exp2(-(float) (now - from) / half_life_in_seconds);
+}
+
+static uint32_t
+checksum(const FrecencyRecord &record, const char *name) {
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const char *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= (uint8_t) data[i];
+            hash *= 16777619u;
+        }
+    };
+    const char *fields = (const char *) &record;
+    mix(fields + sizeof(record.checksum), sizeof(FrecencyRecord) - sizeof(record.checksum));
+    mix(name, record.name_length);
+    return hash;
+}
+
+static HistoryIndex *
+index_for(uint8_t kind) {
+    if (kind == FRECENCY_APP)
+        return &global->history_apps;
+    if (kind == FRECENCY_SCRIPT)
+        return &global->history_scripts;
+    return nullptr;
+}
+
+static void
+append_record(std::string *buffer, FrecencyKind kind, const std::string &name,
+              uint32_t count, float score, int64_t when) {
+    FrecencyRecord record{};
+    record.kind = kind;
+    record.name_length = (uint16_t) std::min(name.size(), (size_t) UINT16_MAX);
+    record.count = count;
+    record.score = score;
+    record.when = when;
+    record.checksum = checksum(record, name.data());
+    buffer->append((const char *) &record, sizeof(FrecencyRecord));
+    buffer->append(name.data(), record.name_length);
+}
+
+static bool
+make_directories() {
+    if (directories_made)
+        return true;
+    const char *home = getenv("HOME");
+    std::string path(home);
+    for (const char *part: {"/.config", "/winbar", "/historic"}) {
+        path += part;
+        if (mkdir(path.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
+            if (errno != EEXIST) {
+                printf("Couldn't mkdir %s\n", path.c_str());
+                return false;
+            }
+        }
+    }
+    directories_made = true;
+    return true;
+}
+
+static bool
+write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Rewrites the log with a single record per entry, atomically replacing the old one
+static void
+compact() {
+    if (!make_directories())
+        return;
+    int64_t now = time(nullptr);
+    
+    std::string buffer;
+    FrecencyHeader header{};
+    memcpy(header.magic, frecency_magic, sizeof(frecency_magic));
+    header.version = frecency_version;
+    buffer.append((const char *) &header, sizeof(FrecencyHeader));
+    
+    long records = 0;
+    for (auto kind: {FRECENCY_APP, FRECENCY_SCRIPT}) {
+        auto *index = index_for(kind);
+        for (auto it = index->entries.begin(); it != index->entries.end();) {
+            if (frecency_decay(it->second.score, it->second.last_used, now) < forget_below_score) {
+                it = index->entries.erase(it);
+                continue;
+            }
+            append_record(&buffer, kind, it->first, it->second.count, it->second.score, it->second.last_used);
+            records++;
+            ++it;
+        }
+    }
+    
+    std::string temp_path = log_path + ".tmp";
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        printf("Couldn't open %s\n", temp_path.c_str());
+        return;
+    }
+    bool ok = write_all(fd, buffer.data(), buffer.size()) && fsync(fd) == 0;
+    close(fd);
+    if (ok && rename(temp_path.c_str(), log_path.c_str()) == 0) {
+        records_in_log = records;
+    } else {
+        unlink(temp_path.c_str());
+    }
+}
+
+// Seeds the index from the text files written by older versions, most recent first
+static bool
+import_text_history(const std::string &path, FrecencyKind kind, int64_t now) {
+    std::ifstream status_file(path);
+    if (!status_file.is_open())
+        return false;
+    auto *index = index_for(kind);
+    std::string line;
+    int position = 0;
+    while (getline(status_file, line)) {
+        if (!line.empty() && index->entries.find(line) == index->entries.end())
+            index->add(line, 1, 1, now - position);
+        position++;
+    }
+    return true;
+}
+
+// Returns true if the log should be compacted after replay
+static bool
+replay(const char *data, size_t size) {
+    if (size < sizeof(FrecencyHeader))
+        return true;
+    FrecencyHeader header{};
+    memcpy(&header, data, sizeof(FrecencyHeader));
+    if (memcmp(header.magic, frecency_magic, sizeof(frecency_magic)) != 0 || header.version != frecency_version) {
+        printf("Ignoring unrecognized frecency log: %s\n", log_path.c_str());
+        return true;
+    }
+    
+    size_t offset = sizeof(FrecencyHeader);
+    while (offset + sizeof(FrecencyRecord) <= size) {
+        FrecencyRecord record{};
+        memcpy(&record, data + offset, sizeof(FrecencyRecord));
+        const char *name = data + offset + sizeof(FrecencyRecord);
+        if (offset + sizeof(FrecencyRecord) + record.name_length > size ||
+            checksum(record, name) != record.checksum) {
+            break;
+        }
+        if (auto *index = index_for(record.kind))
+            index->add(std::string(name, record.name_length), record.count, record.score, record.when);
+        offset += sizeof(FrecencyRecord) + record.name_length;
+        records_in_log++;
+    }
+    
+    // A torn tail is left by a crash mid append and has to be cut off
+    return offset != size;
+}
+
+void frecency_load() {
+    const char *home = getenv("HOME");
+    std::string historic_path(home);
+    historic_path += "/.config/winbar/historic/";
+    log_path = historic_path + "frecency.bin";
+    records_in_log = 0;
+    global->history_apps.entries.clear();
+    global->history_scripts.entries.clear();
+    
+    bool needs_compaction = false;
+    int fd = open(log_path.c_str(), O_RDONLY);
+    if (fd != -1) {
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                needs_compaction = replay((const char *) data, st.st_size);
+                munmap(data, st.st_size);
+            }
+        } else {
+            needs_compaction = true;
+        }
+        close(fd);
+    } else {
+        int64_t now = time(nullptr);
+        bool imported = import_text_history(historic_path + "apps.txt", FRECENCY_APP, now);
+        imported = import_text_history(historic_path + "scripts.txt", FRECENCY_SCRIPT, now) || imported;
+        needs_compaction = imported;
+    }
+    
+    size_t entry_count = global->history_apps.entries.size() + global->history_scripts.entries.size();
+    if (needs_compaction || records_in_log > (long) entry_count * 4 + 64)
+        compact();
+}
+
+void frecency_record(FrecencyKind kind, const std::string &lowercase_name) {
+    int64_t now = time(nullptr);
+    index_for(kind)->add(lowercase_name, 1, 1, now);
+    append_record(&pending, kind, lowercase_name, 1, 1, now);
+    pending_records++;
+}
+
+void frecency_flush() {
+    if (pending.empty() || log_path.empty())
+        return;
+    
+    // Folding the log back down is cheaper than letting replay grow forever
+    size_t entry_count = global->history_apps.entries.size() + global->history_scripts.entries.size();
+    if (records_in_log > (long) entry_count * 4 + 64) {
+        pending.clear();
+        pending_records = 0;
+        compact();
+        return;
+    }
+    
+    if (!make_directories())
+        return;
+    int fd = open(log_path.c_str(), O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        printf("Couldn't open %s\n", log_path.c_str());
+        return;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && st.st_size == 0) {
+        FrecencyHeader header{};
+        memcpy(header.magic, frecency_magic, sizeof(frecency_magic));
+        header.version = frecency_version;
+        pending.insert(0, (const char *) &header, sizeof(FrecencyHeader));
+    }
+    if (write_all(fd, pending.data(), pending.size())) {
+        records_in_log += pending_records;
+    }
+    close(fd);
+    pending.clear();
+    pending_records = 0;
+}
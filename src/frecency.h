@@ -0,0 +1,45 @@
+#ifndef WINBAR_FRECENCY_H
+#define WINBAR_FRECENCY_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+struct HistoryEntry {
+    uint32_t count = 0;    // total number of launches
+    float score = 0;       // launch score decayed to last_used
+    int64_t last_used = 0; // unix time in seconds
+};
+
+// Maps a lowercase name to its launch history so the search menu can rank a
+// match with a single lookup.
+class HistoryIndex {
+public:
+    std::unordered_map<std::string, HistoryEntry> entries;
+    
+    // Returns 0 if the name was never launched, otherwise its score decayed to now
+    float score(const std::string &lowercase_name, int64_t now) const;
+    
+    // Folds count launches worth score, the last of which happened at when, into the entry
+    void add(const std::string &lowercase_name, uint32_t count, float score, int64_t when);
+};
+
+enum FrecencyKind {
+    FRECENCY_APP = 0,
+    FRECENCY_SCRIPT = 1,
+};
+
+// Decays a score from the time it was computed at to now
+float frecency_decay(float score, int64_t from, int64_t now);
+
+// Replays ~/.config/winbar/historic/frecency.bin into global->history_apps and
+// global->history_scripts, compacting it if it has grown or has a torn tail.
+void frecency_load();
+
+// Records a launch in memory; it hits the disk on the next frecency_flush
+void frecency_record(FrecencyKind kind, const std::string &lowercase_name);
+
+// Appends every pending launch to the log in one write
+void frecency_flush();
+
+#endif //WINBAR_FRECENCY_H
@@ -6,13 +6,7 @@
 #define WINBAR_GLOBALS_H
 
 #include <cairo.h>
-#include <string>
-#include <vector>
-
-class HistoricalNameUsed {
-public:
-    std::string text;
-};
+#include "frecency.h"
 
 class globals {
 public:
@@ -21,8 +15,8 @@ public:
     cairo_surface_t *unknown_icon_24 = nullptr;
     cairo_surface_t *unknown_icon_64 = nullptr;
     
-    std::vector<HistoricalNameUsed *> history_scripts;
-    std::vector<HistoricalNameUsed *> history_apps;
+    HistoryIndex history_scripts;
+    HistoryIndex history_apps;
     
     ~globals() {
         if (unknown_icon_16)
@@ -33,14 +27,6 @@ public:
             cairo_surface_destroy(unknown_icon_24);
         if (unknown_icon_64)
             cairo_surface_destroy(unknown_icon_64);
-        for (auto s: history_scripts)
-            delete s;
-        history_scripts.clear();
-        history_scripts.shrink_to_fit();
-        for (auto a: history_apps)
-            delete a;
-        history_apps.clear();
-        history_apps.shrink_to_fit();
     }
 };
 
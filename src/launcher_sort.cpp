@@ -0,0 +1,50 @@
+#include "launcher_sort.h"
+
+#include <algorithm>
+#include <cctype>
+#include <clocale>
+#include <cstring>
+
+std::string collation_key(const std::string &lowercase_name) {
+    static locale_t collation_locale = newlocale(LC_COLLATE_MASK, "", (locale_t) 0);
+    if (collation_locale == (locale_t) 0)
+        return lowercase_name;
+    
+    size_t length = strxfrm_l(nullptr, lowercase_name.c_str(), 0, collation_locale);
+    std::string key(length + 1, '\0');
+    strxfrm_l(key.data(), lowercase_name.c_str(), key.size(), collation_locale);
+    key.resize(length);
+    return key;
+}
+
+void assign_app_menu_priority(Launcher *l, time_t now) {
+    auto recently_added_threshold = 86400 * 2; // two days  in seconds
+    double diff = difftime(now, l->time_modified);
+    if (diff < recently_added_threshold) { // less than two days old
+        l->app_menu_priority = 1;
+    } else if (!l->name.empty()) {
+        if (!isalnum(l->name[0])) { // is symbol
+            l->app_menu_priority = 2;
+        } else if (isdigit(l->name[0])) { // is number
+            l->app_menu_priority = 3;
+        } else { // is ascii
+            l->app_menu_priority = 4;
+        }
+    }
+}
+
+void sort_launchers(std::vector<Launcher *> *to_sort) {
+    // TODO: sort in order latest, &, #, A...Z
+    std::sort(to_sort->begin(), to_sort->end(), [](const auto &lhs, const auto &rhs) {
+        if (lhs->app_menu_priority == rhs->app_menu_priority) {
+            if (lhs->app_menu_priority == 1) { // time based
+                return lhs->time_modified > rhs->time_modified;
+            }
+            
+            // alphabetical order
+            return lhs->collation_key < rhs->collation_key;
+        } else {
+            return lhs->app_menu_priority < rhs->app_menu_priority;
+        }
+    });
+}
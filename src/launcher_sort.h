@@ -0,0 +1,20 @@
+#ifndef WINBAR_LAUNCHER_SORT_H
+#define WINBAR_LAUNCHER_SORT_H
+
+#include "app_menu.h"
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+// strxfrm of lowercase_name under the user's LC_COLLATE (the name itself if that locale can't be opened).
+// Sorting by it gives the same order as strcoll on the names, but each comparison is just a byte compare.
+std::string collation_key(const std::string &lowercase_name);
+
+// Recently added launchers first, then ones starting with a symbol, then a digit, then a letter
+void assign_app_menu_priority(Launcher *l, time_t now);
+
+// Orders launchers the way the app menu lists them, using the app_menu_priority and collation_key already on them
+void sort_launchers(std::vector<Launcher *> *to_sort);
+
+#endif //WINBAR_LAUNCHER_SORT_H
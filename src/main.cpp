@@ -11,10 +11,17 @@
 #include "taskbar.h"
 #include "config.h"
 #include "globals.h"
+#include "frecency.h"
 #include "notifications.h"
 #include "wifi_backend.h"
 #include "simple_dbus.h"
 #include "icons.h"
+#include "startup.h"
+#include "search_menu.h"
+#include "date_menu.h"
+#include "battery_menu.h"
+#include "volume_menu.h"
+#include "wifi_menu.h"
 
 App *app;
 
@@ -22,6 +29,17 @@ bool restart = false;
 
 void check_config_version();
 
+// Creates the popup windows ahead of time so the first time they're opened is as fast as every other time
+static void
+prewarm_popups(App *app, AppClient *, Timeout *, void *) {
+    prewarm_app_menu();
+    prewarm_search_menu();
+    prewarm_date_menu();
+    prewarm_battery_menu();
+    prewarm_volume_menu();
+    prewarm_wifi_menu();
+}
+
 int main() {
 //    char buf[102];
 //    buf[0] = '\0';
@@ -46,39 +64,44 @@ int main() {
     
     active_tab = config->starting_tab_index == 0 ? "Apps" : "Scripts";
     
-    load_icons(app);
-    
-    // Add listeners and grabs on the root window
-    root_start(app);
-    
-    // Start the pulseaudio connection
-    audio_start(app);
-    
-    // We need to register as the systray
-    register_as_systray();
-    
-    // Open our windows
-    AppClient *taskbar = create_taskbar(app);
-    
-    // We only want to load the desktop files once at the start of the program
-    //std::thread(load_desktop_files).detach();
-    load_all_desktop_files();
-    load_scripts();// The scripts are reloaded every time the search_menu window closes
-    load_historic_scripts();
-    load_historic_apps();
-    
-    client_show(app, taskbar);
-    xcb_set_input_focus(app->connection, XCB_INPUT_FOCUS_PARENT, taskbar->window, XCB_CURRENT_TIME);
-    
-    on_meta_key_pressed = meta_pressed;
-    
-    dbus_start();
-    
-    wifi_start(app);
+    // Everything that doesn't depend on each other is started at the same time, see startup.trace for the timeline
+    AppClient *taskbar = nullptr;
+    std::vector<StartupTask> tasks = {
+            {"icons",         {},                                false, [] { load_icons(app); }},
+            // Add listeners and grabs on the root window
+            {"root",          {},                                true,  [] { root_start(app); }},
+            // Start the pulseaudio connection
+            {"audio",         {},                                false, [] { audio_start(app); }},
+            // We need to register as the systray
+            {"systray",       {"root"},                          true,  [] { register_as_systray(); }},
+            // Open our windows
+            {"taskbar",       {"root", "systray"},               true,  [&taskbar] {
+                taskbar = create_taskbar(app);
+                client_show(app, taskbar);
+                xcb_set_input_focus(app->connection, XCB_INPUT_FOCUS_PARENT, taskbar->window, XCB_CURRENT_TIME);
+                on_meta_key_pressed = meta_pressed;
+            }},
+            // Pinned icons are looked up, and the volume button shows the real volume, once those are ready
+            {"taskbar icons", {"taskbar", "icons"},              true,  [] { taskbar_icons_loaded(); }},
+            {"taskbar audio", {"taskbar", "audio"},              true,  [] { taskbar_audio_started(); }},
+            // We only want to load the desktop files once at the start of the program (happens on another thread)
+            {"desktop files", {"taskbar", "icons"},              false, [] { load_all_desktop_files(); }},
+            // The scripts are kept up to date by watching the $PATH directories
+            {"scripts",       {},                                false, [] { load_scripts(app); }},
+            {"frecency",      {},                                false, [] { frecency_load(); }},
+            {"dbus",          {"taskbar"},                       false, [] { dbus_start(); }},
+            {"wifi",          {},                                false, [] { wifi_start(app); }},
+    };
+    startup_run(tasks);
+    
+    // Wait until after the taskbar has had its first paint
+    app_timeout_create(app, nullptr, 1000, prewarm_popups, nullptr);
     
     // Start our listening loop until the end of the program
     app_main(app);
     
+    unload_all_desktop_files();
+    
     unload_icons();
     
     dbus_end();
@@ -90,12 +113,6 @@ int main() {
     
     wifi_stop();
     
-    for (auto l: launchers) {
-        delete l;
-    }
-    launchers.clear();
-    launchers.shrink_to_fit();
-    
     delete global;
     
     if (restart) {
@@ -71,33 +71,10 @@ int determine_height_of_text(App *app, std::string text, PangoWeight weight, int
     int height = size;
     
     if (auto c = client_by_name(app, "taskbar")) {
-        PangoLayout *layout =
-                get_cached_pango_font(c->cr, config->font, size, weight);
-        auto initial_wrap = pango_layout_get_wrap(layout);
-        auto initial_ellipse = pango_layout_get_ellipsize(layout);
-        
-        pango_layout_set_attributes(layout, nullptr);
-        PangoAttrList *attrs = nullptr;
-        pango_parse_markup(text.data(), text.length(), 0, &attrs, NULL, NULL, NULL);
-        if (attrs) {
-            pango_layout_set_attributes(layout, attrs);
-        }
-        
-        pango_layout_set_width(layout, width * PANGO_SCALE);
-        const std::string &stripped = strip_html(text);
-        pango_layout_set_text(layout, stripped.data(), stripped.length());
-        pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_NONE);
-        
-        PangoRectangle text_ink;
-        PangoRectangle text_logical;
-        pango_layout_get_extents(layout, &text_ink, &text_logical);
-        
-        height = text_logical.height / PANGO_SCALE;
-        
-        pango_layout_set_width(layout, -1);
-        pango_layout_set_wrap(layout, initial_wrap);
-        pango_layout_set_ellipsize(layout, initial_ellipse);
+        // Shaped the same way paint_label will, so painting it afterwards finds it already done
+        auto text_layout = get_cached_text_layout(c->cr, text, config->font, size, weight, width,
+                                                  PANGO_WRAP_WORD_CHAR, PANGO_ELLIPSIZE_NONE, true, strip_html);
+        height = text_layout->logical.height / PANGO_SCALE;
     }
     
     return height;
@@ -106,35 +83,15 @@ int determine_height_of_text(App *app, std::string text, PangoWeight weight, int
 static void paint_label(AppClient *client, cairo_t *cr, Container *container) {
     auto data = (LabelData *) container->user_data;
     
-    PangoLayout *layout = get_cached_pango_font(
-            client->cr, config->font, data->size, data->weight);
-    auto initial_wrap = pango_layout_get_wrap(layout);
-    auto initial_ellipse = pango_layout_get_ellipsize(layout);
-    
-    pango_layout_set_attributes(layout, nullptr);
-    PangoAttrList *attrs = nullptr;
-    pango_parse_markup(data->text.data(), data->text.length(), 0, &attrs, NULL, NULL, NULL);
-    if (attrs) {
-        pango_layout_set_attributes(layout, attrs);
-    }
-    
-    const std::string &stripped = strip_html(data->text);
-    
-    pango_layout_set_width(layout, container->real_bounds.w * PANGO_SCALE);
-    pango_layout_set_text(layout, stripped.data(), stripped.length());
-    pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
-    pango_layout_set_alignment(layout, PANGO_ALIGN_LEFT);
-    pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_NONE);
+    auto text_layout = get_cached_text_layout(client->cr, data->text, config->font, data->size, data->weight,
+                                              container->real_bounds.w, PANGO_WRAP_WORD_CHAR,
+                                              PANGO_ELLIPSIZE_NONE, true, strip_html);
     
     set_argb(cr, config->color_notification_content_text);
     cairo_move_to(cr,
                   container->real_bounds.x,
                   container->real_bounds.y);
-    pango_cairo_show_layout(cr, layout);
-    
-    pango_layout_set_width(layout, -1);
-    pango_layout_set_wrap(layout, initial_wrap);
-    pango_layout_set_ellipsize(layout, initial_ellipse);
+    pango_cairo_show_layout(cr, text_layout->layout);
 }
 
 static void paint_notify(AppClient *client, cairo_t *cr, Container *container) {
@@ -312,7 +269,7 @@ void show_notification(App *app, NotificationInfo *ni) {
     settings.slide_data[4] = 170;
     
     auto client = client_new(app, settings, "winbar_notification_" + std::to_string(ni->id));
-    xcb_atom_t atom = get_cached_atom(app, "_NET_WM_WINDOW_TYPE_NOTIFICATION");
+    xcb_atom_t atom = get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_NOTIFICATION);
     xcb_ewmh_set_wm_window_type(&app->ewmh, client->window, 1, &atom);
     delete client->root;
     client->root = notification_container;
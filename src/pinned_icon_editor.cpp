@@ -143,9 +143,9 @@ static void paint_restore(AppClient *client, cairo_t *cr, Container *container)
     ArgbColor color = config->color_pinned_icon_editor_button_default;
     
     bool disabled = true;
-    if (pinned_icon_data->command_launched_by != launch_field_data->state->text ||
-        pinned_icon_data->icon_name != icon_field_data->state->text | \
-        pinned_icon_data->class_name != wm_field_data->state->text) {
+    if (pinned_icon_data->command_launched_by != launch_field_data->state->text.str() ||
+        pinned_icon_data->icon_name != icon_field_data->state->text.str() | \
+        pinned_icon_data->class_name != wm_field_data->state->text.str()) {
         disabled = false;
     }
     
@@ -239,9 +239,9 @@ static void clicked_save_and_quit(AppClient *client, cairo_t *cr, Container *con
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    pinned_icon_data->command_launched_by = launch_field_data->state->text;
-    pinned_icon_data->class_name = wm_field_data->state->text;
-    pinned_icon_data->icon_name = icon_field_data->state->text;
+    pinned_icon_data->command_launched_by = launch_field_data->state->text.str();
+    pinned_icon_data->class_name = wm_field_data->state->text.str();
+    pinned_icon_data->icon_name = icon_field_data->state->text.str();
     client_close_threaded(client->app, client);
     update_pinned_items_file(false);
     
@@ -256,7 +256,7 @@ static void update_icon(AppClient *client) {
         auto icon_data = (IconButton *) icon->user_data;
         
         std::vector<IconTarget> targets;
-        targets.emplace_back(IconTarget(icon_field_data->state->text));
+        targets.emplace_back(IconTarget(icon_field_data->state->text.str()));
         search_icons(targets);
         pick_best(targets, 64);
         std::string icon_path = targets[0].best_full_path;
@@ -266,9 +266,9 @@ static void update_icon(AppClient *client) {
                 icon_data->surface = nullptr;
             }
             load_icon_full_path(app, client, &icon_data->surface, icon_path, 64);
-            icon_search_state->text = "Found a match for: '" + icon_field_data->state->text + "'";
+            icon_search_state->text = "Found a match for: '" + icon_field_data->state->text.str() + "'";
         } else {
-            icon_search_state->text = "Didn't find a match for: '" + icon_field_data->state->text + "'";
+            icon_search_state->text = "Didn't find a match for: '" + icon_field_data->state->text.str() + "'";
             // TODO: this is kind of annoying, we should instead make the surface have a cairo_t and just clear the surface
             cairo_surface_destroy(icon_data->surface);
             icon_data->surface = nullptr;
@@ -281,9 +281,9 @@ static void clicked_restore(AppClient *client, cairo_t *cr, Container *container
     ZoneScoped;
 #endif
     bool disabled = true;
-    if (pinned_icon_data->command_launched_by != launch_field_data->state->text ||
-        pinned_icon_data->icon_name != icon_field_data->state->text | \
-        pinned_icon_data->class_name != wm_field_data->state->text) {
+    if (pinned_icon_data->command_launched_by != launch_field_data->state->text.str() ||
+        pinned_icon_data->icon_name != icon_field_data->state->text.str() | \
+        pinned_icon_data->class_name != wm_field_data->state->text.str()) {
         disabled = false;
     }
     if (disabled)
@@ -0,0 +1,291 @@
+#include "power_supply.h"
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/Tracy.hpp"
+
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+static const std::string power_supply_directory = "/sys/class/power_supply/";
+
+// Not every driver sends a uevent when the capacity drops (most ACPI batteries only do when the status changes),
+// so the files are also read again every so often. Much more often when there's no uevent socket at all.
+static const int refresh_with_uevents_ms = 60000;
+static const int refresh_without_uevents_ms = 7000;
+
+// The files are kept open and read with pread from the start, which is all sysfs needs to give fresh contents
+struct Battery {
+    std::string name;
+    int status_fd = -1;
+    int capacity_fd = -1;
+    
+    // energy_* on most drivers, charge_* on some, used to weigh batteries by size when there's more than one
+    int now_fd = -1;
+    int full_fd = -1;
+};
+
+static std::vector<Battery> batteries;
+static BatteryState state;
+static int uevent_fd = -1;
+static Timeout *refresh_timeout = nullptr;
+static void (*state_changed)(App *app) = nullptr;
+
+static bool
+read_line(int fd, char *buffer, size_t size) {
+    if (fd == -1)
+        return false;
+    ssize_t length = pread(fd, buffer, size - 1, 0);
+    if (length <= 0)
+        return false;
+    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == ' '))
+        length--;
+    buffer[length] = '\0';
+    return true;
+}
+
+static bool
+read_number(int fd, long *value) {
+    char buffer[32];
+    if (!read_line(fd, buffer, sizeof(buffer)))
+        return false;
+    char *end = nullptr;
+    *value = strtol(buffer, &end, 10);
+    return end != buffer;
+}
+
+static bool
+read_once(const std::string &path, char *buffer, size_t size) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    bool read = read_line(fd, buffer, size);
+    close(fd);
+    return read;
+}
+
+static void
+close_batteries() {
+    for (auto &battery: batteries) {
+        for (int fd: {battery.status_fd, battery.capacity_fd, battery.now_fd, battery.full_fd}) {
+            if (fd != -1)
+                close(fd);
+        }
+    }
+    batteries.clear();
+}
+
+static void
+find_batteries() {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    close_batteries();
+    DIR *directory = opendir(power_supply_directory.c_str());
+    if (!directory)
+        return;
+    while (auto entry = readdir(directory)) {
+        if (entry->d_name[0] == '.')
+            continue;
+        std::string path = power_supply_directory + entry->d_name + "/";
+        
+        char buffer[64];
+        // Mains, UPS and USB supplies aren't batteries
+        if (!read_once(path + "type", buffer, sizeof(buffer)) || strcmp(buffer, "Battery") != 0)
+            continue;
+        // Neither are the batteries of wireless mice and keyboards, as far as the taskbar is concerned
+        if (read_once(path + "scope", buffer, sizeof(buffer)) && strcmp(buffer, "Device") == 0)
+            continue;
+        
+        Battery battery;
+        battery.name = entry->d_name;
+        battery.status_fd = open((path + "status").c_str(), O_RDONLY | O_CLOEXEC);
+        battery.capacity_fd = open((path + "capacity").c_str(), O_RDONLY | O_CLOEXEC);
+        for (const char *prefix: {"energy_", "charge_"}) {
+            battery.now_fd = open((path + prefix + "now").c_str(), O_RDONLY | O_CLOEXEC);
+            battery.full_fd = open((path + prefix + "full").c_str(), O_RDONLY | O_CLOEXEC);
+            if (battery.now_fd != -1 && battery.full_fd != -1)
+                break;
+            if (battery.now_fd != -1)
+                close(battery.now_fd);
+            if (battery.full_fd != -1)
+                close(battery.full_fd);
+            battery.now_fd = -1;
+            battery.full_fd = -1;
+        }
+        batteries.push_back(battery);
+    }
+    closedir(directory);
+}
+
+// When batteries disagree the one doing the most wins, so one charging and one full is "Charging"
+static int
+status_rank(const char *status) {
+    if (strcmp(status, "Charging") == 0)
+        return 4;
+    if (strcmp(status, "Discharging") == 0)
+        return 3;
+    if (strcmp(status, "Not charging") == 0)
+        return 2;
+    if (strcmp(status, "Full") == 0)
+        return 1;
+    return 0;
+}
+
+// Returns true if the state is different than it was
+static bool
+read_state() {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    BatteryState next;
+    next.present = !batteries.empty();
+    
+    int best_rank = -1;
+    long now_total = 0;
+    long full_total = 0;
+    bool every_battery_has_amounts = true;
+    long capacity_total = 0;
+    int capacities = 0;
+    for (auto &battery: batteries) {
+        char status[32];
+        if (read_line(battery.status_fd, status, sizeof(status))) {
+            int rank = status_rank(status);
+            if (rank > best_rank) {
+                best_rank = rank;
+                next.status = status;
+            }
+        }
+        
+        long value;
+        if (read_number(battery.capacity_fd, &value)) {
+            capacity_total += value;
+            capacities++;
+        }
+        
+        long now;
+        long full;
+        if (read_number(battery.now_fd, &now) && read_number(battery.full_fd, &full) && full > 0) {
+            now_total += now;
+            full_total += full;
+        } else {
+            every_battery_has_amounts = false;
+        }
+    }
+    
+    if (batteries.size() > 1 && every_battery_has_amounts && full_total > 0) {
+        next.capacity = (int) std::round(100.0 * now_total / full_total);
+    } else if (capacities > 0) {
+        next.capacity = (int) (capacity_total / capacities);
+    }
+    next.capacity = std::max(0, std::min(100, next.capacity));
+    
+    bool changed = next.present != state.present || next.status != state.status || next.capacity != state.capacity;
+    state = next;
+    return changed;
+}
+
+static void
+update(App *app) {
+    if (read_state() && state_changed)
+        state_changed(app);
+}
+
+static void
+uevent_received(App *app, int fd) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    char buffer[8192];
+    bool power_supply_event = false;
+    bool devices_changed = false;
+    while (true) {
+        ssize_t length = recv(fd, buffer, sizeof(buffer) - 1, 0);
+        if (length <= 0)
+            break;
+        buffer[length] = '\0';
+        
+        // "action@devpath" followed by KEY=value pairs, each one ending in a nul
+        bool is_power_supply = false;
+        for (char *field = buffer + strlen(buffer) + 1; field < buffer + length; field += strlen(field) + 1) {
+            if (strcmp(field, "SUBSYSTEM=power_supply") == 0) {
+                is_power_supply = true;
+                break;
+            }
+        }
+        if (!is_power_supply)
+            continue;
+        power_supply_event = true;
+        if (strncmp(buffer, "add@", 4) == 0 || strncmp(buffer, "remove@", 7) == 0)
+            devices_changed = true;
+    }
+    
+    if (devices_changed)
+        find_batteries();
+    if (power_supply_event)
+        update(app);
+}
+
+static void
+refresh(App *app, AppClient *, Timeout *timeout, void *) {
+    if (timeout)
+        timeout->keep_running = true;
+    update(app);
+}
+
+static int
+open_uevent_socket() {
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd == -1)
+        return -1;
+    sockaddr_nl address{};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = 1; // the kernel's own messages, as opposed to udev's rebroadcasts
+    if (bind(fd, (sockaddr *) &address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void power_supply_start(App *app, void on_change(App *app)) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    power_supply_stop(app);
+    state_changed = on_change;
+    find_batteries();
+    read_state();
+    
+    uevent_fd = open_uevent_socket();
+    if (uevent_fd != -1)
+        poll_descriptor(app, uevent_fd, EPOLLIN, uevent_received);
+    refresh_timeout = app_timeout_create(app, nullptr,
+                                         uevent_fd != -1 ? refresh_with_uevents_ms : refresh_without_uevents_ms,
+                                         refresh, nullptr);
+}
+
+void power_supply_stop(App *app) {
+    app_timeout_stop(app, nullptr, refresh_timeout);
+    refresh_timeout = nullptr;
+    if (uevent_fd != -1) {
+        unpoll_descriptor(app, uevent_fd);
+        close(uevent_fd);
+    }
+    uevent_fd = -1;
+    close_batteries();
+    state_changed = nullptr;
+}
+
+const BatteryState &power_supply_state() {
+    return state;
+}
@@ -0,0 +1,27 @@
+#ifndef WINBAR_POWER_SUPPLY_H
+#define WINBAR_POWER_SUPPLY_H
+
+#include "application.h"
+
+#include <string>
+
+// Every battery in the system folded together
+struct BatteryState {
+    bool present = false;
+    
+    // Worded the way the kernel words it: "Charging", "Discharging", "Not charging", "Full" or "Unknown"
+    std::string status = "Unknown";
+    
+    // 0 to 100
+    int capacity = 0;
+};
+
+// Finds the system's batteries under /sys/class/power_supply and starts listening for the kernel's power_supply
+// uevents. on_change is called (on the main thread) whenever the combined state ends up different than it was.
+void power_supply_start(App *app, void on_change(App *app));
+
+void power_supply_stop(App *app);
+
+const BatteryState &power_supply_state();
+
+#endif //WINBAR_POWER_SUPPLY_H
@@ -12,44 +12,102 @@
 #include "utility.h"
 #include "config.h"
 
+#ifdef TRACY_ENABLE
+
+#include "../tracy/Tracy.hpp"
+
+#endif
+
 #include <mutex>
 
-void update_stacking_order() {
-    xcb_get_property_cookie_t cookie =
-            xcb_get_property(app->connection,
-                             0,
-                             app->screen->root,
-                             get_cached_atom(app, "_NET_CLIENT_LIST_STACKING"),
-                             XCB_ATOM_WINDOW,
-                             0,
-                             -1);
-    
-    xcb_get_property_reply_t *reply = xcb_get_property_reply(app->connection, cookie, NULL);
-    
+static void
+apply_stacking_order(xcb_get_property_reply_t *reply) {
+    if (!reply)
+        return;
     long windows_count = xcb_get_property_value_length(reply) / sizeof(xcb_window_t);
     auto *windows = (xcb_window_t *) xcb_get_property_value(reply);
     
     stacking_order_changed(windows, windows_count);
+}
+
+static void
+apply_active_window(xcb_get_property_reply_t *reply) {
+    if (!reply || xcb_get_property_value_length(reply) < (int) sizeof(xcb_window_t))
+        return;
+    auto *windows = (xcb_window_t *) xcb_get_property_value(reply);
+    
+    active_window_changed(windows[0]);
+}
+
+static xcb_get_property_cookie_t
+get_root_window_property(KnownAtom atom) {
+    return xcb_get_property(app->connection, 0, app->screen->root, get_cached_atom(app, atom), XCB_ATOM_WINDOW, 0, -1);
+}
+
+void update_stacking_order() {
+    xcb_get_property_cookie_t cookie = get_root_window_property(KnownAtom::NET_CLIENT_LIST_STACKING);
+    xcb_get_property_reply_t *reply = xcb_get_property_reply(app->connection, cookie, NULL);
+    apply_stacking_order(reply);
     free(reply);
 }
 
 void update_active_window() {
-    xcb_get_property_cookie_t cookie = xcb_get_property(app->connection,
-                                                        0,
-                                                        app->screen->root,
-                                                        get_cached_atom(app, "_NET_ACTIVE_WINDOW"),
-                                                        XCB_ATOM_WINDOW,
-                                                        0,
-                                                        -1);
-    
+    xcb_get_property_cookie_t cookie = get_root_window_property(KnownAtom::NET_ACTIVE_WINDOW);
     xcb_get_property_reply_t *reply = xcb_get_property_reply(app->connection, cookie, NULL);
+    apply_active_window(reply);
+    free(reply);
+}
     
-    long windows_count = xcb_get_property_value_length(reply) / sizeof(xcb_window_t);
-    auto *windows = (xcb_window_t *) xcb_get_property_value(reply);
+// A root property that changed and hasn't been fetched since. However many notifies for it come in together,
+// it's fetched once, after the whole batch of events has been handled, and without blocking on the reply.
+struct RootProperty {
+    KnownAtom atom;
     
-    active_window_changed(windows[0]);
+    void (*apply)(xcb_get_property_reply_t *reply);
     
-    free(reply);
+    bool stale = false;
+    
+    bool in_flight = false;
+};
+
+static RootProperty active_window_property = {KnownAtom::NET_ACTIVE_WINDOW, apply_active_window};
+static RootProperty stacking_order_property = {KnownAtom::NET_CLIENT_LIST_STACKING, apply_stacking_order};
+static Timeout *fetch_timeout = nullptr;
+
+static void
+fetch_stale_root_properties(App *app, AppClient *, Timeout *, void *);
+
+static void
+fetch_later(App *app) {
+    if (!fetch_timeout)
+        fetch_timeout = app_timeout_create(app, nullptr, 0, fetch_stale_root_properties, nullptr);
+}
+
+static void
+root_property_fetched(App *app, void *reply, void *user_data) {
+    auto *property = (RootProperty *) user_data;
+    property->in_flight = false;
+    // It changed again while we were waiting, so what came back is already old
+    if (property->stale) {
+        fetch_later(app);
+        return;
+    }
+    property->apply((xcb_get_property_reply_t *) reply);
+}
+
+static void
+fetch_stale_root_properties(App *app, AppClient *, Timeout *, void *) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    fetch_timeout = nullptr;
+    for (auto property: {&active_window_property, &stacking_order_property}) {
+        if (!property->stale || property->in_flight)
+            continue;
+        property->stale = false;
+        property->in_flight = true;
+        app_when_reply(app, get_root_window_property(property->atom).sequence, root_property_fetched, property);
+    }
 }
 
 static bool
@@ -57,18 +115,13 @@ root_event_handler(App *app, xcb_generic_event_t *event) {
     switch (XCB_EVENT_RESPONSE_TYPE(event)) {
         case XCB_PROPERTY_NOTIFY: {
             auto *e = (xcb_property_notify_event_t *) event;
-//            const xcb_get_atom_name_cookie_t &cookie = xcb_get_atom_name(app->connection, e->atom);
-//            xcb_get_atom_name_reply_t *reply = xcb_get_atom_name_reply(app->connection, cookie, NULL);
-//            char *name = xcb_get_atom_name_name(reply);
-//            printf("ATOM: %s\n", name);
-            
-            if (e->atom == get_cached_atom(app, "_NET_CLIENT_LIST_STACKING")) {
-                update_stacking_order();
-            }
-            if (e->atom == get_cached_atom(app, "_NET_WM_DESKTOP")) {
-//                printf("here\n");
+            if (e->atom == get_cached_atom(app, KnownAtom::NET_ACTIVE_WINDOW)) {
+                active_window_property.stale = true;
+                fetch_later(app);
+            } else if (e->atom == get_cached_atom(app, KnownAtom::NET_CLIENT_LIST_STACKING)) {
+                stacking_order_property.stale = true;
+                fetch_later(app);
             }
-            update_active_window();
             break;
         }
         case XCB_BUTTON_PRESS: {
@@ -17,10 +17,13 @@
 #include "main.h"
 #include "taskbar.h"
 #include "globals.h"
+#include "frecency.h"
 
 #include <algorithm>
 #include <fstream>
+#include <memory>
 #include <pango/pangocairo.h>
+#include <unordered_set>
 
 class Script : public Sortable {
 public:
@@ -48,7 +51,29 @@ public:
     std::string text;
 };
 
-std::vector<Script *> scripts;
+// An immutable view of every script found in $PATH. load_scripts builds a new one and swaps it in,
+// so readers never see a half-built list, and anything holding a snapshot keeps its Scripts alive.
+class ScriptSnapshot {
+public:
+    std::vector<Script *> scripts;
+    std::unordered_set<std::string> names;
+    
+    ~ScriptSnapshot() {
+        for (auto s: scripts)
+            delete s;
+    }
+};
+
+static std::shared_ptr<const ScriptSnapshot> scripts_snapshot = std::make_shared<ScriptSnapshot>();
+
+// The snapshot the open search menu's items point into
+static std::shared_ptr<const ScriptSnapshot> scripts_in_use;
+
+static const std::vector<Script *> *
+current_scripts() {
+    scripts_in_use = std::atomic_load(&scripts_snapshot);
+    return &scripts_in_use->scripts;
+}
 
 std::string active_tab = "Apps";
 static int active_item = 0;
@@ -98,7 +123,8 @@ static inline int
 determine_priority(Sortable *item,
                    const std::string &text,
                    const std::string &lowercase_text,
-                   const std::vector<HistoricalNameUsed *> &history) {
+                   const HistoryIndex &history,
+                   int64_t now) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
@@ -150,14 +176,10 @@ determine_priority(Sortable *item,
     // Find it in history and attach a ranking
     if (prio != -1) {    // if it wasn't a perfect match
         if (prio != 11) {// but it was a match
-            for (int i = 0; i < history.size(); i++) {
-                HistoricalNameUsed *h = (history)[i];
-                auto lowercase_historic_find = h->text.find(item->lowercase_name);
-                if (lowercase_historic_find != std::string::npos) {
-                    item->historical_ranking = i;
-                    prio = 0;
-                    return prio;
-                }
+            float score = history.score(item->lowercase_name, now);
+            if (score > 0) {
+                item->historical_score = score;
+                return 0;
             }
         }
     }
@@ -294,22 +316,15 @@ paint_right_item(AppClient *client, cairo_t *cr, Container *container) {
     }
 }
 
-static void
-paint_item(AppClient *client, cairo_t *cr, Container *container) {
-#ifdef TRACY_ENABLE
-    ZoneScoped;
-#endif
-    paint_item_background(client, cr, container, 1);
-    auto *data = (SearchItemData *) container->parent->user_data;
-    PangoLayout *layout =
-            get_cached_pango_font(cr, config->font, 11, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
+// The item's name with whatever part of it matched what was typed in bold
+static const CachedTextLayout *
+highlighted_name_layout(AppClient *client, cairo_t *cr, SearchItemData *data) {
     int location = -1;
     int length = -1;
     if (auto *taskbar = client_by_name(client->app, "taskbar")) {
         if (auto *textarea = container_by_name("main_text_area", taskbar->root)) {
             auto *textarea_data = (TextAreaData *) textarea->user_data;
-            std::string text(textarea_data->state->text);
+            std::string text(textarea_data->state->text.str());
             std::string lowercase_text(text);
             std::transform(
                     lowercase_text.begin(), lowercase_text.end(), lowercase_text.begin(), ::tolower);
@@ -318,34 +333,38 @@ paint_item(AppClient *client, cairo_t *cr, Container *container) {
         }
     }
     
-    if (location != -1) {
-        pango_layout_set_attributes(layout, nullptr);
-        std::string text(data->sortable->name);
-        text.insert(location + length, "</b>");
-        text.insert(location, "<b>");
+    const std::string &name = data->sortable->name;
+    if (location == -1 || (size_t) location > name.size())
+        return get_cached_text_layout(cr, name, config->font, 11, PangoWeight::PANGO_WEIGHT_NORMAL);
         
-        PangoAttrList *attrs = nullptr;
-        pango_parse_markup(text.data(), text.length(), 0, &attrs, NULL, NULL, NULL);
+    // Escaped so names with a '&' or '<' in them still parse once the tags are in
+    auto escaped = [](const std::string &part) {
+        char *escaped_part = g_markup_escape_text(part.data(), part.size());
+        std::string result(escaped_part);
+        g_free(escaped_part);
+        return result;
+    };
+    std::string text = escaped(name.substr(0, location)) + "<b>" + escaped(name.substr(location, length)) + "</b>" +
+                       escaped(name.substr(std::min(name.size(), (size_t) (location + length))));
+    return get_cached_text_layout(cr, text, config->font, 11, PangoWeight::PANGO_WEIGHT_NORMAL, -1, PANGO_WRAP_WORD,
+                                  PANGO_ELLIPSIZE_NONE, true);
+}
         
-        if (layout && attrs) {
-            pango_layout_set_attributes(layout, attrs);
-        }
-    }
+static void
+paint_item(AppClient *client, cairo_t *cr, Container *container) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    paint_item_background(client, cr, container, 1);
+    auto *data = (SearchItemData *) container->parent->user_data;
+    auto text_layout = highlighted_name_layout(client, cr, data);
     
     set_argb(cr, config->color_search_content_text_primary);
-    pango_layout_set_text(layout, data->sortable->name.c_str(), data->sortable->name.size());
-    
-    PangoRectangle ink;
-    PangoRectangle logical;
-    pango_layout_get_extents(layout, &ink, &logical);
-    
     cairo_move_to(cr,
                   (int) (container->real_bounds.x + 40),
                   (int) (container->real_bounds.y + (container->real_bounds.h / 2) -
-                         ((logical.height / PANGO_SCALE) / 2)));
-    pango_cairo_show_layout(cr, layout);
-    
-    pango_layout_set_attributes(layout, nullptr);
+                         ((text_layout->logical.height / PANGO_SCALE) / 2)));
+    pango_cairo_show_layout(cr, text_layout->layout);
     
     if (active_tab == "Scripts") {
         if (script_16) {
@@ -380,48 +399,15 @@ paint_top_item(AppClient *client, cairo_t *cr, Container *container) {
     paint_item_background(client, cr, container, 1);
     
     auto *data = (SearchItemData *) container->parent->user_data;
-    PangoLayout *layout =
-            get_cached_pango_font(cr, config->font, 11, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    int location = -1;
-    int length = -1;
-    if (auto *taskbar = client_by_name(client->app, "taskbar")) {
-        if (auto *textarea = container_by_name("main_text_area", taskbar->root)) {
-            auto *textarea_data = (TextAreaData *) textarea->user_data;
-            std::string text(textarea_data->state->text);
-            std::string lowercase_text(text);
-            std::transform(
-                    lowercase_text.begin(), lowercase_text.end(), lowercase_text.begin(), ::tolower);
-            length = text.length();
-            determine_priority_location(*data->sortable, text, lowercase_text, &location);
-        }
-    }
-    
-    if (location != -1) {
-        pango_layout_set_attributes(layout, nullptr);
-        std::string text(data->sortable->name);
-        text.insert(location + length, "</b>");
-        text.insert(location, "<b>");
-        
-        PangoAttrList *attrs = nullptr;
-        pango_parse_markup(text.data(), text.length(), 0, &attrs, NULL, NULL, NULL);
-        
-        if (layout && attrs) {
-            pango_layout_set_attributes(layout, attrs);
-        }
-    }
-    
-    int width;
-    int height;
-    pango_layout_set_text(layout, data->sortable->name.c_str(), data->sortable->name.size());
-    pango_layout_get_pixel_size(layout, &width, &height);
+    auto text_layout = highlighted_name_layout(client, cr, data);
     
     set_argb(cr, config->color_search_content_text_primary);
     cairo_move_to(cr, (int) (container->real_bounds.x + 56), (int) (container->real_bounds.y + 10));
-    pango_cairo_show_layout(cr, layout);
-    pango_layout_set_attributes(layout, nullptr);
+    pango_cairo_show_layout(cr, text_layout->layout);
     
-    layout = get_cached_pango_font(cr, config->font, 9, PangoWeight::PANGO_WEIGHT_NORMAL);
+    int width;
+    int height;
+    PangoLayout *layout = get_cached_pango_font(cr, config->font, 9, PangoWeight::PANGO_WEIGHT_NORMAL);
     
     pango_layout_set_text(layout, active_tab.c_str(), active_tab.size());
     pango_layout_get_pixel_size(layout, &width, &height);
@@ -466,48 +452,15 @@ paint_no_result_item(AppClient *client, cairo_t *cr, Container *container) {
     paint_item_background(client, cr, container, 1);
     
     auto *data = (SearchItemData *) container->parent->user_data;
-    PangoLayout *layout =
-            get_cached_pango_font(cr, config->font, 11, PangoWeight::PANGO_WEIGHT_NORMAL);
-    
-    int location = -1;
-    int length = -1;
-    if (auto *taskbar = client_by_name(client->app, "taskbar")) {
-        if (auto *textarea = container_by_name("main_text_area", taskbar->root)) {
-            auto *textarea_data = (TextAreaData *) textarea->user_data;
-            std::string text(textarea_data->state->text);
-            std::string lowercase_text(text);
-            std::transform(
-                    lowercase_text.begin(), lowercase_text.end(), lowercase_text.begin(), ::tolower);
-            length = text.length();
-            determine_priority_location(*data->sortable, text, lowercase_text, &location);
-        }
-    }
-    
-    if (location != -1) {
-        pango_layout_set_attributes(layout, nullptr);
-        std::string text(data->sortable->name);
-        text.insert(location + length, "</b>");
-        text.insert(location, "<b>");
-        
-        PangoAttrList *attrs = nullptr;
-        pango_parse_markup(text.data(), text.length(), 0, &attrs, NULL, NULL, NULL);
-        
-        if (layout && attrs) {
-            pango_layout_set_attributes(layout, attrs);
-        }
-    }
-    
-    int width;
-    int height;
-    pango_layout_set_text(layout, data->sortable->name.c_str(), data->sortable->name.size());
-    pango_layout_get_pixel_size(layout, &width, &height);
+    auto text_layout = highlighted_name_layout(client, cr, data);
     
     set_argb(cr, config->color_search_content_text_primary);
     cairo_move_to(cr, (int) (container->real_bounds.x + 56), (int) (container->real_bounds.y + 10));
-    pango_cairo_show_layout(cr, layout);
-    pango_layout_set_attributes(layout, nullptr);
+    pango_cairo_show_layout(cr, text_layout->layout);
     
-    layout = get_cached_pango_font(cr, config->font, 9, PangoWeight::PANGO_WEIGHT_NORMAL);
+    int width;
+    int height;
+    PangoLayout *layout = get_cached_pango_font(cr, config->font, 9, PangoWeight::PANGO_WEIGHT_NORMAL);
     
     std::string subtitle_text = "Run command anyways";
     pango_layout_set_text(layout, subtitle_text.c_str(), subtitle_text.size());
@@ -734,21 +687,7 @@ launch_item(AppClient *client, Container *item) {
     if (active_tab == "Scripts" || data->delete_user_data_as_script) {
         Script *script = (Script *) data->user_data;
         
-        for (int i = 0; i < global->history_scripts.size(); i++) {
-            auto *historic_script = global->history_scripts[i];
-            if (historic_script->text == script->lowercase_name) {
-                delete historic_script;
-                global->history_scripts.erase(global->history_scripts.begin() + i);
-                break;
-            }
-        }
-        auto *historic_script = new HistoricalNameUsed;
-        historic_script->text = script->lowercase_name;
-        global->history_scripts.insert(global->history_scripts.begin(), historic_script);
-        if (global->history_scripts.size() > 100) {
-            delete global->history_scripts[global->history_scripts.size() - 1];
-            global->history_scripts.erase(global->history_scripts.end() - 1);
-        }
+        frecency_record(FRECENCY_SCRIPT, script->lowercase_name);
         
         if (script->path_is_full_command) {
             launch_command(script->path);
@@ -758,21 +697,7 @@ launch_item(AppClient *client, Container *item) {
     } else if (active_tab == "Apps") {
         Launcher *launcher = (Launcher *) data->user_data;
         
-        for (int i = 0; i < global->history_apps.size(); i++) {
-            auto *historic_app = global->history_apps[i];
-            if (historic_app->text == launcher->lowercase_name) {
-                delete historic_app;
-                global->history_apps.erase(global->history_apps.begin() + i);
-                break;
-            }
-        }
-        auto *historic_app = new HistoricalNameUsed;
-        historic_app->text = launcher->lowercase_name;
-        global->history_apps.insert(global->history_apps.begin(), historic_app);
-        if (global->history_apps.size() > 100) {
-            delete global->history_apps[global->history_apps.size() - 1];
-            global->history_apps.erase(global->history_apps.end() - 1);
-        }
+        frecency_record(FRECENCY_APP, launcher->lowercase_name);
         
         launch_command(launcher->exec);
     }
@@ -998,10 +923,10 @@ clicked_right_item(AppClient *client, cairo_t *cr, Container *container) {
 }
 
 template<class T>
-void sort_and_add(std::vector<T> *sortables,
+void sort_and_add(const std::vector<T> *sortables,
                   Container *bottom,
                   std::string text,
-                  const std::vector<HistoricalNameUsed *> &history);
+                  const HistoryIndex &history);
 
 static void
 clicked_tab_timeout(App *app, AppClient *client, Timeout *, void *user_data) {
@@ -1020,14 +945,14 @@ clicked_tab_timeout(App *app, AppClient *client, Timeout *, void *user_data) {
             bottom->children.shrink_to_fit();
             if (!data->state->text.empty()) {
                 if (active_tab == "Scripts") {
-                    sort_and_add<Script *>(&scripts, bottom, data->state->text, global->history_scripts);
+                    sort_and_add<Script *>(current_scripts(), bottom, data->state->text.str(), global->history_scripts);
                 } else if (active_tab == "Apps") {
                     // We create a copy because app_menu relies on the order
                     std::vector<Launcher *> launchers_copy;
                     for (auto *l: launchers) {
                         launchers_copy.push_back(l);
                     }
-                    sort_and_add<Launcher *>(&launchers_copy, bottom, data->state->text, global->history_apps);
+                    sort_and_add<Launcher *>(&launchers_copy, bottom, data->state->text.str(), global->history_apps);
                 }
             }
             client_layout(app, client);
@@ -1073,16 +998,16 @@ compare_priority(Sortable *first, Sortable *second) {
         return first->priority < second->priority;
     }
     if (first->priority == 0) {
-        return first->historical_ranking < second->historical_ranking;
+        return first->historical_score > second->historical_score;
     }
     return first->name.length() < second->name.length();
 }
 
 template<class T>
-void sort_and_add(std::vector<T> *sortables,
+void sort_and_add(const std::vector<T> *sortables,
                   Container *bottom,
                   std::string text,
-                  const std::vector<HistoricalNameUsed *> &history) {
+                  const HistoryIndex &history) {
     std::vector<T> sorted;
     
     {
@@ -1092,9 +1017,10 @@ void sort_and_add(std::vector<T> *sortables,
         std::string lowercase_text(text);
         std::transform(
                 lowercase_text.begin(), lowercase_text.end(), lowercase_text.begin(), ::tolower);
+        int64_t now = time(nullptr);
         
         for (auto *s: *sortables) {
-            s->priority = determine_priority(s, text, lowercase_text, history);
+            s->priority = determine_priority(s, text, lowercase_text, history, now);
             if (s->priority != 11) {
                 sorted.push_back(s);
             }
@@ -1159,7 +1085,7 @@ void sort_and_add(std::vector<T> *sortables,
             sortable_data->name = text;
             sortable_data->lowercase_name = text;
             sortable_data->priority = -1;
-            sortable_data->historical_ranking = -1;
+            sortable_data->historical_score = 0;
             sortable_data->path_is_full_command = true;
             sortable_data->path = text;
             
@@ -1302,14 +1228,14 @@ when_key_event(AppClient *client,
                     bottom->children.shrink_to_fit();
                     if (!data->state->text.empty()) {
                         if (active_tab == "Scripts") {
-                            sort_and_add<Script *>(&scripts, bottom, data->state->text, global->history_scripts);
+                            sort_and_add<Script *>(current_scripts(), bottom, data->state->text.str(), global->history_scripts);
                         } else if (active_tab == "Apps") {
                             // We create a copy because app_menu relies on the order
                             std::vector<Launcher *> launchers_copy;
                             for (auto *l: launchers) {
                                 launchers_copy.push_back(l);
                             }
-                            sort_and_add<Launcher *>(&launchers_copy, bottom, data->state->text, global->history_apps);
+                            sort_and_add<Launcher *>(&launchers_copy, bottom, data->state->text.str(), global->history_apps);
                         }
                     }
                     client_layout(app, client);
@@ -1344,14 +1270,14 @@ when_key_event(AppClient *client,
             bottom->children.shrink_to_fit();
             if (!data->state->text.empty()) {
                 if (active_tab == "Scripts") {
-                    sort_and_add<Script *>(&scripts, bottom, data->state->text, global->history_scripts);
+                    sort_and_add<Script *>(current_scripts(), bottom, data->state->text.str(), global->history_scripts);
                 } else if (active_tab == "Apps") {
                     // We create a copy because app_menu relies on the order
                     std::vector<Launcher *> launchers_copy;
                     for (auto *l: launchers) {
                         launchers_copy.push_back(l);
                     }
-                    sort_and_add<Launcher *>(&launchers_copy, bottom, data->state->text, global->history_apps);
+                    sort_and_add<Launcher *>(&launchers_copy, bottom, data->state->text.str(), global->history_apps);
                 }
             }
             client_layout(app, search_menu_client);
@@ -1396,129 +1322,6 @@ fill_root(AppClient *client) {
     paint_surface_with_image(open_surface, as_resource_path("open.png"), 16, nullptr);
 }
 
-void load_historic_scripts() {
-    const char *home = getenv("HOME");
-    std::string scriptsPath(home);
-    scriptsPath += "/.config/winbar/historic/scripts.txt";
-    
-    std::ifstream status_file(scriptsPath);
-    if (status_file.is_open()) {
-        std::string line;
-        while (getline(status_file, line)) {
-            auto *h = new HistoricalNameUsed;
-            h->text = line;
-            global->history_scripts.push_back(h);
-            if (global->history_scripts.size() > 100) {
-                break;
-            }
-        }
-    }
-    status_file.close();
-}
-
-void load_historic_apps() {
-    const char *home = getenv("HOME");
-    std::string scriptsPath(home);
-    scriptsPath += "/.config/winbar/historic/apps.txt";
-    
-    std::ifstream status_file(scriptsPath);
-    if (status_file.is_open()) {
-        std::string line;
-        while (getline(status_file, line)) {
-            auto *h = new HistoricalNameUsed;
-            h->text = line;
-            global->history_apps.push_back(h);
-            if (global->history_apps.size() > 100) {
-                break;
-            }
-        }
-    }
-    status_file.close();
-}
-
-#include <cerrno>
-#include <sys/stat.h> /* mkdir(2) */
-
-static void
-write_historic_scripts() {
-    const char *home = getenv("HOME");
-    std::string scriptsPath(home);
-    scriptsPath += "/.config/";
-    
-    if (mkdir(scriptsPath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
-        if (errno != EEXIST) {
-            printf("Couldn't mkdir %s\n", scriptsPath.c_str());
-            return;
-        }
-    }
-    
-    scriptsPath += "/winbar/";
-    
-    if (mkdir(scriptsPath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
-        if (errno != EEXIST) {
-            printf("Couldn't mkdir %s\n", scriptsPath.c_str());
-            return;
-        }
-    }
-    scriptsPath += "/historic/";
-    
-    if (mkdir(scriptsPath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
-        if (errno != EEXIST) {
-            printf("Couldn't mkdir %s\n", scriptsPath.c_str());
-            return;
-        }
-    }
-    
-    scriptsPath += "scripts.txt";
-    
-    std::ofstream myfile;
-    myfile.open(scriptsPath);
-    for (HistoricalNameUsed *h: global->history_scripts) {
-        myfile << h->text + "\n";
-    }
-    myfile.close();
-}
-
-static void
-write_historic_apps() {
-    const char *home = getenv("HOME");
-    std::string scriptsPath(home);
-    scriptsPath += "/.config/";
-    
-    if (mkdir(scriptsPath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
-        if (errno != EEXIST) {
-            printf("Couldn't mkdir %s\n", scriptsPath.c_str());
-            return;
-        }
-    }
-    
-    scriptsPath += "/winbar/";
-    
-    if (mkdir(scriptsPath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
-        if (errno != EEXIST) {
-            printf("Couldn't mkdir %s\n", scriptsPath.c_str());
-            return;
-        }
-    }
-    scriptsPath += "/historic/";
-    
-    if (mkdir(scriptsPath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
-        if (errno != EEXIST) {
-            printf("Couldn't mkdir %s\n", scriptsPath.c_str());
-            return;
-        }
-    }
-    
-    scriptsPath += "apps.txt";
-    
-    std::ofstream myfile;
-    myfile.open(scriptsPath);
-    for (HistoricalNameUsed *h: global->history_apps) {
-        myfile << h->text + "\n";
-    }
-    myfile.close();
-}
-
 static void
 search_menu_when_closed(AppClient *client) {
     cairo_surface_destroy(script_16);
@@ -1526,13 +1329,13 @@ search_menu_when_closed(AppClient *client) {
     cairo_surface_destroy(script_64);
     cairo_surface_destroy(arrow_right_surface);
     cairo_surface_destroy(open_surface);
-    write_historic_scripts();
-    write_historic_apps();
-    std::thread(load_scripts).detach();
+    frecency_flush();
+    scripts_in_use.reset();
     set_textarea_inactive();
 }
 
-void start_search_menu() {
+static Settings
+search_menu_settings() {
     Settings settings;
     settings.decorations = false;
     settings.skip_taskbar = true;
@@ -1548,6 +1351,11 @@ void start_search_menu() {
         settings.y = taskbar->bounds->y - settings.h;
     }
     settings.override_redirect = true;
+    return settings;
+}
+
+void start_search_menu() {
+    Settings settings = search_menu_settings();
     
     if (auto taskbar = client_by_name(app, "taskbar")) {
         PopupSettings popup_settings;
@@ -1561,99 +1369,417 @@ void start_search_menu() {
         set_textarea_active();
         xcb_set_input_focus(app->connection, XCB_NONE, client->window, XCB_CURRENT_TIME);
         xcb_flush(app->connection);
-        xcb_aux_sync(app->connection);
     }
 }
 
+void prewarm_search_menu() {
+    client_prewarm(app, search_menu_settings(), "search_menu");
+}
+
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 #include <sstream>
+#include <unordered_map>
+
+// Every directory in $PATH with the names it contained the last time we looked.
+// The list is built once (from the cache file when a directory's mtime hasn't changed),
+// and afterwards kept current by inotify instead of rescanning.
+struct PathDirectory {
+    std::string path;
+    int64_t mtime_sec = -1;
+    int64_t mtime_nsec = -1;
+    int watch_descriptor = -1;
+    // While the directory doesn't exist, its closest existing parent is watched for awaited_name (the next directory
+    // down) to be made, and then the watch moves down
+    int parent_watch_descriptor = -1;
+    std::string awaited_name;
+    std::vector<std::string> names;
+};
+
+static std::vector<PathDirectory> path_directories;
+static int scripts_inotify_fd = -1;
+static Timeout *scripts_changed_timeout = nullptr;
 
-static std::mutex script_loaded;
+static const char *scripts_cache_header = "winbar_scripts_cache 1";
 
-void load_scripts() {
-    std::lock_guard m(script_loaded);
-    for (auto s: scripts) {
-        delete s;
+static std::string
+scripts_cache_path() {
+    const char *home = getenv("HOME");
+    std::string path(home);
+    path += "/.cache/winbar_scripts_cache/scripts.cache";
+    return path;
+}
+
+static bool
+should_list(int dir_fd, const char *name, unsigned char type) {
+    if (name[0] == '.')
+        return false;
+    // d_type tells us what the entry is without a syscall on most filesystems,
+    // we only have to stat the entry itself when it's a link or the filesystem doesn't say
+    if (type == DT_DIR)
+        return false;
+    if (type == DT_LNK || type == DT_UNKNOWN) {
+        struct stat st{};
+        if (fstatat(dir_fd, name, &st, 0) != 0 || S_ISDIR(st.st_mode))
+            return false;
+    }
+    return true;
+}
+
+static void
+scan_directory(PathDirectory *directory) {
+    directory->names.clear();
+    if (auto *dir = opendir(directory->path.c_str())) {
+        int dir_fd = dirfd(dir);
+        struct dirent *dp;
+        while ((dp = readdir(dir)) != NULL) {
+            if (should_list(dir_fd, dp->d_name, dp->d_type))
+                directory->names.emplace_back(dp->d_name);
+        }
+        closedir(dir);
+    }
+}
+
+// Cache layout: header, then for every directory: path, mtime seconds, mtime nanoseconds,
+// name count, and that many names. Every field is terminated by a '\0'.
+static std::unordered_map<std::string, PathDirectory>
+read_scripts_cache() {
+    std::unordered_map<std::string, PathDirectory> cached;
+    std::ifstream file(scripts_cache_path(), std::ios::binary);
+    if (!file.is_open())
+        return cached;
+    std::string field;
+    if (!std::getline(file, field, '\0') || field != scripts_cache_header)
+        return cached;
+    while (std::getline(file, field, '\0')) {
+        PathDirectory directory;
+        directory.path = field;
+        std::string sec, nsec, count;
+        if (!std::getline(file, sec, '\0') || !std::getline(file, nsec, '\0') || !std::getline(file, count, '\0'))
+            break;
+        try {
+            directory.mtime_sec = std::stoll(sec);
+            directory.mtime_nsec = std::stoll(nsec);
+            long name_count = std::stol(count);
+            for (long i = 0; i < name_count && std::getline(file, field, '\0'); i++)
+                directory.names.push_back(field);
+            if ((long) directory.names.size() != name_count)
+                break;
+        } catch (...) {
+            break;
+        }
+        cached[directory.path] = std::move(directory);
+    }
+    return cached;
+}
+
+static void
+write_scripts_cache() {
+    std::string path = scripts_cache_path();
+    std::string directory = path.substr(0, path.find_last_of('/'));
+    std::string cache_directory = directory.substr(0, directory.find_last_of('/'));
+    for (const auto &dir: {cache_directory, directory}) {
+        if (mkdir(dir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
+            if (errno != EEXIST) {
+                printf("Couldn't mkdir %s\n", dir.c_str());
+                return;
+            }
+        }
     }
-    scripts.clear();
-    scripts.shrink_to_fit();
-    // go through every directory in $PATH environment variable
-    // add to our scripts list if the files we check are executable
-    std::string paths = std::string(getenv("PATH"));
     
-    std::replace(paths.begin(), paths.end(), ':', ' ');
+    std::string temp_path = path + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return;
+    file << scripts_cache_header << '\0';
+    for (const auto &d: path_directories) {
+        file << d.path << '\0' << d.mtime_sec << '\0' << d.mtime_nsec << '\0' << d.names.size() << '\0';
+        for (const auto &name: d.names)
+            file << name << '\0';
+    }
+    file.close();
+    rename(temp_path.c_str(), path.c_str());
+}
+
+static void
+update_mtime(PathDirectory *directory) {
+    struct stat st{};
+    if (stat(directory->path.c_str(), &st) == 0) {
+        directory->mtime_sec = st.st_mtim.tv_sec;
+        directory->mtime_nsec = st.st_mtim.tv_nsec;
+    } else {
+        directory->mtime_sec = -1;
+        directory->mtime_nsec = -1;
+    }
+}
+
+// Builds a new snapshot from the directory lists (no filesystem access) and swaps it in
+static void
+publish_scripts() {
+    auto snapshot = std::make_shared<ScriptSnapshot>();
+    for (const auto &directory: path_directories) {
+        std::string path = directory.path;
+        if (!path.empty() && (path[path.length() - 1] == '/' || path[path.length() - 1] == '\\'))
+            path.erase(path.begin() + (path.length() - 1));
+        for (const auto &name: directory.names) {
+            // Earlier entries in $PATH win, same as the shell
+            if (!snapshot->names.insert(name).second)
+                continue;
+            
+            auto *script = new Script();
+            script->name = name;
+            script->lowercase_name = script->name;
+            std::transform(script->lowercase_name.begin(),
+                           script->lowercase_name.end(),
+                           script->lowercase_name.begin(),
+                           ::tolower);
+            script->path = path;
+            snapshot->scripts.push_back(script);
+        }
+    }
     
-    std::stringstream ss(paths);
-    std::string string_path;
-    while (ss >> string_path) {
-        if (auto *dir = opendir(string_path.c_str())) {
-            struct dirent *dp;
-            while ((dp = readdir(dir)) != NULL) {
-                struct stat st, ln;
-                
-                // This is what determines if its an executable and its from dmenu and its not good. oh
-                // well
-                static int flag[26];
-#define FLAG(x) (flag[(x) - 'a'])
+    std::atomic_store(&scripts_snapshot, std::shared_ptr<const ScriptSnapshot>(std::move(snapshot)));
+}
+
+static void
+scripts_changed(App *, AppClient *, Timeout *, void *) {
+    scripts_changed_timeout = nullptr;
+    publish_scripts();
+    write_scripts_cache();
+}
+
+static int
+watch_path_directory(const std::string &path) {
+    return inotify_add_watch(scripts_inotify_fd, path.c_str(),
+                             IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                             IN_ONLYDIR);
+}
+
+// IN_MASK_ADD because the parent can be a directory in $PATH too, whose watch shares the descriptor
+static int
+watch_parent_directory(const std::string &path) {
+    return inotify_add_watch(scripts_inotify_fd, path.c_str(),
+                             IN_CREATE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_MASK_ADD);
+}
+
+static bool
+watch_descriptor_in_use(int watch_descriptor) {
+    for (const auto &directory: path_directories)
+        if (directory.watch_descriptor == watch_descriptor || directory.parent_watch_descriptor == watch_descriptor)
+            return true;
+    return false;
+}
+
+static void
+release_parent_watch(PathDirectory *directory) {
+    int watch_descriptor = directory->parent_watch_descriptor;
+    directory->parent_watch_descriptor = -1;
+    directory->awaited_name.clear();
+    if (watch_descriptor != -1 && !watch_descriptor_in_use(watch_descriptor))
+        inotify_rm_watch(scripts_inotify_fd, watch_descriptor);
+}
+
+static void
+watch_closest_parent(PathDirectory *directory) {
+    std::string path = directory->path;
+    while (path.length() > 1 && path[path.length() - 1] == '/')
+        path.erase(path.length() - 1);
+    
+    int watch_descriptor = -1;
+    std::string awaited_name;
+    // Relative entries (like ".") have no parent worth watching
+    while (watch_descriptor == -1 && path != "/") {
+        auto slash = path.rfind('/');
+        if (slash == std::string::npos)
+            break;
+        awaited_name = path.substr(slash + 1);
+        path = slash == 0 ? "/" : path.substr(0, slash);
+        if (!awaited_name.empty())
+            watch_descriptor = watch_parent_directory(path);
+    }
+    
+    if (watch_descriptor != directory->parent_watch_descriptor)
+        release_parent_watch(directory);
+    directory->parent_watch_descriptor = watch_descriptor;
+    directory->awaited_name = watch_descriptor == -1 ? "" : awaited_name;
+}
+
+// Watches and rescans every directory that exists now, and moves the parent watch of every one that doesn't as
+// close to it as it can go. Returns if any directory came back.
+static bool
+watch_unwatched_directories() {
+    bool changed = false;
+    for (auto &directory: path_directories) {
+        if (directory.watch_descriptor != -1)
+            continue;
+        directory.watch_descriptor = watch_path_directory(directory.path);
+        if (directory.watch_descriptor == -1) {
+            watch_closest_parent(&directory);
+            continue;
+        }
+        release_parent_watch(&directory);
+        scan_directory(&directory);
+        update_mtime(&directory);
+        changed = true;
+    }
+    return changed;
+}
+
+static void
+scripts_inotify_wakeup(App *app, int fd) {
+    char buf[4096]
+            __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    bool changed = false;
+    bool rewatch = false;
+    
+    for (;;) {
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0)
+            break;
+        
+        for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *) ptr;
+            
+            if (event->mask & IN_Q_OVERFLOW) {
+                // We lost events, so we can't trust anything we have
+                for (auto &directory: path_directories) {
+                    scan_directory(&directory);
+                    update_mtime(&directory);
+                }
+                changed = true;
+                rewatch = true;
+                continue;
+            }
+            
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                // The descriptor can be shared by a directory in $PATH and parent watches
+                if (event->mask & IN_MOVE_SELF)
+                    inotify_rm_watch(fd, event->wd);
+                for (auto &directory: path_directories) {
+                    if (directory.watch_descriptor == event->wd) {
+                        directory.names.clear();
+                        directory.watch_descriptor = -1;
+                        update_mtime(&directory);
+                        changed = true;
+                        rewatch = true;
+                    }
+                    if (directory.parent_watch_descriptor == event->wd) {
+                        directory.parent_watch_descriptor = -1;
+                        directory.awaited_name.clear();
+                        rewatch = true;
+                    }
+                }
+                continue;
+            }
+            
+            for (auto &directory: path_directories) {
+                if (directory.parent_watch_descriptor == event->wd) {
+                    if (event->len && (event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+                        directory.awaited_name == event->name) {
+                        rewatch = true;
+                    }
+                    continue;
+                }
+                if (directory.watch_descriptor != event->wd)
+                    continue;
                 
-                const char *path = string_path.c_str();
-                if ((!stat(path, &st) && (FLAG('a') || dp->d_name[0] != '.')       /* hidden files      */
-                     && (!FLAG('b') || S_ISBLK(st.st_mode))                        /* block special     */
-                     && (!FLAG('c') || S_ISCHR(st.st_mode))                        /* character special */
-                     && (!FLAG('d') || S_ISDIR(st.st_mode))                        /* directory         */
-                     && (!FLAG('e') || access(path, F_OK) == 0)                    /* exists            */
-                     && (!FLAG('f') || S_ISREG(st.st_mode))                        /* regular file      */
-                     && (!FLAG('g') || st.st_mode & S_ISGID)                       /* set-group-id flag */
-                     && (!FLAG('h') || (!lstat(path, &ln) && S_ISLNK(ln.st_mode))) /* symbolic link */
-                     && (!FLAG('p') || S_ISFIFO(st.st_mode))                       /* named pipe        */
-                     && (!FLAG('r') || access(path, R_OK) == 0)                    /* readable          */
-                     && (!FLAG('s') || st.st_size > 0)                             /* not empty         */
-                     && (!FLAG('u') || st.st_mode & S_ISUID)                       /* set-user-id flag  */
-                     && (!FLAG('w') || access(path, W_OK) == 0)                    /* writable          */
-                     && (!FLAG('x') || access(path, X_OK) == 0)) != FLAG('v')) {   /* executable        */
-                    
-                    if (!(FLAG('q'))) {
-                        bool already_have_this_script = false;
-                        std::string name = std::string(dp->d_name);
-                        for (auto *script: scripts) {
-                            if (script->name == name) {
-                                already_have_this_script = true;
-                                break;
-                            }
+                if (event->len && event->name[0] != '.') {
+                    std::string name(event->name);
+                    auto existing = std::find(directory.names.begin(), directory.names.end(), name);
+                    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                        if (existing != directory.names.end())
+                            directory.names.erase(existing);
+                    } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                        if (existing == directory.names.end() && !(event->mask & IN_ISDIR) &&
+                            should_list(AT_FDCWD, (directory.path + "/" + name).c_str(), DT_UNKNOWN)) {
+                            directory.names.push_back(name);
                         }
-                        if (already_have_this_script)
-                            continue;
-                        
-                        auto *script = new Script();
-                        script->name = name;
-                        script->lowercase_name = script->name;
-                        std::transform(script->lowercase_name.begin(),
-                                       script->lowercase_name.end(),
-                                       script->lowercase_name.begin(),
-                                       ::tolower);
-                        
-                        script->path = path;
-                        if (!script->path.empty()) {
-                            if (script->path[script->path.length() - 1] == '/' ||
-                                script->path[script->path.length() - 1] == '\\') {
-                                script->path.erase(script->path.begin() + (script->path.length() - 1));
-                            }
-                        }
-                        
-                        scripts.push_back(script);
                     }
                 }
+                update_mtime(&directory);
+                changed = true;
             }
-            closedir(dir);
+        }
+    }
+    
+    // The directory might have been replaced right away (moved over, or deleted and made again), or the one it's
+    // waiting on was made
+    if (rewatch && watch_unwatched_directories())
+        changed = true;
+    
+    // Package managers touch lots of files at once, so we wait for things to settle before rebuilding
+    if (changed) {
+        if (scripts_changed_timeout == nullptr) {
+            scripts_changed_timeout = app_timeout_create(app, nullptr, 250, scripts_changed, nullptr);
+        } else {
+            app_timeout_replace(app, nullptr, scripts_changed_timeout, 250, scripts_changed, nullptr);
         }
     }
 }
 
-bool script_exists(const std::string &name) {
-    for (auto s: scripts)
-        if (s->name == name)
-            return true;
-    return false;
+void load_scripts(App *app) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    if (scripts_inotify_fd != -1) {
+        unpoll_descriptor(app, scripts_inotify_fd);
+        close(scripts_inotify_fd);
+    }
+    scripts_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    scripts_changed_timeout = nullptr;
+    path_directories.clear();
+    
+    const char *path_env = getenv("PATH");
+    std::string paths = path_env ? std::string(path_env) : "";
+    std::replace(paths.begin(), paths.end(), ':', ' ');
+    
+    auto cached = read_scripts_cache();
+    bool cache_stale = false;
+    
+    std::stringstream ss(paths);
+    std::string string_path;
+    while (ss >> string_path) {
+        bool duplicate = false;
+        for (const auto &directory: path_directories)
+            if (directory.path == string_path)
+                duplicate = true;
+        if (duplicate)
+            continue;
+        
+        PathDirectory directory;
+        directory.path = string_path;
+        // The watch goes in before we look at the directory so nothing can change unseen in between
+        if (scripts_inotify_fd != -1)
+            directory.watch_descriptor = watch_path_directory(string_path);
+        update_mtime(&directory);
+        
+        auto it = cached.find(string_path);
+        if (it != cached.end() && directory.mtime_sec != -1 &&
+            it->second.mtime_sec == directory.mtime_sec && it->second.mtime_nsec == directory.mtime_nsec) {
+            directory.names = std::move(it->second.names);
+        } else {
+            scan_directory(&directory);
+            cache_stale = true;
+        }
+        path_directories.push_back(std::move(directory));
+        if (scripts_inotify_fd != -1 && path_directories.back().watch_descriptor == -1)
+            watch_closest_parent(&path_directories.back());
+    }
+    if (cached.size() != path_directories.size())
+        cache_stale = true;
+    
+    publish_scripts();
+    if (cache_stale)
+        write_scripts_cache();
+    
+    if (scripts_inotify_fd != -1)
+        poll_descriptor(app, scripts_inotify_fd, EPOLLIN, scripts_inotify_wakeup);
 }
 
-
+bool script_exists(const std::string &name) {
+    auto snapshot = std::atomic_load(&scripts_snapshot);
+    return snapshot->names.find(name) != snapshot->names.end();
+}
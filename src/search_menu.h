@@ -14,20 +14,18 @@ public:
     std::string name;
     std::string lowercase_name;
     int priority = -1;
-    int historical_ranking = -1;
+    float historical_score = 0;
 };
 
 extern std::string active_tab;
 
 void start_search_menu();
 
-void on_key_press_search_bar(xcb_generic_event_t *event);
-
-void load_scripts();
+void prewarm_search_menu();
 
-void load_historic_apps();
+void on_key_press_search_bar(xcb_generic_event_t *event);
 
-void load_historic_scripts();
+void load_scripts(App *app);
 
 bool script_exists(const std::string &name);
 
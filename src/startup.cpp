@@ -0,0 +1,170 @@
+#include "startup.h"
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/Tracy.hpp"
+
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+
+struct TaskTiming {
+    long start_us = 0;
+    long end_us = 0;
+    int thread = 0; // 0 is the main thread
+};
+
+static long
+microseconds_since(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void
+write_trace(const std::vector<StartupTask> &tasks, const std::vector<TaskTiming> &timings) {
+    const char *home = getenv("HOME");
+    if (!home)
+        return;
+    std::string directory(home);
+    directory += "/.cache/winbar_startup";
+    if (mkdir(directory.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
+        if (errno != EEXIST) {
+            printf("Couldn't mkdir %s\n", directory.c_str());
+            return;
+        }
+    }
+    
+    std::string path = directory + "/startup.trace";
+    std::string temp_path = path + ".tmp";
+    std::ofstream file(temp_path, std::ios::trunc);
+    if (!file.is_open())
+        return;
+    file << "{\"traceEvents\":[";
+    for (int i = 0; i < tasks.size(); i++) {
+        if (i != 0)
+            file << ",";
+        // Task names are ours so they never need escaping
+        file << "\n{\"name\":\"" << tasks[i].name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << timings[i].thread
+             << ",\"ts\":" << timings[i].start_us << ",\"dur\":" << timings[i].end_us - timings[i].start_us << "}";
+    }
+    file << "\n]}\n";
+    file.close();
+    rename(temp_path.c_str(), path.c_str());
+}
+
+void startup_run(std::vector<StartupTask> &tasks) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto begin = std::chrono::steady_clock::now();
+    
+    std::unordered_map<std::string, int> index_of;
+    for (int i = 0; i < tasks.size(); i++)
+        index_of[tasks[i].name] = i;
+    
+    std::vector<int> waiting_on(tasks.size(), 0);
+    std::vector<std::vector<int>> dependents(tasks.size());
+    for (int i = 0; i < tasks.size(); i++) {
+        for (const auto &name: tasks[i].after) {
+            auto it = index_of.find(name);
+            if (it == index_of.end()) {
+                printf("Startup task \"%s\" comes after unknown task \"%s\"\n", tasks[i].name.c_str(), name.c_str());
+                continue;
+            }
+            waiting_on[i]++;
+            dependents[it->second].push_back(i);
+        }
+    }
+    
+    std::vector<TaskTiming> timings(tasks.size());
+    std::vector<std::thread> threads;
+    std::vector<bool> started(tasks.size(), false);
+    std::vector<int> finished; // filled by worker threads, drained by the main thread
+    std::mutex mutex;
+    std::condition_variable task_finished;
+    int done = 0;
+    int running = 0;
+    
+    auto run = [&](int i, int thread) {
+        timings[i].thread = thread;
+        timings[i].start_us = microseconds_since(begin);
+        {
+#ifdef TRACY_ENABLE
+            ZoneScopedN("Startup task");
+            ZoneName(tasks[i].name.c_str(), tasks[i].name.size());
+#endif
+            tasks[i].run();
+        }
+        timings[i].end_us = microseconds_since(begin);
+    };
+    
+    auto complete = [&](int i) {
+        done++;
+        for (int dependent: dependents[i])
+            waiting_on[dependent]--;
+    };
+    
+    std::unique_lock lock(mutex);
+    while (done < tasks.size()) {
+        // Hand every task that's ready to a thread, and run at most one main thread task
+        // before checking again since finishing it may have unblocked others
+        int main_task = -1;
+        for (int i = 0; i < tasks.size(); i++) {
+            if (started[i] || waiting_on[i] != 0)
+                continue;
+            if (tasks[i].main_thread) {
+                if (main_task == -1)
+                    main_task = i;
+                continue;
+            }
+            started[i] = true;
+            running++;
+            int thread = threads.size() + 1;
+            threads.emplace_back([&, i, thread]() {
+                run(i, thread);
+                std::lock_guard guard(mutex);
+                finished.push_back(i);
+                task_finished.notify_one();
+            });
+        }
+        
+        if (main_task != -1) {
+            started[main_task] = true;
+            lock.unlock();
+            run(main_task, 0);
+            lock.lock();
+            complete(main_task);
+        } else if (running > 0) {
+            task_finished.wait(lock, [&finished] { return !finished.empty(); });
+        } else if (done < tasks.size()) {
+            // Whatever is left is waiting on itself or something that doesn't exist
+            for (int i = 0; i < tasks.size(); i++) {
+                if (!started[i]) {
+                    printf("Startup task \"%s\" is part of a dependency cycle, running it anyway\n",
+                           tasks[i].name.c_str());
+                    waiting_on[i] = 0;
+                    break;
+                }
+            }
+        }
+        
+        for (int i: finished) {
+            running--;
+            complete(i);
+        }
+        finished.clear();
+    }
+    lock.unlock();
+    
+    for (auto &thread: threads)
+        thread.join();
+    
+    write_trace(tasks, timings);
+}
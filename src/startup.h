@@ -0,0 +1,27 @@
+#ifndef WINBAR_STARTUP_H
+#define WINBAR_STARTUP_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+struct StartupTask {
+    std::string name;
+    
+    // Names of the tasks that have to finish before this one can start
+    std::vector<std::string> after;
+    
+    // Anything that creates clients or otherwise touches the App's clients and
+    // containers has to run on the main thread
+    bool main_thread = false;
+    
+    std::function<void()> run;
+};
+
+// Starts every task as soon as the tasks it comes after have finished, each task
+// that isn't main_thread on its own thread. Returns once all of them are done and
+// writes when each one started and ended to ~/.cache/winbar_startup/startup.trace
+// (in the Chrome trace event format, so it opens in chrome://tracing or Perfetto).
+void startup_run(std::vector<StartupTask> &tasks);
+
+#endif //WINBAR_STARTUP_H
@@ -87,7 +87,7 @@ systray_event_handler(App *app, xcb_generic_event_t *event) {
         case XCB_CLIENT_MESSAGE: {
             auto *client_message = (xcb_client_message_event_t *) event;
             
-            if (client_message->type == get_cached_atom(app, "_NET_SYSTEM_TRAY_OPCODE")) {
+            if (client_message->type == get_cached_atom(app, KnownAtom::NET_SYSTEM_TRAY_OPCODE)) {
                 if (client_message->data.data32[1] == SYSTEM_TRAY_REQUEST_DOCK) {
                     auto window_to_be_docked = client_message->data.data32[2];
                     
@@ -292,7 +292,7 @@ void register_as_systray() {
     ev.response_type = XCB_CLIENT_MESSAGE;
     ev.window = app->screen->root;
     ev.format = 32;
-    ev.type = get_cached_atom(app, "MANAGER");
+    ev.type = get_cached_atom(app, KnownAtom::MANAGER);
     ev.data.data32[0] = 0;
     ev.data.data32[1] = tray_atom;
     ev.data.data32[2] = systray->window;
@@ -29,17 +29,27 @@
 #include "simple_dbus.h"
 #include "audio.h"
 #include "defer.h"
+#include "thumbnails.h"
+#include "power_supply.h"
 
 #include <algorithm>
 #include <cairo.h>
 #include <cmath>
+#include <cstring>
 #include <fstream>
-#include <iomanip>
 #include <cassert>
 #include <pango/pangocairo.h>
 #include <xcb/xproto.h>
 #include <dpi.h>
-#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 class WorkspaceButton : public HoverableButton {
 public:
@@ -59,6 +69,7 @@ static xcb_window_t active_window = 0;
 static xcb_window_t backup_active_window = 0;
 
 static std::string time_text("N/A");
+static int clock_fd = -1;
 
 static xcb_window_t popup_window_open = -1;
 
@@ -176,6 +187,9 @@ paint_super(AppClient *client, cairo_t *cr, Container *container) {
     }
 }
 
+// Set by taskbar_audio_started. Before that, audio_clients is still being filled in on the audio task's thread.
+static bool audio_started = false;
+
 static void
 paint_volume(AppClient *client, cairo_t *cr, Container *container) {
 #ifdef TRACY_ENABLE
@@ -197,11 +211,13 @@ paint_volume(AppClient *client, cairo_t *cr, Container *container) {
     
     int val = 100;
     bool mute_state = false;
-    for (auto c: audio_clients) {
-        if (c->is_master_volume()) {
-            val = round(c->get_volume() * 100);
-            mute_state = c->is_muted();
-            break;
+    if (audio_started) {
+        for (auto c: audio_clients) {
+            if (c->is_master_volume()) {
+                val = round(c->get_volume() * 100);
+                mute_state = c->is_muted();
+                break;
+            }
         }
     }
     
@@ -609,79 +625,109 @@ pinned_icon_mouse_leaves(AppClient *client, cairo_t *cr, Container *container) {
     client_create_animation(app, client, &data->hover_amount, 70, 0, 0);
 }
 
-std::string
-return_current_time_and_date() {
-    auto now = std::chrono::system_clock::now();
-    auto in_time_t = std::chrono::system_clock::to_time_t(now);
-    
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&in_time_t), "%I:%M %p");
-    if (config->date_single_line) {
-        ss << ' ';
-    } else {
-        ss << '\n';
-    }
-    
-    std::stringstream month;
-    month << std::put_time(std::localtime(&in_time_t), "%m");
-    
-    std::string real_month;
-    if (month.str().at(0) == '0') {
-        real_month = month.str().erase(0, 1);
-    } else {
-        real_month = month.str();
-    }
+// Writes something like "3:07 PM 6/9/2026" into buffer, returning its length
+static int
+format_current_time_and_date(char *buffer, size_t size) {
+    time_t now = time(nullptr);
+    struct tm local{};
+    localtime_r(&now, &local);
     
-    std::stringstream day;
-    day << std::put_time(std::localtime(&in_time_t), "%d");
-    auto s = day.str();
-    
-    std::string real_day;
-    if (day.str().at(0) == '0') {
-        real_day = day.str().erase(0, 1);
-    } else {
-        real_day = day.str();
+    size_t length = strftime(buffer, size, "%I:%M %p", &local);
+    if (length == 0)
+        return 0;
+    // Twelve hour times don't get a leading zero
+    if (buffer[0] == '0') {
+        memmove(buffer, buffer + 1, length);
+        length--;
     }
-    
-    std::stringstream year;
-    year << std::put_time(std::localtime(&in_time_t), "%Y");
-    
-    ss << real_month << "/" << real_day << "/" << year.str();
-    
-    return ss.str();
+    int written = snprintf(buffer + length, size - length, "%c%d/%d/%d", config->date_single_line ? ' ' : '\n',
+                           local.tm_mon + 1, local.tm_mday, local.tm_year + 1900);
+    if (written < 0 || (size_t) written >= size - length)
+        return 0;
+    return length + written;
 }
 
-void update_time(App *app, AppClient *client, Timeout *timeout, void *data) {
+static void
+update_time(App *app, AppClient *client) {
 #ifdef TRACY_ENABLE
-    tracy::SetThreadName("Time Thread");
+    ZoneScoped;
 #endif
-    if (timeout)
-        timeout->keep_running = true;
+    static char buffer[128];
+    int length = format_current_time_and_date(buffer, sizeof(buffer));
+    if (length == 0 || time_text.compare(0, std::string::npos, buffer, length) == 0)
+        return;
+    time_text.assign(buffer, length);
     
-    std::string date = return_current_time_and_date();
-    if (date[0] == '0')
-        date.erase(0, 1);
-    if (time_text != date) {
-        time_text = date;
-        client_layout(app, client);
+    // Only the date is repainted, and if its text got wider or narrower paint_date lays the taskbar out again
+    if (auto date = container_by_name("date", client->root)) {
+        client_paint_region(app, client, date->real_bounds);
+    } else {
         request_refresh(app, client);
     }
 }
 
-Container *get_pinned_icon_representing_window(xcb_window_t window) {
-    if (auto c = client_by_name(app, "taskbar")) {
-        if (auto icons = container_by_name("icons", c->root)) {
-            for (Container *container: icons->children) {
-                auto data = (LaunchableButton *) container->user_data;
-                
-                for (auto windows_data: data->windows_data_list) {
-                    if (windows_data->id == window) {
-                        return container;
-                    }
-                }
-            }
-        }
+// Arms the clock to go off exactly when the next minute starts, or as soon as the wall clock is set
+static void
+arm_clock(int fd) {
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    itimerspec when{};
+    when.it_value.tv_sec = now.tv_sec - now.tv_sec % 60 + 60;
+    timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &when, nullptr);
+}
+
+static void
+clock_ticked(App *app, int fd) {
+    // A read fails with ECANCELED when the wall clock jumped (it was set, or we woke up from suspend), which
+    // just means the time has to be updated early and the next minute found again
+    uint64_t expirations;
+    read(fd, &expirations, sizeof(expirations));
+    arm_clock(fd);
+    // Unlike localtime, localtime_r doesn't have to check whether the timezone changed, so it's asked for here
+    tzset();
+    if (auto client = client_by_name(app, "taskbar"))
+        update_time(app, client);
+}
+
+static void
+start_clock(App *app) {
+    clock_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (clock_fd == -1) {
+        printf("Couldn't create the clock's timerfd\n");
+        return;
     }
+    arm_clock(clock_fd);
+    poll_descriptor(app, clock_fd, EPOLLIN, clock_ticked);
+}
+
+struct RegisteredWindow {
+    Container *icon = nullptr;
+    LaunchableButton *button = nullptr;
+    WindowsData *windows_data = nullptr;
+};
+
+// Every window that has an icon on the taskbar, kept up to date by add_window and remove_window,
+// so events about a window don't have to search through every icon to find it
+static std::unordered_map<xcb_window_t, RegisteredWindow> window_registry;
+
+// The last _NET_CLIENT_LIST_STACKING we were told about, sorted so the next one can be diffed against it
+static std::vector<xcb_window_t> last_stacking_windows;
+
+// Windows in that list add_window turned down (docks, menus, skip taskbar). They aren't queried again every time
+// the stacking order changes, only when their _NET_WM_STATE or _NET_WM_WINDOW_TYPE does.
+static std::unordered_set<xcb_window_t> rejected_windows;
+
+static RegisteredWindow *
+registered_window(xcb_window_t window) {
+    auto it = window_registry.find(window);
+    if (it == window_registry.end())
+        return nullptr;
+    return &it->second;
+}
+
+Container *get_pinned_icon_representing_window(xcb_window_t window) {
+    if (auto registered = registered_window(window))
+        return registered->icon;
     return nullptr;
 }
 
@@ -719,11 +765,9 @@ void active_window_changed(xcb_window_t new_active_window) {
             auto data = (LaunchableButton *) new_active_container->user_data;
             client_create_animation(app, c, &data->active_amount, 45, nullptr, 1);
             
-            for (auto w_d: data->windows_data_list) {
-                if (w_d->id == new_active_window) {
-                    if (w_d->mapped) {
-                        w_d->take_screenshot();
-                    }
+            if (auto registered = registered_window(new_active_window)) {
+                if (registered->windows_data->mapped && !thumbnails_damage_driven(app)) {
+                    registered->windows_data->take_screenshot();
                 }
             }
         }
@@ -907,8 +951,8 @@ get_wm_state(xcb_window_t window) {
     cookie = xcb_get_property(app->connection,
                               false,
                               window,
-                              get_cached_atom(app, "WM_STATE"),
-                              get_cached_atom(app, "WM_STATE"),
+                              get_cached_atom(app, KnownAtom::WM_STATE),
+                              get_cached_atom(app, KnownAtom::WM_STATE),
                               0,
                               sizeof(int32_t));
     
@@ -941,7 +985,7 @@ minimize_window(xcb_window_t window) {
     event.format = 32;
     event.sequence = 0;
     event.window = window;
-    event.type = get_cached_atom(app, "WM_CHANGE_STATE");
+    event.type = get_cached_atom(app, KnownAtom::WM_CHANGE_STATE);
     event.data.data32[0] = XCB_ICCCM_WM_STATE_ICONIC;// IconicState
     event.data.data32[1] = 0;
     event.data.data32[2] = 0;
@@ -1371,7 +1415,7 @@ clicked_minimize(AppClient *client, cairo_t *cr, Container *container) {
         defer(xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data));
         bool state = false;
         for (int i = 0; i < atoms_reply_data.atoms_len; i++) {
-            if (atoms_reply_data.atoms[i] == get_cached_atom(app, "_NET_SHOWING_DESKTOP")) {
+            if (atoms_reply_data.atoms[i] == get_cached_atom(app, KnownAtom::NET_SHOWING_DESKTOP)) {
                 request_cookie = xcb_ewmh_get_showing_desktop(&app->ewmh, app->screen_number);
                 unsigned int state;
                 xcb_ewmh_get_showing_desktop_reply(&app->ewmh, request_cookie, &state, nullptr);
@@ -1383,7 +1427,7 @@ clicked_minimize(AppClient *client, cairo_t *cr, Container *container) {
                 event.format = 32;
                 event.sequence = 0;
                 event.window = app->screen->root;
-                event.type = get_cached_atom(app, "_NET_SHOWING_DESKTOP");
+                event.type = get_cached_atom(app, KnownAtom::NET_SHOWING_DESKTOP);
                 event.data.data32[0] = state;
                 event.data.data32[1] = 0;
                 event.data.data32[2] = 0;
@@ -1591,77 +1635,79 @@ paint_search(AppClient *client, cairo_t *cr, Container *container) {
     }
 }
 
+static void
+repaint_battery(App *app, AppClient *client) {
+    if (auto battery = container_by_name("battery", client->root))
+        client_paint_region(app, client, battery->real_bounds);
+}
+
+// Only exists while the battery is charging, since that's the only time the icon animates
+static Timeout *battery_animation_timeout = nullptr;
+
 void update_battery_animation_timeout(App *app, AppClient *client, Timeout *timeout, void *userdata) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    timeout->keep_running = true;
-    
     auto *data = static_cast<data_battery_surfaces *>(userdata);
+    if (data->status != "Charging") {
+        if (battery_animation_timeout == timeout)
+            battery_animation_timeout = nullptr;
+        return;
+    }
+    timeout->keep_running = true;
     
     data->animating_capacity_index++;
     if (data->animating_capacity_index > 9)
         data->animating_capacity_index = data->capacity_index;
     
-    request_refresh(app, client);
+    repaint_battery(app, client);
+}
+
+// Returns true if what the battery button shows is different now
+static bool
+apply_battery_state(data_battery_surfaces *data) {
+    const BatteryState &state = power_supply_state();
+    bool was_charging = data->status == "Charging";
+    int previous_capacity_index = data->capacity_index;
+    
+    data->status = state.status;
+    data->capacity = std::to_string(state.capacity);
+    data->previous_status_update_ms = get_current_time_in_ms();
+    data->capacity_index = std::max(0, std::min(9, state.capacity / 10));
+    
+    bool charging = data->status == "Charging";
+    // While charging the icon animates up from wherever it already is
+    if (!charging || !was_charging)
+        data->animating_capacity_index = data->capacity_index;
+    return charging != was_charging || data->capacity_index != previous_capacity_index;
+}
+
+static void
+animate_battery_while_charging(App *app, AppClient *client, data_battery_surfaces *data) {
+    bool charging = data->status == "Charging";
+    if (charging && !battery_animation_timeout) {
+        battery_animation_timeout = app_timeout_create(app, client, 1200, update_battery_animation_timeout, data);
+    } else if (!charging && battery_animation_timeout) {
+        app_timeout_stop(app, client, battery_animation_timeout);
+        battery_animation_timeout = nullptr;
+    }
 }
 
-void update_battery_status_timeout(App *app, AppClient *client, Timeout *timeout, void *userdata) {
+static void
+battery_state_changed(App *app) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    if (timeout) {
-        timeout->keep_running = true;
-    }
-    
-    auto data = (data_battery_surfaces *) userdata;
-    long current_time = get_current_time_in_ms();
-    
-    int previous_animating_capacity = 0;
-    bool was_charging_on_previous_status_update = data->status == "Charging";
-    if (was_charging_on_previous_status_update) {
-        previous_animating_capacity = data->animating_capacity_index;
-    }
-    
-    std::string line;
-    std::ifstream status("/sys/class/power_supply/BAT0/status");
-    if (status.is_open()) {
-        data->status = "Missing BAT0";
-        if (getline(status, line)) {
-            data->status = line;
-        }
-        status.close();
-    } else {
-        data->status = "Missing BAT0";
-    }
-    
-    std::ifstream capacity("/sys/class/power_supply/BAT0/capacity");
-    if (capacity.is_open()) {
-        data->capacity = "0";
-        if (getline(capacity, line)) {
-            data->capacity = line;
-        }
-        capacity.close();
-    } else {
-        data->capacity = "0";
-    }
-    data->previous_status_update_ms = current_time;
-    
-    int capacity_index = std::floor(((double) (std::stoi(data->capacity))) / 10.0);
-    
-    if (capacity_index > 9)
-        capacity_index = 9;
-    if (capacity_index < 0)
-        capacity_index = 0;
-    
-    data->capacity_index = capacity_index;
-    if (was_charging_on_previous_status_update) {
-        data->animating_capacity_index = previous_animating_capacity;
-    } else {
-        data->animating_capacity_index = data->capacity_index;
-    }
-    
-    request_refresh(app, client);
+    auto client = client_by_name(app, "taskbar");
+    if (!client)
+        return;
+    auto battery = container_by_name("battery", client->root);
+    if (!battery)
+        return;
+    auto *data = (data_battery_surfaces *) battery->user_data;
+    if (apply_battery_state(data))
+        repaint_battery(app, client);
+    animate_battery_while_charging(app, client, data);
 }
 
 void paint_battery(AppClient *client_entity, cairo_t *cr, Container *container) {
@@ -1744,22 +1790,13 @@ make_battery_button(Container *parent, AppClient *client_entity) {
     }
     c->user_data = data;
     
-    std::string line;
-    std::ifstream capacity("/sys/class/power_supply/BAT0/type");
-    if (capacity.is_open()) {
-        if (getline(capacity, line)) {
-            if (line != "UPS") {
-                parent->children.push_back(c);
-                app_timeout_create(app, client_entity, 7000, update_battery_status_timeout, data);
-                update_battery_status_timeout(app, client_entity, nullptr, data);
-                
-                app_timeout_create(app, client_entity, 1200, update_battery_animation_timeout, data);
-            } else {
-                delete c;
-            }
-        }
-        capacity.close();
+    power_supply_start(app, battery_state_changed);
+    if (power_supply_state().present) {
+        parent->children.push_back(c);
+        apply_battery_state(data);
+        animate_battery_while_charging(app, client_entity, data);
     } else {
+        power_supply_stop(app);
         delete c;
     }
 };
@@ -2013,7 +2050,7 @@ fill_root(App *app, AppClient *client, Container *root) {
     button_date->when_mouse_down = invalidate_icon_button_press_if_window_open;
     button_date->name = "date";
     
-    app_timeout_create(app, client, 1000, update_time, nullptr);
+    start_clock(app);
     app_timeout_create(app, client, 10000, late_classes_update, nullptr);
     
     button_action_center->when_paint = paint_action_center;
@@ -2039,19 +2076,41 @@ fill_root(App *app, AppClient *client, Container *root) {
 static void
 load_pinned_icons();
 
-static int inotify_fd = -1;
-static int inotify_status_fd = -1;
-static int inotify_capacity_fd = -1;
+static void
+write_taskbar_snapshot(AppClient *client);
+
 static Timeout *pinned_timeout = nullptr;
 
+static std::thread pinned_icons_reconciler;
+static std::atomic<bool> pinned_icons_reconciler_cancelled = false;
+
+// The pinned icons are made before the icon theme is loaded, so their lookup waits here for taskbar_icons_loaded
+static std::vector<LaunchableButton *> pinned_awaiting_icons;
+static std::vector<std::string> pinned_snapshot_paths;
+static bool pinned_from_snapshot = false;
+
 static void
 when_taskbar_closed(AppClient *client) {
-    if (inotify_fd != -1) close(inotify_fd);
-    inotify_fd = -1;
-    inotify_status_fd = -1;
-    inotify_capacity_fd = -1;
+    if (clock_fd != -1) {
+        unpoll_descriptor(client->app, clock_fd);
+        close(clock_fd);
+    }
+    clock_fd = -1;
+    power_supply_stop(client->app);
+    // The client's timeouts are removed along with it
+    battery_animation_timeout = nullptr;
     update_pinned_items_file(true);
     pinned_timeout = nullptr;
+    pinned_awaiting_icons.clear();
+    pinned_snapshot_paths.clear();
+    pinned_icons_reconciler_cancelled = true;
+    if (pinned_icons_reconciler.joinable())
+        pinned_icons_reconciler.join();
+    write_taskbar_snapshot(client);
+    window_registry.clear();
+    last_stacking_windows.clear();
+    rejected_windows.clear();
+    thumbnails_stop(client->app);
 }
 
 static bool
@@ -2104,41 +2163,27 @@ taskbar_on_screen_size_change(App *app, AppClient *client) {
 
 static void
 update_window_title_name(xcb_window_t window) {
-    if (auto client = client_by_name(app, "taskbar")) {
-        if (client->root) {
-            if (auto icons = container_by_name("icons", client->root)) {
-                for (auto icon: icons->children) {
-                    auto *data = static_cast<LaunchableButton *>(icon->user_data);
-                    for (auto windows_data: data->windows_data_list) {
-                        if (windows_data->id == window) {
-                            const xcb_get_property_cookie_t &propertyCookie = xcb_ewmh_get_wm_name(
-                                    &app->ewmh, window);
-                            xcb_ewmh_get_utf8_strings_reply_t data;
-                            uint8_t success = xcb_ewmh_get_wm_name_reply(&app->ewmh, propertyCookie, &data,
-                                                                         nullptr);
-                            if (success) {
-                                windows_data->title = strndup(data.strings, data.strings_len);
-                                xcb_ewmh_get_utf8_strings_reply_wipe(&data);
-                                return;
-                            }
-                            
-                            const xcb_get_property_cookie_t &cookie = xcb_icccm_get_wm_name(app->connection,
-                                                                                            window);
-                            xcb_icccm_get_text_property_reply_t reply;
-                            success = xcb_icccm_get_wm_name_reply(app->connection, cookie, &reply,
-                                                                  nullptr);
-                            if (success) {
-                                windows_data->title = std::string(reply.name, reply.name_len);
-                                xcb_icccm_get_text_property_reply_wipe(&reply);
-                                return;
-                            }
-                            
-                            return;
-                        }
-                    }
-                }
-            }
-        }
+    auto registered = registered_window(window);
+    if (!registered)
+        return;
+    auto windows_data = registered->windows_data;
+
+    const xcb_get_property_cookie_t &propertyCookie = xcb_ewmh_get_wm_name(&app->ewmh, window);
+    xcb_ewmh_get_utf8_strings_reply_t data;
+    uint8_t success = xcb_ewmh_get_wm_name_reply(&app->ewmh, propertyCookie, &data, nullptr);
+    if (success) {
+        windows_data->title = strndup(data.strings, data.strings_len);
+        xcb_ewmh_get_utf8_strings_reply_wipe(&data);
+        return;
+    }
+
+    const xcb_get_property_cookie_t &cookie = xcb_icccm_get_wm_name(app->connection, window);
+    xcb_icccm_get_text_property_reply_t reply;
+    success = xcb_icccm_get_wm_name_reply(app->connection, cookie, &reply, nullptr);
+    if (success) {
+        windows_data->title = std::string(reply.name, reply.name_len);
+        xcb_icccm_get_text_property_reply_wipe(&reply);
+        return;
     }
 }
 
@@ -2153,103 +2198,79 @@ window_event_handler(App *app, xcb_generic_event_t *event) {
     switch (XCB_EVENT_RESPONSE_TYPE(event)) {
         case XCB_CONFIGURE_NOTIFY: {
             auto *e = (xcb_configure_notify_event_t *) event;
-            if (auto client = client_by_name(app, "taskbar")) {
-                if (client->root) {
-                    if (auto icons = container_by_name("icons", client->root)) {
-                        for (auto icon: icons->children) {
-                            auto *data = static_cast<LaunchableButton *>(icon->user_data);
-                            for (auto windows_data: data->windows_data_list) {
-                                if (windows_data->id == e->window) {
-                                    // update the size of the surface
-                                    if (windows_data->window_surface && (e->width != windows_data->width ||
-                                                                         e->height != windows_data->height)) {
-                                        windows_data->width = e->width;
-                                        windows_data->height = e->height;
-                                        cairo_xcb_surface_set_size(windows_data->window_surface,
-                                                                   windows_data->width, windows_data->height);
-                                        
-                                        cairo_surface_destroy(windows_data->raw_thumbnail_surface);
-                                        cairo_destroy(windows_data->raw_thumbnail_cr);
-                                        cairo_surface_destroy(windows_data->scaled_thumbnail_surface);
-                                        cairo_destroy(windows_data->scaled_thumbnail_cr);
-                                        
-                                        windows_data->raw_thumbnail_surface = accelerated_surface(app,
-                                                                                                  client_by_name(
-                                                                                                          app,
-                                                                                                          "taskbar"),
-                                                                                                  windows_data->width,
-                                                                                                  windows_data->height);
-                                        windows_data->raw_thumbnail_cr = cairo_create(
-                                                windows_data->raw_thumbnail_surface);
-                                        windows_data->scaled_thumbnail_surface = accelerated_surface(app,
-                                                                                                     client_by_name(
-                                                                                                             app,
-                                                                                                             "taskbar"),
-                                                                                                     option_width,
-                                                                                                     option_height);
-                                        windows_data->scaled_thumbnail_cr = cairo_create(
-                                                windows_data->scaled_thumbnail_surface);
-                                    }
-                                    return false;
-                                }
-                            }
-                        }
-                    }
-                }
+            auto registered = registered_window(e->window);
+            if (!registered)
+                break;
+            auto windows_data = registered->windows_data;
+            // update the size of the surface
+            if (windows_data->window_surface && (e->width != windows_data->width ||
+                                                 e->height != windows_data->height)) {
+                auto client = client_by_name(app, "taskbar");
+                windows_data->width = e->width;
+                windows_data->height = e->height;
+                cairo_xcb_surface_set_size(windows_data->window_surface,
+                                           windows_data->width, windows_data->height);
+                thumbnails_window_reshaped(app, windows_data);
+
+                cairo_surface_destroy(windows_data->scaled_thumbnail_surface);
+                cairo_destroy(windows_data->scaled_thumbnail_cr);
+
+                windows_data->scaled_thumbnail_surface = accelerated_surface(app, client,
+                                                                             option_width,
+                                                                             option_height);
+                windows_data->scaled_thumbnail_cr = cairo_create(windows_data->scaled_thumbnail_surface);
             }
             break;
         }
         case XCB_PROPERTY_NOTIFY: {
             auto e = (xcb_property_notify_event_t *) event;
+            if ((e->atom == get_cached_atom(app, KnownAtom::NET_WM_STATE) ||
+                 e->atom == get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE)) &&
+                rejected_windows.count(e->window)) {
+                rejected_windows.erase(e->window);
+                add_window(app, e->window);
+                if (!registered_window(e->window))
+                    rejected_windows.insert(e->window);
+                break;
+            }
 //            const xcb_get_atom_name_cookie_t &cookie = xcb_get_atom_name(app->connection, e->atom);
 //            xcb_get_atom_name_reply_t *reply = xcb_get_atom_name_reply(app->connection, cookie, nullptr);
 //            char *string = xcb_get_atom_name_name(reply);
 //            printf("%s\n", string);
-            if (e->atom == get_cached_atom(app, "WM_NAME") ||
-                e->atom == get_cached_atom(app, "_NET_WM_NAME")) {
+            if (e->atom == get_cached_atom(app, KnownAtom::WM_NAME) ||
+                e->atom == get_cached_atom(app, KnownAtom::NET_WM_NAME)) {
                 update_window_title_name(e->window);
-            } else if (e->atom == get_cached_atom(app, "_NET_WM_NAME") ||
-                       e->atom == get_cached_atom(app, "_NET_WM_NAME")) {
+            } else if (e->atom == get_cached_atom(app, KnownAtom::NET_WM_NAME) ||
+                       e->atom == get_cached_atom(app, KnownAtom::NET_WM_NAME)) {
                 update_window_title_name(e->window);
-            } else if (e->atom == get_cached_atom(app, "WM_CLASS")) {
+            } else if (e->atom == get_cached_atom(app, KnownAtom::WM_CLASS)) {
                 late_classes_update(app, client_by_name(app, "taskbar"), nullptr, nullptr);
-            } else if (e->atom == get_cached_atom(app, "_NET_WM_CLASS")) {
+            } else if (e->atom == get_cached_atom(app, KnownAtom::NET_WM_CLASS)) {
                 late_classes_update(app, client_by_name(app, "taskbar"), nullptr, nullptr);
-            } else if (e->atom == get_cached_atom(app, "_GTK_FRAME_EXTENTS")) {
-                if (auto client = client_by_name(app, "taskbar")) {
-                    if (client->root) {
-                        if (auto icons = container_by_name("icons", client->root)) {
-                            for (auto icon: icons->children) {
-                                auto *data = static_cast<LaunchableButton *>(icon->user_data);
-                                for (auto windows_data: data->windows_data_list) {
-                                    if (windows_data->id == e->window) {
-                                        auto cookie = xcb_get_property(app->connection, 0, e->window,
-                                                                       get_cached_atom(app, "_GTK_FRAME_EXTENTS"),
-                                                                       XCB_ATOM_CARDINAL, 0, 4);
-                                        auto reply = xcb_get_property_reply(app->connection, cookie, nullptr);
+            } else if (e->atom == get_cached_atom(app, KnownAtom::GTK_FRAME_EXTENTS)) {
+                if (auto registered = registered_window(e->window)) {
+                    auto windows_data = registered->windows_data;
+                    auto cookie = xcb_get_property(app->connection, 0, e->window,
+                                                   get_cached_atom(app, KnownAtom::GTK_FRAME_EXTENTS),
+                                                   XCB_ATOM_CARDINAL, 0, 4);
+                    auto reply = xcb_get_property_reply(app->connection, cookie, nullptr);
                                         
-                                        if (reply) {
-                                            int length = xcb_get_property_value_length(reply);
-                                            if (length != 0) {
-                                                auto gtkFrameExtents = static_cast<uint32_t *>(xcb_get_property_value(
-                                                        reply));
-                                                windows_data->gtk_left_margin = (int) gtkFrameExtents[0];
-                                                windows_data->gtk_right_margin = (int) gtkFrameExtents[1];
-                                                windows_data->gtk_top_margin = (int) gtkFrameExtents[2];
-                                                windows_data->gtk_bottom_margin = (int) gtkFrameExtents[3];
-                                            }
-                                            free(reply);
-                                        }
-                                    }
-                                }
-                            }
+                    if (reply) {
+                        int length = xcb_get_property_value_length(reply);
+                        if (length != 0) {
+                            auto gtkFrameExtents = static_cast<uint32_t *>(xcb_get_property_value(reply));
+                            windows_data->gtk_left_margin = (int) gtkFrameExtents[0];
+                            windows_data->gtk_right_margin = (int) gtkFrameExtents[1];
+                            windows_data->gtk_top_margin = (int) gtkFrameExtents[2];
+                            windows_data->gtk_bottom_margin = (int) gtkFrameExtents[3];
                         }
+                        free(reply);
                     }
                 }
-            } else if (e->atom == get_cached_atom(app, "_NET_WM_STATE")) {
+            } else if (e->atom == get_cached_atom(app, KnownAtom::NET_WM_STATE)) {
                 xcb_generic_error_t *err = nullptr;
-                auto cookie = xcb_get_property(app->connection, 0, e->window, get_cached_atom(app, "_NET_WM_STATE"),
-                                               XCB_ATOM_ATOM, 0,
+                auto cookie = xcb_get_property(app->connection, 0, e->window,
+                                               get_cached_atom(app, KnownAtom::NET_WM_STATE), XCB_ATOM_ATOM, 0,
                                                BUFSIZ);
                 xcb_get_property_reply_t *reply = xcb_get_property_reply(app->connection, cookie, &err);
                 if (reply) {
@@ -2257,23 +2278,14 @@ window_event_handler(App *app, xcb_generic_event_t *event) {
                         auto *state_atoms = (xcb_atom_t *) xcb_get_property_value(reply);
                         bool attention = false;
                         for (unsigned int a = 0; a < sizeof(xcb_atom_t); a++) {
-                            if (state_atoms[a] == get_cached_atom(app, "_NET_WM_STATE_DEMANDS_ATTENTION")) {
+                            if (state_atoms[a] == get_cached_atom(app, KnownAtom::NET_WM_STATE_DEMANDS_ATTENTION)) {
                                 attention = true;
-                                if (auto client = client_by_name(app, "taskbar")) {
-                                    if (client->root) {
-                                        if (auto icons = container_by_name("icons", client->root)) {
-                                            for (auto icon: icons->children) {
-                                                auto *data = static_cast<LaunchableButton *>(icon->user_data);
-                                                for (auto windows_data: data->windows_data_list) {
-                                                    if (windows_data->id == e->window) {
-                                                        client_create_animation(app, client,
-                                                                                &data->wants_attention_amount, 10000, 0,
-                                                                                1);
-                                                        windows_data->wants_attention = true;
-                                                    }
-                                                }
-                                            }
-                                        }
+                                if (auto registered = registered_window(e->window)) {
+                                    if (auto client = client_by_name(app, "taskbar")) {
+                                        client_create_animation(app, client,
+                                                                &registered->button->wants_attention_amount, 10000, 0,
+                                                                1);
+                                        registered->windows_data->wants_attention = true;
                                     }
                                 }
                                 free(reply);
@@ -2281,28 +2293,19 @@ window_event_handler(App *app, xcb_generic_event_t *event) {
                             }
                         }
                         if (!attention) {
-                            if (auto client = client_by_name(app, "taskbar")) {
-                                if (client->root) {
-                                    if (auto icons = container_by_name("icons", client->root)) {
-                                        for (auto icon: icons->children) {
-                                            auto *data = static_cast<LaunchableButton *>(icon->user_data);
-                                            for (auto windows_data: data->windows_data_list) {
-                                                if (windows_data->id == e->window) {
-                                                    client_create_animation(app, client, &data->wants_attention_amount,
-                                                                            0, 0, 0);
-                                                    windows_data->wants_attention = false;
-                                                }
-                                            }
-                                        }
-                                    }
+                            if (auto registered = registered_window(e->window)) {
+                                if (auto client = client_by_name(app, "taskbar")) {
+                                    client_create_animation(app, client, &registered->button->wants_attention_amount,
+                                                            0, 0, 0);
+                                    registered->windows_data->wants_attention = false;
                                 }
                             }
                         }
                     }
-                } else if (e->atom == get_cached_atom(app, "_NET_WM_DESKTOP")) {
+                } else if (e->atom == get_cached_atom(app, KnownAtom::NET_WM_DESKTOP)) {
                     // TODO: error check
                     auto r = xcb_get_property(app->connection, False, e->window,
-                                              get_cached_atom(app, "_NET_WM_DESKTOP"),
+                                              get_cached_atom(app, KnownAtom::NET_WM_DESKTOP),
                                               XCB_ATOM_CARDINAL, 0, 32);
                     auto re = xcb_get_property_reply(app->connection, r, nullptr);
                     if (re) {
@@ -2320,38 +2323,16 @@ window_event_handler(App *app, xcb_generic_event_t *event) {
         }
         case XCB_MAP_NOTIFY: {
             auto *e = (xcb_map_notify_event_t *) event;
-            if (auto client = client_by_name(app, "taskbar")) {
-                if (client->root) {
-                    if (auto icons = container_by_name("icons", client->root)) {
-                        for (auto icon: icons->children) {
-                            auto *data = static_cast<LaunchableButton *>(icon->user_data);
-                            for (auto windows_data: data->windows_data_list) {
-                                if (windows_data->id == e->window) {
-                                    windows_data->mapped = true;
-                                }
-                            }
-                        }
-                    }
-                }
+            if (auto registered = registered_window(e->window)) {
+                registered->windows_data->mapped = true;
+                thumbnails_window_reshaped(app, registered->windows_data);
             }
             break;
         }
         case XCB_UNMAP_NOTIFY: {
             auto *e = (xcb_unmap_notify_event_t *) event;
-            if (auto client = client_by_name(app, "taskbar")) {
-                if (client->root) {
-                    if (auto icons = container_by_name("icons", client->root)) {
-                        for (auto icon: icons->children) {
-                            auto *data = static_cast<LaunchableButton *>(icon->user_data);
-                            for (auto windows_data: data->windows_data_list) {
-                                if (windows_data->id == e->window) {
-                                    windows_data->mapped = false;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+            if (auto registered = registered_window(e->window))
+                registered->windows_data->mapped = false;
             break;
         }
     }
@@ -2359,96 +2340,8 @@ window_event_handler(App *app, xcb_generic_event_t *event) {
 }
 
 void screenshot_active_window(App *app, AppClient *client, Timeout *, void *user_data) {
-    if (auto client = client_by_name(app, "taskbar")) {
-        if (client->root) {
-            if (auto icons = container_by_name("icons", client->root)) {
-                for (auto icon: icons->children) {
-                    auto *data = static_cast<LaunchableButton *>(icon->user_data);
-                    for (auto windows_data: data->windows_data_list) {
-                        if (windows_data->id == active_window) {
-                            windows_data->take_screenshot();
-                            return;
-                        }
-                    }
-                }
-            }
-        }
-    }
-}
-
-void inotify_event_wakeup(App *app, int fd) {
-    /* Some systems cannot read integer variables if they are not
-              properly aligned. On other systems, incorrect alignment may
-              decrease performance. Hence, the buffer used for reading from
-              the inotify file descriptor should have the same alignment as
-              struct inotify_event. */
-    
-    char buf[4096]
-            __attribute__ ((aligned(__alignof__(struct inotify_event))));
-    const struct inotify_event *event;
-    ssize_t len;
-    
-    /* Loop while events can be read from inotify file descriptor. */
-    
-    bool update = false;
-    
-    for (;;) {
-        
-        /* Read some events. */
-        
-        len = read(fd, buf, sizeof(buf));
-        if (len == -1 && errno != EAGAIN) {
-            perror("read");
-            exit(EXIT_FAILURE);
-        }
-        
-        /* If the nonblocking read() found no events to read, then
-           it returns -1 with errno set to EAGAIN. In that case,
-           we exit the loop. */
-        
-        if (len <= 0)
-            break;
-        
-        /* Loop over all events in the buffer. */
-        
-        for (char *ptr = buf; ptr < buf + len;
-             ptr += sizeof(struct inotify_event) + event->len) {
-            
-            event = (const struct inotify_event *) ptr;
-            
-            /* Print event type. */
-            
-            if (event->mask & IN_OPEN)
-                printf("IN_OPEN: ");
-            if (event->mask & IN_CLOSE_NOWRITE)
-                printf("IN_CLOSE_NOWRITE: ");
-            if (event->mask & IN_CLOSE_WRITE)
-                printf("IN_CLOSE_WRITE: ");
-            if (event->mask & IN_MODIFY)
-                printf("IN_CLOSE_WRITE: ");
-            
-            /* Print the name of the watched directory. */
-            
-            if (inotify_status_fd == event->wd) {
-                update = true;
-            } else if (inotify_capacity_fd == event->wd) {
-                update = true;
-            }
-            /* Print the name of the file. */
-            
-            if (event->len)
-                printf("%s", event->name);
-            
-            /* Print type of filesystem object. */
-            
-            if (event->mask & IN_ISDIR)
-                printf(" [directory]\n");
-            else
-                printf(" [file]\n");
-        }
-    }
-
-//    update_battery(app);
+    if (auto registered = registered_window(active_window))
+        registered->windows_data->take_screenshot();
 }
 
 AppClient *
@@ -2513,28 +2406,49 @@ create_taskbar(App *app) {
     
     app_create_custom_event_handler(app, taskbar->window, taskbar_event_handler);
     app_create_custom_event_handler(app, INT_MAX, window_event_handler);
-    app_timeout_create(app, taskbar, 500, screenshot_active_window, nullptr);
+    thumbnails_start(app);
+    // Damaged windows are captured when they're shown instead
+    if (!thumbnails_damage_driven(app))
+        app_timeout_create(app, taskbar, 500, screenshot_active_window, nullptr);
     
     // Lay it out
     fill_root(app, taskbar, taskbar->root);
-    update_time(app, taskbar, nullptr, nullptr);
+    update_time(app, taskbar);
     update_active_window();
     
     load_pinned_icons();
     
+    return taskbar;
+}
+
+void taskbar_audio_started() {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    audio_started = true;
     if (audio_backend_data->audio_backend == Audio_Backend::PULSEAUDIO) {
         audio_update_list_of_clients();
     }
+    update_taskbar_volume_icon();
+}
+
+// The class a window is grouped by on the taskbar, lowercased
+static std::string
+class_name_from_reply(const xcb_icccm_get_wm_class_reply_t &wm_class) {
+    std::string name;
     
-    /*
-    inotify_fd = inotify_init1(IN_NONBLOCK);
-    if (inotify_fd != -1) {
-        inotify_status_fd = inotify_add_watch(inotify_fd, "/sys/class/power_supply/BAT0/status", IN_ALL_EVENTS);
-        inotify_capacity_fd = inotify_add_watch(inotify_fd, "/sys/class/power_supply/BAT0/capacity", IN_ALL_EVENTS);
-        poll_descriptor(app, inotify_fd, POLLIN, inotify_event_wakeup);
+    if (wm_class.class_name) {
+        name = std::string(wm_class.class_name);
+        if (name.empty() && wm_class.instance_name) {
+            name = std::string(wm_class.instance_name);
+        }
+    } else if (wm_class.instance_name) {
+        name = std::string(wm_class.instance_name);
     }
-    */
-    return taskbar;
+    
+    std::for_each(name.begin(), name.end(), [](char &c) { c = std::tolower(c); });
+    
+    return name;
 }
 
 std::string
@@ -2551,21 +2465,8 @@ class_name(App *app, xcb_window_t window) {
     } else if (r) {
         xcb_icccm_get_wm_class_reply_t wm_class;
         if (xcb_icccm_get_wm_class_from_reply(&wm_class, r)) {
-            std::string name;
-            
-            if (wm_class.class_name) {
-                name = std::string(wm_class.class_name);
-                if (name.empty()) {
-                    name = std::string(wm_class.instance_name);
-                }
-            } else if (wm_class.instance_name) {
-                name = std::string(wm_class.instance_name);
-            } else {
-            }
+            std::string name = class_name_from_reply(wm_class);
             xcb_icccm_get_wm_class_reply_wipe(&wm_class);
-            
-            std::for_each(name.begin(), name.end(), [](char &c) { c = std::tolower(c); });
-            
             return name;
         } else {
             std::free(r);
@@ -2596,43 +2497,242 @@ static inline void rtrim(std::string &s) {
                          std::not1(std::ptr_fun<int, int>(std::isspace))).base(), s.end());
 }
 
-void add_window(App *app, xcb_window_t window) {
+// Everything add_window needs to know about a window. They are fetched for a whole batch of
+// windows at once (see fetch_window_properties) so that many new windows, like when a session
+// is restored, cost a single round trip to the X server instead of a dozen each.
+struct WindowProperties {
+    xcb_window_t window = 0;
+    
+    // The window type is something a dock shouldn't display
+    bool unwanted_type = false;
+    // _NET_WM_STATE asks to be left off the taskbar
+    bool skip_taskbar = false;
+    
+    uint32_t pid = -1;
+    std::string class_name;
+    std::string title;
+    
+    bool has_wm_icon_name = false;
+    std::string wm_icon_name;
+    std::string net_wm_icon_name;
+    
+    bool has_gtk_application_id = false;
+    std::string gtk_application_id;
+    
+    bool has_frame_extents = false;
+    int frame_extents[4] = {0, 0, 0, 0};
+    
+    bool has_attributes = false;
+    bool mapped = false;
+    xcb_visualid_t visual = 0;
+    
+    bool has_geometry = false;
+    int width = 0;
+    int height = 0;
+};
+
+static std::vector<WindowProperties>
+fetch_window_properties(App *app, const std::vector<xcb_window_t> &windows) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    // Exit the function if the window type is not something a dock should display
-    xcb_get_property_cookie_t cookie = xcb_ewmh_get_wm_window_type_unchecked(&app->ewmh, window);
-    xcb_ewmh_get_atoms_reply_t atoms_reply_data;
-    if (xcb_ewmh_get_wm_window_type_reply(&app->ewmh, cookie, &atoms_reply_data, nullptr)) {
-        for (unsigned short i = 0; i < atoms_reply_data.atoms_len; i++) {
-            if (atoms_reply_data.atoms[i] == get_cached_atom(app, "_NET_WM_WINDOW_TYPE_DESKTOP")) {
-                xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data);
-                return;
-            } else if (atoms_reply_data.atoms[i] == get_cached_atom(app, "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU")) {
-                xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data);
-                return;
-            } else if (atoms_reply_data.atoms[i] == get_cached_atom(app, "_NET_WM_WINDOW_TYPE_POPUP_MENU")) {
-                xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data);
-                return;
-            } else if (atoms_reply_data.atoms[i] == get_cached_atom(app, "_NET_WM_WINDOW_TYPE_TOOLTIP")) {
-                xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data);
-                return;
-            } else if (atoms_reply_data.atoms[i] == get_cached_atom(app, "_NET_WM_WINDOW_TYPE_COMBO")) {
-                xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data);
-                return;
-            } else if (atoms_reply_data.atoms[i] == get_cached_atom(app, "_NET_WM_WINDOW_TYPE_DND")) {
-                xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data);
-                return;
-            } else if (atoms_reply_data.atoms[i] == get_cached_atom(app, "_NET_WM_WINDOW_TYPE_DOCK")) {
-                xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data);
-                return;
-            } else if (atoms_reply_data.atoms[i] == get_cached_atom(app, "_NET_WM_WINDOW_TYPE_NOTIFICATION")) {
-                xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data);
-                return;
+    struct Cookies {
+        xcb_get_property_cookie_t window_type;
+        xcb_get_property_cookie_t pid;
+        xcb_get_property_cookie_t wm_class;
+        xcb_get_property_cookie_t state;
+        xcb_get_property_cookie_t net_wm_name;
+        xcb_get_property_cookie_t wm_name;
+        xcb_get_property_cookie_t wm_icon_name;
+        xcb_get_property_cookie_t net_wm_icon_name;
+        xcb_get_property_cookie_t gtk_application_id;
+        xcb_get_property_cookie_t frame_extents;
+        xcb_get_window_attributes_cookie_t attributes;
+        xcb_get_geometry_cookie_t geometry;
+    };
+    
+    // Send every request for every window before waiting on any of the replies
+    std::vector<Cookies> cookies(windows.size());
+    for (int i = 0; i < windows.size(); i++) {
+        xcb_window_t window = windows[i];
+        Cookies &c = cookies[i];
+        c.window_type = xcb_ewmh_get_wm_window_type_unchecked(&app->ewmh, window);
+        c.pid = xcb_ewmh_get_wm_pid_unchecked(&app->ewmh, window);
+        c.wm_class = xcb_icccm_get_wm_class_unchecked(app->connection, window);
+        c.state = xcb_get_property_unchecked(app->connection, 0, window, get_cached_atom(app, KnownAtom::NET_WM_STATE),
+                                             XCB_ATOM_ATOM, 0, BUFSIZ);
+        c.net_wm_name = xcb_ewmh_get_wm_name_unchecked(&app->ewmh, window);
+        c.wm_name = xcb_icccm_get_wm_name_unchecked(app->connection, window);
+        c.wm_icon_name = xcb_icccm_get_wm_icon_name_unchecked(app->connection, window);
+        c.net_wm_icon_name = xcb_ewmh_get_wm_icon_name_unchecked(&app->ewmh, window);
+        c.gtk_application_id = xcb_icccm_get_text_property_unchecked(
+                app->connection, window, get_cached_atom(app, KnownAtom::GTK_APPLICATION_ID));
+        c.frame_extents = xcb_get_property_unchecked(app->connection, 0, window,
+                                                     get_cached_atom(app, KnownAtom::GTK_FRAME_EXTENTS),
+                                                     XCB_ATOM_CARDINAL, 0, 4);
+        c.attributes = xcb_get_window_attributes_unchecked(app->connection, window);
+        c.geometry = xcb_get_geometry_unchecked(app->connection, window);
+    }
+    
+    // Every reply has to be collected, even for windows that end up ignored, or xcb holds onto them
+    std::vector<WindowProperties> properties(windows.size());
+    for (int i = 0; i < windows.size(); i++) {
+        Cookies &c = cookies[i];
+        WindowProperties &p = properties[i];
+        p.window = windows[i];
+        
+        xcb_ewmh_get_atoms_reply_t atoms_reply_data;
+        if (xcb_ewmh_get_wm_window_type_reply(&app->ewmh, c.window_type, &atoms_reply_data, nullptr)) {
+            for (unsigned short a = 0; a < atoms_reply_data.atoms_len; a++) {
+                xcb_atom_t type = atoms_reply_data.atoms[a];
+                if (type == get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_DESKTOP) ||
+                    type == get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_DROPDOWN_MENU) ||
+                    type == get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_POPUP_MENU) ||
+                    type == get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_TOOLTIP) ||
+                    type == get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_COMBO) ||
+                    type == get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_DND) ||
+                    type == get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_DOCK) ||
+                    type == get_cached_atom(app, KnownAtom::NET_WM_WINDOW_TYPE_NOTIFICATION)) {
+                    p.unwanted_type = true;
+                }
+            }
+            xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data);
+        }
+        
+        xcb_ewmh_get_wm_pid_reply(&app->ewmh, c.pid, &p.pid, nullptr);
+        
+        xcb_icccm_get_wm_class_reply_t wm_class;
+        if (xcb_icccm_get_wm_class_reply(app->connection, c.wm_class, &wm_class, nullptr)) {
+            p.class_name = class_name_from_reply(wm_class);
+            xcb_icccm_get_wm_class_reply_wipe(&wm_class);
+        }
+        
+        if (auto reply = xcb_get_property_reply(app->connection, c.state, nullptr)) {
+            if (reply->type == XCB_ATOM_ATOM) {
+                auto *state_atoms = (xcb_atom_t *) xcb_get_property_value(reply);
+                int state_count = xcb_get_property_value_length(reply) / sizeof(xcb_atom_t);
+                for (int a = 0; a < state_count; a++) {
+                    // TODO: on first launch xterm has this true????
+                    if (state_atoms[a] == get_cached_atom(app, KnownAtom::NET_WM_STATE_SKIP_TASKBAR) ||
+                        state_atoms[a] == get_cached_atom(app, KnownAtom::NET_WM_STATE_SKIP_PAGER)) {
+                        p.skip_taskbar = true;
+                    }
+                }
+            }
+            free(reply);
+        }
+        
+        xcb_ewmh_get_utf8_strings_reply_t utf8_reply;
+        if (xcb_ewmh_get_wm_name_reply(&app->ewmh, c.net_wm_name, &utf8_reply, nullptr))
+            p.title = get_reply_string(&utf8_reply);
+        
+        xcb_icccm_get_text_property_reply_t text_reply;
+        if (xcb_icccm_get_wm_name_reply(app->connection, c.wm_name, &text_reply, nullptr)) {
+            if (p.title.empty())
+                p.title = std::string(text_reply.name, text_reply.name_len);
+            xcb_icccm_get_text_property_reply_wipe(&text_reply);
+        }
+        
+        if (xcb_icccm_get_wm_icon_name_reply(app->connection, c.wm_icon_name, &text_reply, nullptr)) {
+            p.has_wm_icon_name = true;
+            p.wm_icon_name = std::string(text_reply.name, text_reply.name_len);
+            xcb_icccm_get_text_property_reply_wipe(&text_reply);
+        }
+        
+        if (xcb_ewmh_get_wm_icon_name_reply(&app->ewmh, c.net_wm_icon_name, &utf8_reply, nullptr))
+            p.net_wm_icon_name = get_reply_string(&utf8_reply);
+        
+        if (xcb_icccm_get_text_property_reply(app->connection, c.gtk_application_id, &text_reply, nullptr)) {
+            p.has_gtk_application_id = true;
+            p.gtk_application_id = std::string(text_reply.name, text_reply.name_len);
+            xcb_icccm_get_text_property_reply_wipe(&text_reply);
+        }
+        
+        if (auto reply = xcb_get_property_reply(app->connection, c.frame_extents, nullptr)) {
+            if (xcb_get_property_value_length(reply) >= 4 * sizeof(uint32_t)) {
+                auto gtkFrameExtents = static_cast<uint32_t *>(xcb_get_property_value(reply));
+                p.has_frame_extents = true;
+                for (int e = 0; e < 4; e++)
+                    p.frame_extents[e] = (int) gtkFrameExtents[e];
             }
+            free(reply);
         }
-        xcb_ewmh_get_atoms_reply_wipe(&atoms_reply_data);
+        
+        if (auto attributes = xcb_get_window_attributes_reply(app->connection, c.attributes, nullptr)) {
+            p.has_attributes = true;
+            p.mapped = attributes->map_state == XCB_MAP_STATE_VIEWABLE;
+            p.visual = attributes->visual;
+            free(attributes);
+        }
+        
+        if (auto geometry = xcb_get_geometry_reply(app->connection, c.geometry, nullptr)) {
+            p.has_geometry = true;
+            p.width = geometry->width;
+            p.height = geometry->height;
+            free(geometry);
+        }
+    }
+    
+    return properties;
+}
+
+struct CachedCommandLine {
+    long started = 0;
+    std::string line;
+};
+
+// Windows of the same process (and the same process showing up in every stacking update) don't re-read /proc
+static std::unordered_map<uint32_t, CachedCommandLine> command_line_cache;
+
+// What the process was launched with, arguments separated by spaces
+static std::string
+process_command_line(uint32_t pid) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::string proc_path = "/proc/" + std::to_string(pid);
+    struct stat st{};
+    if (stat(proc_path.c_str(), &st) != 0)
+        return "";
+    
+    // pids get reused, but the new process gets a new /proc entry
+    long started = st.st_ctim.tv_sec * 1000000000L + st.st_ctim.tv_nsec;
+    auto it = command_line_cache.find(pid);
+    if (it != command_line_cache.end() && it->second.started == started)
+        return it->second.line;
+    
+    std::string line;
+    int fd = open((proc_path + "/cmdline").c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        char buffer[4096];
+        ssize_t bytes_read;
+        while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0)
+            line.append(buffer, bytes_read);
+        close(fd);
     }
+    std::replace(line.begin(), line.end(), '\000', ' ');
+    rtrim(line);
+    
+    if (command_line_cache.size() > 512)
+        command_line_cache.clear();
+    command_line_cache[pid] = {started, line};
+    return line;
+}
+
+static void
+add_fetched_window(App *app, const WindowProperties &properties) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    xcb_window_t window = properties.window;
+    
+    // Already has an icon
+    if (registered_window(window))
+        return;
+    
+    // Exit the function if the window type is not something a dock should display
+    if (properties.unwanted_type)
+        return;
     
     // on gnome, the Extension app ends up adding the taskbar to the taskbar. I have no idea how it's doing that
     // but the fix for now is just going to be to ignore every client that is ours. Eventually when we make a settings
@@ -2643,11 +2743,6 @@ void add_window(App *app, xcb_window_t window) {
         }
     }
     
-    auto cookie_get_wm_desktop = xcb_ewmh_get_wm_desktop(&app->ewmh, window);
-    uint32_t desktop = 0;
-    xcb_ewmh_get_wm_desktop_from_reply(&desktop, NULL);
-    
-    std::vector<xcb_window_t> old_windows;
     AppClient *client = client_by_name(app, "taskbar");
     if (!client)
         return;
@@ -2658,31 +2753,12 @@ void add_window(App *app, xcb_window_t window) {
     if (!icons)
         return;
     
-    xcb_get_property_cookie_t prop_cookie = xcb_ewmh_get_wm_pid(&app->ewmh, window);
-    uint32_t pid = -1;
-    xcb_ewmh_get_wm_pid_reply(&app->ewmh, prop_cookie, &pid, NULL);
+    uint32_t pid = properties.pid;
     std::string command_launched_by_line;
-    if (pid != -1) {
-        std::ifstream cmdline("/proc/" + std::to_string(pid) + "/cmdline");
-        std::getline((cmdline), command_launched_by_line);
+    if (pid != -1)
+        command_launched_by_line = process_command_line(pid);
         
-        size_t index = 0;
-        while (true) {
-            /* Locate the substring to replace. */
-            index = command_launched_by_line.find('\000', index);
-            if (index == std::string::npos)
-                break;
-            
-            /* Make the replacement. */
-            command_launched_by_line.replace(index, 1, " ");
-            
-            /* Advance index forward so the next iteration doesn't pick it up as well. */
-            index += 1;
-        }
-    }
-    rtrim(command_launched_by_line);
-    
-    std::string window_class_name = class_name(app, window);
+    std::string window_class_name = properties.class_name;
     if (window_class_name.empty()) {
         window_class_name = command_launched_by_line;
         if (window_class_name.empty())
@@ -2698,40 +2774,16 @@ void add_window(App *app, xcb_window_t window) {
             xcb_change_window_attributes(app->connection, window, XCB_CW_EVENT_MASK, values);
             xcb_flush(app->connection);
             
-            data->windows_data_list.push_back(new WindowsData(app, window));
-            update_window_title_name(window);
+            data->windows_data_list.push_back(new WindowsData(app, properties));
+            window_registry[window] = {icon, data, data->windows_data_list.back()};
             update_minimize_icon_positions();
             request_refresh(app, client);
             return;
         }
     }
     
-    xcb_generic_error_t *err = nullptr;
-    cookie = xcb_get_property(app->connection, 0, window, get_cached_atom(app, "_NET_WM_STATE"), XCB_ATOM_ATOM, 0,
-                              BUFSIZ);
-    xcb_get_property_reply_t *reply = xcb_get_property_reply(app->connection, cookie, &err);
-    if (reply) {
-        if (reply->type == XCB_ATOM_ATOM) {
-            xcb_atom_t *state_atoms = (xcb_atom_t *) xcb_get_property_value(reply);
-            for (unsigned int a = 0; a < sizeof(xcb_atom_t); a++) {
-                // TODO: on first launch xterm has this true????
-                if (state_atoms[a] == get_cached_atom(app, "_NET_WM_STATE_SKIP_TASKBAR")) {
-                    free(reply);
-                    return;
-                } else if (state_atoms[a] == get_cached_atom(app, "_NET_WM_STATE_SKIP_PAGER")) {
-                    free(reply);
-                    return;
-                } else if (state_atoms[a] ==
-                           get_cached_atom(app, "_NET_WM_STATE_DEMANDS_ATTENTION")) {
-                }
-            }
-        }
-        free(reply);
-    }
-    if (err) {
-        free(err);
-        err = nullptr;
-    }
+    if (properties.skip_taskbar)
+        return;
     
     const uint32_t values[] = {XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_PROPERTY_CHANGE};
     xcb_change_window_attributes(app->connection, window, XCB_CW_EVENT_MASK, values);
@@ -2747,11 +2799,11 @@ void add_window(App *app, xcb_window_t window) {
     a->when_drag_start = pinned_icon_drag_start;
     a->when_drag = pinned_icon_drag;
     LaunchableButton *data = new LaunchableButton();
-    data->windows_data_list.push_back(new WindowsData(app, window));
+    data->windows_data_list.push_back(new WindowsData(app, properties));
     data->class_name = window_class_name;
     data->icon_name = window_class_name;
     a->user_data = data;
-    update_window_title_name(window);
+    window_registry[window] = {a, data, data->windows_data_list.back()};
     
     if (pid != -1) {
         data->has_launchable_info = true;
@@ -2761,14 +2813,10 @@ void add_window(App *app, xcb_window_t window) {
     std::string path;
     std::string icon_name;
     
-    auto get_wm_icon_name_cookie = xcb_icccm_get_wm_icon_name(app->connection, window);
-    xcb_icccm_get_text_property_reply_t prop;
-    uint8_t success = xcb_icccm_get_wm_icon_name_reply(app->connection, get_wm_icon_name_cookie, &prop, nullptr);
-    if (success) {
-        icon_name = prop.name;
-        xcb_icccm_get_text_property_reply_wipe(&prop);
+    if (properties.has_wm_icon_name) {
+        icon_name = properties.wm_icon_name;
     } else {
-        icon_name = get_icon_name(window);
+        icon_name = properties.net_wm_icon_name;
     }
     if (!icon_name.empty()) {
         std::vector<IconTarget> targets;
@@ -2778,21 +2826,13 @@ void add_window(App *app, xcb_window_t window) {
         path = targets[0].best_full_path;
         data->icon_name = icon_name;
     }
-    if (path.empty()) {
-        xcb_generic_error_t *error = NULL;
-        xcb_get_property_cookie_t c = xcb_icccm_get_text_property_unchecked(app->connection, window,
-                                                                            get_cached_atom(app,
-                                                                                            "_GTK_APPLICATION_ID"));
-        xcb_icccm_get_text_property_reply_t props;
-        if (xcb_icccm_get_text_property_reply(app->connection, c, &props, nullptr)) {
-            data->icon_name = std::string(props.name, props.name_len);
-            std::vector<IconTarget> targets;
-            targets.emplace_back(IconTarget(data->icon_name));
-            search_icons(targets);
-            pick_best(targets, 24 * config->dpi);
-            path = targets[0].best_full_path;
-            xcb_icccm_get_text_property_reply_wipe(&props);
-        }
+    if (path.empty() && properties.has_gtk_application_id) {
+        data->icon_name = properties.gtk_application_id;
+        std::vector<IconTarget> targets;
+        targets.emplace_back(IconTarget(data->icon_name));
+        search_icons(targets);
+        pick_best(targets, 24 * config->dpi);
+        path = targets[0].best_full_path;
     }
     if (path.empty()) {
         std::vector<IconTarget> targets;
@@ -2869,11 +2909,27 @@ void add_window(App *app, xcb_window_t window) {
     request_refresh(app, client);
 }
 
+static void
+add_windows(App *app, const std::vector<xcb_window_t> &windows) {
+    std::vector<xcb_window_t> unknown_windows;
+    for (auto window: windows)
+        if (!registered_window(window))
+            unknown_windows.push_back(window);
+    if (unknown_windows.empty())
+        return;
+    for (const auto &properties: fetch_window_properties(app, unknown_windows))
+        add_fetched_window(app, properties);
+}
+
+void add_window(App *app, xcb_window_t window) {
+    add_windows(app, {window});
+}
+
 void remove_window(App *app, xcb_window_t window) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    
+
     std::vector<xcb_window_t> old_windows;
     AppClient *entity = client_by_name(app, "taskbar");
     if (!entity)
@@ -2884,60 +2940,60 @@ void remove_window(App *app, xcb_window_t window) {
     auto *icons = container_by_name("icons", root);
     if (!icons)
         return;
-    
-    for (int j = 0; j < icons->children.size(); j++) {
-        Container *container = icons->children[j];
-        LaunchableButton *data = (LaunchableButton *) container->user_data;
-        for (int i = 0; i < data->windows_data_list.size(); i++) {
-            if (data->windows_data_list[i]->id == window) {
-                if (auto windows_selector_client = client_by_name(app, "windows_selector")) {
-                    if (auto windows_selector_container = container_by_name(std::to_string(window),
-                                                                            windows_selector_client->root)) {
-                        auto sub_width = windows_selector_container->real_bounds.w;
-                        
-                        auto parent = windows_selector_container->parent;
-                        for (int i = 0; i < parent->children.size(); i++) {
-                            if (parent->children[i] == windows_selector_container) {
-                                parent->children.erase(parent->children.begin() + i);
-                                break;
-                            }
-                        }
-                        
-                        delete windows_selector_container;
-                        
-                        if (parent->children.empty()) {
-                            client_close(app, windows_selector_client);
-                            app->grab_window = -1;
-                        } else {
-                            int width = windows_selector_client->root->real_bounds.w - sub_width;
-                            
-                            double x = container->real_bounds.x - width / 2 + container->real_bounds.w / 2;
-                            if (x < 0) {
-                                x = 0;
-                            }
-                            double y = app->bounds.h - option_height - config->taskbar_height;
-                            double h = option_height;
-                            
-                            handle_configure_notify(app, windows_selector_client, x, y, width, h);
-                            client_set_position_and_size(app, windows_selector_client, x, y, width, h);
-                        }
+
+    if (auto registered = registered_window(window)) {
+        Container *container = registered->icon;
+        LaunchableButton *data = registered->button;
+        WindowsData *windows_data = registered->windows_data;
+        window_registry.erase(window);
+
+        if (auto windows_selector_client = client_by_name(app, "windows_selector")) {
+            if (auto windows_selector_container = container_by_name(std::to_string(window),
+                                                                    windows_selector_client->root)) {
+                auto sub_width = windows_selector_container->real_bounds.w;
+
+                auto parent = windows_selector_container->parent;
+                for (int i = 0; i < parent->children.size(); i++) {
+                    if (parent->children[i] == windows_selector_container) {
+                        parent->children.erase(parent->children.begin() + i);
+                        break;
                     }
                 }
-                
-                delete data->windows_data_list[i];
-                data->windows_data_list.erase(data->windows_data_list.begin() + i);
-                
-                if (data->windows_data_list.empty() && !data->pinned) {
-                    if (active_container == container)
-                        active_container = nullptr;
-                    icons->children.erase(icons->children.begin() + j);
-                    delete container;
+
+                delete windows_selector_container;
+
+                if (parent->children.empty()) {
+                    client_close(app, windows_selector_client);
+                    app->grab_window = -1;
+                } else {
+                    int width = windows_selector_client->root->real_bounds.w - sub_width;
+
+                    double x = container->real_bounds.x - width / 2 + container->real_bounds.w / 2;
+                    if (x < 0) {
+                        x = 0;
+                    }
+                    double y = app->bounds.h - option_height - config->taskbar_height;
+                    double h = option_height;
+
+                    handle_configure_notify(app, windows_selector_client, x, y, width, h);
+                    client_set_position_and_size(app, windows_selector_client, x, y, width, h);
                 }
-                break;
             }
         }
+
+        auto &list = data->windows_data_list;
+        list.erase(std::remove(list.begin(), list.end(), windows_data), list.end());
+        delete windows_data;
+
+        if (data->windows_data_list.empty() && !data->pinned) {
+            if (active_container == container)
+                active_container = nullptr;
+            icons->children.erase(std::remove(icons->children.begin(), icons->children.end(), container),
+                                  icons->children.end());
+            delete container;
+        }
     }
-    
+
     // TODO: mark handler as remove at end of loop
     //    for (int i = 0; i < app->handlers.size(); i++) {
     //        if (app->handlers[i]->target_window == window) {
@@ -2945,23 +3001,30 @@ void remove_window(App *app, xcb_window_t window) {
     //            app->handlers.erase(app->handlers.begin() + i);
     //        }
     //    }
-    
+
     update_pinned_items_file(false);
     icons_align(entity, icons, false);
     request_refresh(app, entity);
 }
 
+// Listens for property changes on a window add_window turned down, so it can be let in if it changes its mind
+static void
+reject_window(App *app, xcb_window_t window) {
+    // Our own windows already have the event mask we want, and changing it would replace it
+    for (auto c: app->clients)
+        if (c->window == window)
+            return;
+    if (!rejected_windows.insert(window).second)
+        return;
+    const uint32_t values[] = {XCB_EVENT_MASK_PROPERTY_CHANGE};
+    xcb_change_window_attributes(app->connection, window, XCB_CW_EVENT_MASK, values);
+    xcb_flush(app->connection);
+}
+
 void stacking_order_changed(xcb_window_t *all_windows, int windows_count) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    
-    std::vector<xcb_window_t> new_windows;
-    for (int i = 0; i < windows_count; i++) {
-        new_windows.push_back(all_windows[i]);
-    }
-    
-    std::vector<xcb_window_t> old_windows;
     AppClient *entity = client_by_name(app, "taskbar");
     if (!entity)
         return;
@@ -2972,33 +3035,59 @@ void stacking_order_changed(xcb_window_t *all_windows, int windows_count) {
     if (!icons)
         return;
     
+    std::vector<xcb_window_t> sorted_windows(all_windows, all_windows + windows_count);
+    std::sort(sorted_windows.begin(), sorted_windows.end());
+    
+    // Only windows that weren't in the last list are new
+    std::vector<xcb_window_t> new_windows;
+    for (int i = 0; i < windows_count; i++) {
+        if (!std::binary_search(last_stacking_windows.begin(), last_stacking_windows.end(), all_windows[i]))
+            new_windows.push_back(all_windows[i]);
+    }
+    add_windows(app, new_windows);
+    for (auto window: new_windows)
+        if (!registered_window(window))
+            reject_window(app, window);
+    for (auto it = rejected_windows.begin(); it != rejected_windows.end();) {
+        if (std::binary_search(sorted_windows.begin(), sorted_windows.end(), *it)) {
+            ++it;
+        } else {
+            it = rejected_windows.erase(it);
+        }
+    }
+    
+    std::vector<xcb_window_t> removed_windows;
+    for (const auto &[window, registered]: window_registry)
+        if (!std::binary_search(sorted_windows.begin(), sorted_windows.end(), window))
+            removed_windows.push_back(window);
+    for (auto window: removed_windows)
+        remove_window(app, window);
+    
+    // Keep the windows of each icon ordered from the top of the stack down
+    std::unordered_map<xcb_window_t, int> stacking_position;
+    stacking_position.reserve(windows_count);
+    for (int i = 0; i < windows_count; i++)
+        stacking_position[all_windows[i]] = i;
+    auto higher_in_stack = [&stacking_position](WindowsData *a, WindowsData *b) {
+        auto a_position = stacking_position.find(a->id);
+        auto b_position = stacking_position.find(b->id);
+        int a_index = a_position == stacking_position.end() ? -1 : a_position->second;
+        int b_index = b_position == stacking_position.end() ? -1 : b_position->second;
+        return a_index > b_index;
+    };
+    bool reordered = false;
     for (auto icon: icons->children) {
         auto *data = static_cast<LaunchableButton *>(icon->user_data);
-        for (auto window_data: data->windows_data_list) {
-            old_windows.emplace_back(window_data->id);
-        }
-    }
-    
-    for (auto new_window: new_windows) {
-        bool found = false;
-        for (auto old_window: old_windows)
-            if (old_window == new_window)
-                found = true;
-        if (!found) {
-            add_window(app, new_window);
+        auto &list = data->windows_data_list;
+        if (list.size() > 1 && !std::is_sorted(list.begin(), list.end(), higher_in_stack)) {
+            std::stable_sort(list.begin(), list.end(), higher_in_stack);
+            reordered = true;
         }
     }
+    if (reordered)
+        request_refresh(app, entity);
     
-    for (int i = 0; i < old_windows.size(); i++) {
-        xcb_window_t old_window = old_windows[i];
-        bool found = false;
-        for (auto new_window: new_windows)
-            if (old_window == new_window)
-                found = true;
-        if (!found) {
-            remove_window(app, old_window);
-        }
-    }
+    last_stacking_windows = std::move(sorted_windows);
 }
 
 void remove_non_pinned_icons() {
@@ -3134,8 +3223,298 @@ void update_pinned_items_file(bool force_update) {
     }
 }
 
+// Pinned icons are the slow part of building the taskbar (searching the icon cache and
+// rasterizing svgs) so when the taskbar closes their pixels are saved along with a hash
+// of the items.ini they came from. If the hash and icon size still match on the next
+// start, the icons are painted straight from the snapshot and the real icon lookup is
+// done after the taskbar is already on screen, replacing only the icons that changed.
+
+static const char taskbar_snapshot_magic[4] = {'W', 'B', 'T', 'S'};
+static const uint32_t taskbar_snapshot_version = 1;
+
+struct TaskbarSnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t items_hash;
+    uint32_t icon_size;
+    uint32_t count;
+};
+
+struct TaskbarSnapshotIcon {
+    uint32_t path_length;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+};
+
+struct SnapshotIcon {
+    std::string path;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    std::string pixels;
+};
+
+static std::string
+taskbar_snapshot_path() {
+    const char *home = getenv("HOME");
+    std::string path(home);
+    path += "/.cache/winbar_taskbar_snapshot/taskbar.snapshot";
+    return path;
+}
+
+static uint64_t
+items_file_hash(const std::string &items_path) {
+    std::ifstream file(items_path, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    uint64_t hash = 14695981039346656037ull;
+    for (char c: contents) {
+        hash ^= (uint8_t) c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string
+items_file_path() {
+    const char *home = getenv("HOME");
+    std::string path(home);
+    path += "/.config/winbar/items.ini";
+    return path;
+}
+
+static bool
+read_taskbar_snapshot(uint64_t items_hash, int icon_size, std::vector<SnapshotIcon> *icons) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::ifstream file(taskbar_snapshot_path(), std::ios::binary);
+    if (!file.is_open())
+        return false;
+    TaskbarSnapshotHeader header{};
+    if (!file.read((char *) &header, sizeof(header)))
+        return false;
+    if (memcmp(header.magic, taskbar_snapshot_magic, sizeof(taskbar_snapshot_magic)) != 0 ||
+        header.version != taskbar_snapshot_version || header.items_hash != items_hash ||
+        header.icon_size != icon_size) {
+        return false;
+    }
+    for (int i = 0; i < header.count; i++) {
+        TaskbarSnapshotIcon record{};
+        if (!file.read((char *) &record, sizeof(record)))
+            return false;
+        if (record.width != icon_size || record.height != icon_size || record.stride < record.width * 4 ||
+            record.path_length > 4096) {
+            return false;
+        }
+        SnapshotIcon icon;
+        icon.width = record.width;
+        icon.height = record.height;
+        icon.stride = record.stride;
+        icon.path.resize(record.path_length);
+        icon.pixels.resize((size_t) record.stride * record.height);
+        if (!file.read(icon.path.data(), icon.path.size()) || !file.read(icon.pixels.data(), icon.pixels.size()))
+            return false;
+        icons->push_back(std::move(icon));
+    }
+    return true;
+}
+
+static void
+write_taskbar_snapshot(AppClient *client) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto *icons = container_by_name("icons", client->root);
+    if (!icons)
+        return;
+    
+    std::string path = taskbar_snapshot_path();
+    std::string directory = path.substr(0, path.find_last_of('/'));
+    std::string cache_directory = directory.substr(0, directory.find_last_of('/'));
+    for (const auto &dir: {cache_directory, directory}) {
+        if (mkdir(dir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1) {
+            if (errno != EEXIST) {
+                printf("Couldn't mkdir %s\n", dir.c_str());
+                return;
+            }
+        }
+    }
+    
+    std::vector<LaunchableButton *> pinned;
+    for (auto icon: icons->children) {
+        auto *data = static_cast<LaunchableButton *>(icon->user_data);
+        if (data && data->pinned) {
+            if (!data->surface || cairo_image_surface_get_data(data->surface) == nullptr)
+                return;
+            pinned.push_back(data);
+        }
+    }
+    
+    TaskbarSnapshotHeader header{};
+    memcpy(header.magic, taskbar_snapshot_magic, sizeof(taskbar_snapshot_magic));
+    header.version = taskbar_snapshot_version;
+    header.items_hash = items_file_hash(items_file_path());
+    header.icon_size = 24 * config->dpi;
+    header.count = pinned.size();
+    
+    std::string temp_path = path + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return;
+    file.write((const char *) &header, sizeof(header));
+    for (auto data: pinned) {
+        cairo_surface_flush(data->surface);
+        TaskbarSnapshotIcon record{};
+        record.path_length = data->surface_path.size();
+        record.width = cairo_image_surface_get_width(data->surface);
+        record.height = cairo_image_surface_get_height(data->surface);
+        record.stride = cairo_image_surface_get_stride(data->surface);
+        file.write((const char *) &record, sizeof(record));
+        file.write(data->surface_path.data(), data->surface_path.size());
+        file.write((const char *) cairo_image_surface_get_data(data->surface), (size_t) record.stride * record.height);
+    }
+    file.close();
+    rename(temp_path.c_str(), path.c_str());
+}
+
+// What a pinned icon's file is looked up by, copied out so the lookup can be done off the main thread
+struct PinnedIconNames {
+    std::string user_icon_name;
+    std::string icon_name;
+    std::string class_name;
+};
+
+static std::vector<PinnedIconNames>
+pinned_icon_names(const std::vector<LaunchableButton *> &pinned) {
+    std::vector<PinnedIconNames> names;
+    for (auto data: pinned)
+        names.push_back({data->user_icon_name, data->icon_name, data->class_name});
+    return names;
+}
+
+// Finds the best icon file for each pinned icon, empty if there wasn't one
+static std::vector<std::string>
+pinned_icon_paths(const std::vector<PinnedIconNames> &pinned) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::vector<IconTarget> targets;
+    for (int i = 0; i < pinned.size(); i++) {
+        for (const auto &name: {pinned[i].user_icon_name, pinned[i].icon_name, pinned[i].class_name}) {
+            if (!name.empty()) {
+                int *mem_i = new int;
+                *mem_i = i;
+                targets.emplace_back(IconTarget(name, mem_i));
+            }
+        }
+    }
+    search_icons(targets);
+    pick_best(targets, 24 * config->dpi);
+    
+    std::vector<std::string> paths(pinned.size());
+    for (int i = 0; i < pinned.size(); i++) {
+        for (int x = 0; x < targets.size(); x++) {
+            if (*((int *) targets[x].user_data) == i) {
+                paths[i] = targets[x].best_full_path;
+                break;
+            }
+        }
+    }
+    
+    for (int x = 0; x < targets.size(); x++)
+        delete ((int *) targets[x].user_data);
+    return paths;
+}
+
+// Can be nullptr
+static cairo_surface_t *
+pinned_icon_surface(AppClient *client_entity, const std::string &class_name, const std::string &path) {
+    cairo_surface_t *surface = nullptr;
+    if (!path.empty()) {
+        load_icon_full_path(app, client_entity, &surface, path, 24 * config->dpi);
+    } else {
+        surface = accelerated_surface(app, client_entity, 24 * config->dpi, 24 * config->dpi);
+        if (!surface)
+            return nullptr;
+        char *string = getenv("HOME");
+        std::string home(string);
+        home += "/.config/winbar/cached_icons/" + class_name + ".png";
+        bool b = paint_surface_with_image(surface, home, 24 * config->dpi, nullptr);
+        if (!b) {
+            paint_surface_with_image(
+                    surface, as_resource_path("unknown-24.svg"), 24 * config->dpi, nullptr);
+        }
+    }
+    return surface;
+}
+
+static void
+load_pinned_icon_surface(AppClient *client_entity, LaunchableButton *data, const std::string &path) {
+    if (data->surface)
+        cairo_surface_destroy(data->surface);
+    data->surface = pinned_icon_surface(client_entity, data->class_name, path);
+    data->surface_path = path;
+}
+
+// Does the icon lookup that was skipped because the pinned icons came from the snapshot. It runs on its own
+// thread, and only takes app->thread_mutex at the end to swap in the icons that changed.
+static void
+reconcile_pinned_icons(AppClient *client, std::vector<LaunchableButton *> pinned, std::vector<PinnedIconNames> names,
+                       std::vector<std::string> snapshot_paths) {
+#ifdef TRACY_ENABLE
+    tracy::SetThreadName("Pinned Icons Thread");
+    ZoneScoped;
+#endif
+    auto paths = pinned_icon_paths(names);
+    std::vector<cairo_surface_t *> surfaces(pinned.size(), nullptr);
+    bool changed = false;
+    for (int i = 0; i < pinned.size(); i++) {
+        if (paths[i] != snapshot_paths[i]) {
+            surfaces[i] = pinned_icon_surface(client, names[i].class_name, paths[i]);
+            changed = true;
+        }
+    }
+    if (!changed)
+        return;
+    
+    // The taskbar closing joins this thread while holding thread_mutex, so waiting on it could deadlock
+    std::unique_lock lock(app->thread_mutex, std::defer_lock);
+    while (!pinned_icons_reconciler_cancelled && !lock.try_lock())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    Container *icons = nullptr;
+    if (lock.owns_lock() && !pinned_icons_reconciler_cancelled)
+        icons = container_by_name("icons", client->root);
+    
+    for (int i = 0; i < pinned.size(); i++) {
+        if (!surfaces[i] && paths[i] == snapshot_paths[i])
+            continue;
+        bool still_there = false;
+        if (icons) {
+            for (auto icon: icons->children)
+                if (icon->user_data == pinned[i])
+                    still_there = true;
+        }
+        // Unpinned, or given a different icon, while we were looking
+        if (!still_there || !pinned[i]->pinned || pinned[i]->surface_path != snapshot_paths[i]) {
+            if (surfaces[i])
+                cairo_surface_destroy(surfaces[i]);
+            continue;
+        }
+        if (pinned[i]->surface)
+            cairo_surface_destroy(pinned[i]->surface);
+        pinned[i]->surface = surfaces[i];
+        pinned[i]->surface_path = paths[i];
+    }
+    if (icons)
+        request_refresh(app, client);
+}
+
 static void
 load_pinned_icons() {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
     AppClient *client_entity = client_by_name(app, "taskbar");
     auto *root = client_entity->root;
     if (!root)
@@ -3171,34 +3550,11 @@ load_pinned_icons() {
     if (itemFile.ParseError() != 0)
         return;
     
-    std::vector<IconTarget> targets;
-    int i = 0;
-    for (const std::string &section_title: itemFile.Sections()) {
-        auto user_icon_name = itemFile.Get(section_title, "user_icon_name", "");
-        auto icon_name = itemFile.Get(section_title, "icon_name", "");
-        auto class_name = itemFile.Get(section_title, "class_name", "");
-        
-        if (!user_icon_name.empty()) {
-            int *mem_i = new int;
-            *mem_i = i;
-            targets.emplace_back(IconTarget(user_icon_name, mem_i));
-        }
-        if (!icon_name.empty()) {
-            int *mem_i = new int;
-            *mem_i = i;
-            targets.emplace_back(IconTarget(icon_name, mem_i));
-        }
-        if (!class_name.empty()) {
-            int *mem_i = new int;
-            *mem_i = i;
-            targets.emplace_back(IconTarget(class_name, mem_i));
-        }
-        i++;
-    }
-    search_icons(targets);
-    pick_best(targets, 24 * config->dpi);
+    std::vector<SnapshotIcon> snapshot;
+    bool from_snapshot = read_taskbar_snapshot(items_file_hash(itemsPath), 24 * config->dpi, &snapshot) &&
+                         snapshot.size() == itemFile.Sections().size();
     
-    i = 0;
+    std::vector<LaunchableButton *> pinned;
     for (const std::string &section_title: itemFile.Sections()) {
         auto *child = new Container();
         child->parent = icons;
@@ -3225,37 +3581,65 @@ load_pinned_icons() {
             data->command_launched_by = command;
         }
         
-        std::string path;
-        for (int x = 0; x < targets.size(); x++) {
-            if (*((int *) targets[x].user_data) == i) {
-                path = targets[x].best_full_path;
-                break;
-            }
-        }
-        
-        if (!path.empty()) {
-            load_icon_full_path(app, client_entity, &data->surface, path, 24 * config->dpi);
-        } else {
-            data->surface = accelerated_surface(app, client_entity, 24 * config->dpi, 24 * config->dpi);
-            char *string = getenv("HOME");
-            std::string home(string);
-            home += "/.config/winbar/cached_icons/" + data->class_name + ".png";
-            bool b = paint_surface_with_image(data->surface, home, 24 * config->dpi, nullptr);
-            if (!b) {
-                paint_surface_with_image(
-                        data->surface, as_resource_path("unknown-24.svg"), 24 * config->dpi, nullptr);
-            }
-        }
-        
         child->user_data = data;
         
         icons->children.push_back(child);
-        
-        i++;
+        pinned.push_back(data);
+    }
+    
+    if (from_snapshot) {
+        std::vector<std::string> snapshot_paths;
+        for (int i = 0; i < pinned.size(); i++) {
+            auto &icon = snapshot[i];
+            auto *data = pinned[i];
+            data->surface_path = icon.path;
+            snapshot_paths.push_back(icon.path);
+            // read_taskbar_snapshot only lets through records the size of an icon, but the surface can still fail
+            data->surface = accelerated_surface(app, client_entity, icon.width, icon.height);
+            unsigned char *pixels = nullptr;
+            if (data->surface) {
+                cairo_surface_flush(data->surface);
+                pixels = cairo_image_surface_get_data(data->surface);
+            }
+            if (!pixels || cairo_image_surface_get_width(data->surface) != icon.width ||
+                cairo_image_surface_get_height(data->surface) != icon.height ||
+                cairo_image_surface_get_stride(data->surface) < icon.width * 4) {
+                load_pinned_icon_surface(client_entity, data, icon.path);
+                continue;
+            }
+            int stride = cairo_image_surface_get_stride(data->surface);
+            for (int y = 0; y < icon.height; y++)
+                memcpy(pixels + y * stride, icon.pixels.data() + y * icon.stride, icon.width * 4);
+            cairo_surface_mark_dirty(data->surface);
+        }
+        pinned_snapshot_paths = std::move(snapshot_paths);
     }
+    pinned_awaiting_icons = std::move(pinned);
+    pinned_from_snapshot = from_snapshot;
+}
+
+void taskbar_icons_loaded() {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto pinned = std::move(pinned_awaiting_icons);
+    auto snapshot_paths = std::move(pinned_snapshot_paths);
+    pinned_awaiting_icons.clear();
+    pinned_snapshot_paths.clear();
+    AppClient *client_entity = client_by_name(app, "taskbar");
+    if (!client_entity || pinned.empty())
+        return;
     
-    for (int x = 0; x < targets.size(); x++)
-        delete ((int *) targets[x].user_data);
+    if (pinned_from_snapshot) {
+        pinned_icons_reconciler_cancelled = false;
+        pinned_icons_reconciler = std::thread(reconcile_pinned_icons, client_entity, pinned, pinned_icon_names(pinned),
+                                              snapshot_paths);
+    } else {
+        auto paths = pinned_icon_paths(pinned_icon_names(pinned));
+        for (int i = 0; i < pinned.size(); i++)
+            load_pinned_icon_surface(client_entity, pinned[i], paths[i]);
+        request_refresh(app, client_entity);
+    }
 }
 
 static void
@@ -3426,64 +3810,45 @@ void update_pinned_items_icon() {
     }
 }
 
-WindowsData::WindowsData(App *app, xcb_window_t window) {
-    id = window;
+WindowsData::WindowsData(App *app, const WindowProperties &properties) {
+    id = properties.window;
+    title = properties.title;
     
-    auto cookie = xcb_get_property(app->connection, 0, id, get_cached_atom(app, "_GTK_FRAME_EXTENTS"),
-                                   XCB_ATOM_CARDINAL, 0, 4);
-    auto reply = xcb_get_property_reply(app->connection, cookie, nullptr);
+    if (properties.has_frame_extents) {
+        gtk_left_margin = properties.frame_extents[0];
+        gtk_right_margin = properties.frame_extents[1];
+        gtk_top_margin = properties.frame_extents[2];
+        gtk_bottom_margin = properties.frame_extents[3];
+    }
     
-    if (reply) {
-        int length = xcb_get_property_value_length(reply);
-        if (length != 0) {
-            auto gtkFrameExtents = static_cast<uint32_t *>(xcb_get_property_value(reply));
-            gtk_left_margin = (int) gtkFrameExtents[0];
-            gtk_right_margin = (int) gtkFrameExtents[1];
-            gtk_top_margin = (int) gtkFrameExtents[2];
-            gtk_bottom_margin = (int) gtkFrameExtents[3];
-        }
-        free(reply);
-    }
-    
-    const xcb_get_window_attributes_cookie_t &attributesCookie = xcb_get_window_attributes(
-            app->connection, window);
-    xcb_get_window_attributes_reply_t *attributes = xcb_get_window_attributes_reply(app->connection,
-                                                                                    attributesCookie,
-                                                                                    nullptr);
-    if (attributes) {
-        mapped = attributes->map_state == XCB_MAP_STATE_VIEWABLE;
+    if (properties.has_attributes) {
+        mapped = properties.mapped;
         // TODO: screen should be found using the window somehow I think
         xcb_screen_t *screen = xcb_setup_roots_iterator(xcb_get_setup(app->connection)).data;
-        xcb_visualtype_t *visual = xcb_aux_find_visual_by_id(screen, attributes->visual);
-        
-        xcb_get_geometry_cookie_t geomCookie = xcb_get_geometry(app->connection,
-                                                                window);  // window is a xcb_drawable_t
-        xcb_get_geometry_reply_t *geom = xcb_get_geometry_reply(app->connection, geomCookie, NULL);
+        visual = xcb_aux_find_visual_by_id(screen, properties.visual);
         
-        if (geom) {
+        if (properties.has_geometry) {
+            thumbnails_track(app, this);
             window_surface = cairo_xcb_surface_create(app->connection,
-                                                      window,
+                                                      id,
                                                       visual,
-                                                      (width = geom->width),
-                                                      (height = geom->height));
+                                                      (width = properties.width),
+                                                      (height = properties.height));
             
-            raw_thumbnail_surface = accelerated_surface(app, client_by_name(app, "taskbar"), width, height);
-            raw_thumbnail_cr = cairo_create(raw_thumbnail_surface);
             scaled_thumbnail_surface = accelerated_surface(app, client_by_name(app, "taskbar"), option_width,
                                                            option_height);
             scaled_thumbnail_cr = cairo_create(scaled_thumbnail_surface);
-            take_screenshot();
-            free(geom);
+            // When damage driven, the thumbnail starts out stale instead
+            if (!thumbnails_damage_driven(app))
+                take_screenshot();
         }
-        free(attributes);
     }
 }
 
 WindowsData::~WindowsData() {
+    thumbnails_untrack(app, this);
     if (window_surface) {
         cairo_surface_destroy(window_surface);
-        cairo_surface_destroy(raw_thumbnail_surface);
-        cairo_destroy(raw_thumbnail_cr);
         cairo_surface_destroy(scaled_thumbnail_surface);
         cairo_destroy(scaled_thumbnail_cr);
     }
@@ -3493,24 +3858,7 @@ void WindowsData::take_screenshot() {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    if (!mapped)
-        return;
-    
-    if (gtk_left_margin == 0 && gtk_right_margin == 0 && gtk_top_margin == 0 && gtk_bottom_margin == 0) {
-        cairo_set_source_surface(raw_thumbnail_cr, window_surface, 0, 0);
-        cairo_paint(raw_thumbnail_cr);
-    } else {
-        cairo_save(raw_thumbnail_cr);
-        cairo_set_source_surface(raw_thumbnail_cr, window_surface, 0, 0);
-        cairo_rectangle(raw_thumbnail_cr, gtk_left_margin, gtk_top_margin,
-                        width - (gtk_right_margin + gtk_left_margin), height - (gtk_bottom_margin + gtk_top_margin));
-        cairo_clip(raw_thumbnail_cr);
-        cairo_paint(raw_thumbnail_cr);
-        cairo_restore(raw_thumbnail_cr);
-    }
-    
-    cairo_surface_flush(window_surface);
-    cairo_surface_mark_dirty(window_surface);
+    thumbnails_capture(app, this);
 }
 
 void WindowsData::rescale(double scale_w, double scale_h) {
@@ -3519,14 +3867,7 @@ void WindowsData::rescale(double scale_w, double scale_h) {
 #endif
     last_rescale_timestamp = get_current_time_in_ms();
     
-    cairo_pattern_t *pattern = cairo_pattern_create_for_surface(raw_thumbnail_surface);
-    cairo_pattern_set_filter(pattern, CAIRO_FILTER_GOOD);
-    
-    cairo_save(scaled_thumbnail_cr);
-    cairo_scale(scaled_thumbnail_cr, scale_w, scale_h);
-    cairo_set_source(scaled_thumbnail_cr, pattern);
-    cairo_paint(scaled_thumbnail_cr);
-    cairo_restore(scaled_thumbnail_cr);
+    thumbnails_paint(app, this, scaled_thumbnail_cr, scale_w, scale_h);
 }
 
 void taskbar_launch_index(int index) {
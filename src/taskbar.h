@@ -42,6 +42,8 @@ struct ActionCenterButtonData : public IconButton {
     }
 };
 
+struct WindowProperties;
+
 class WindowsData {
 public:
     
@@ -56,6 +58,7 @@ public:
     
     // This is the surface that is linked to the actual window content
     cairo_surface_t *window_surface = nullptr;
+    xcb_visualtype_t *visual = nullptr;
     int width = -1;
     int height = -1;
     
@@ -64,11 +67,13 @@ public:
     int gtk_top_margin = 0;
     int gtk_bottom_margin = 0;
     
-    // This is where screenshots are stored every so often (if we could guarantee a compositor, we wouldn't need this.
-    cairo_surface_t *raw_thumbnail_surface = nullptr;
-    cairo_t *raw_thumbnail_cr = nullptr;
-    
+    // Screenshots themselves are kept (shrunk down) in the thumbnail store, see thumbnails.h
     long last_rescale_timestamp = 0;
+    long last_capture_timestamp = 0;
+    
+    // The size the windows selector last painted the thumbnail at, which is what captures are scaled to
+    int thumbnail_width = 0;
+    int thumbnail_height = 0;
     
     // This is where we rescale the screenshot to the correct thumbnail size
     cairo_surface_t *scaled_thumbnail_surface = nullptr;
@@ -79,7 +84,7 @@ public:
     ScreenInformation *on_screen = nullptr;
     int on_desktop = 0;
     
-    WindowsData(App *app, xcb_window_t window);
+    WindowsData(App *app, const WindowProperties &properties);
     
     void take_screenshot();
     
@@ -102,6 +107,8 @@ public:
     std::string class_name;
     std::string icon_name;
     std::string user_icon_name;
+    // The file the pinned icon surface was painted from, empty if it fell back to a cached or default icon
+    std::string surface_path;
     bool has_launchable_info = false;
     std::string command_launched_by;
     int initial_mouse_click_before_drag_offset_x = 0;
@@ -145,6 +152,11 @@ public:
 AppClient *
 create_taskbar(App *app);
 
+// The taskbar doesn't wait on the icon theme or the audio connection to be created, these fill in what needed them
+void taskbar_icons_loaded();
+
+void taskbar_audio_started();
+
 void stacking_order_changed(xcb_window_t *all_windows, int windows_count);
 
 void active_window_changed(xcb_window_t new_active_window);
@@ -0,0 +1,633 @@
+#include "thumbnails.h"
+#include "downscale.h"
+#include "taskbar.h"
+#include "utility.h"
+#include "windows_selector.h"
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/Tracy.hpp"
+
+#endif
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <xcb/composite.h>
+#include <xcb/damage.h>
+#include <xcb/xcb_event.h>
+
+struct TrackedWindow {
+    WindowsData *windows_data = nullptr;
+    xcb_damage_damage_t damage = XCB_NONE;
+    
+    // Named from the compositor's redirect of the window, stays valid (showing the last frame) while unmapped
+    xcb_pixmap_t pixmap = XCB_NONE;
+    
+    // Damaged since its last capture, so the stored thumbnail is stale
+    bool damaged = false;
+};
+
+static const xcb_query_extension_reply_t *damage_query = nullptr;
+static bool composite_present = false;
+static bool damage_present = false;
+
+static std::unordered_map<xcb_window_t, TrackedWindow> tracked_windows;
+static std::unordered_map<xcb_damage_damage_t, xcb_window_t> damage_to_window;
+static std::vector<xcb_window_t> damaged_windows;
+static Timeout *capture_timeout = nullptr;
+
+// While the windows selector is open, a damaged window is captured at most this often, no matter how often it repaints
+static const int capture_interval_ms = 250;
+
+// While it's closed, damaged windows are only captured this often, so their thumbnails aren't too old when it opens
+static const int stale_capture_interval_ms = 10000;
+static bool capture_timeout_is_background = false;
+
+// Captures are shrunk by halves and then scaled the rest of the way to the size the windows selector shows them
+// at, all on the capture thread, so painting a stored thumbnail is a plain copy
+struct StoredThumbnail {
+    std::vector<uint32_t> pixels; // premultiplied ARGB32, rows are width pixels long
+    int width = 0;
+    int height = 0;
+    std::list<xcb_window_t>::iterator lru_position;
+};
+
+static std::unordered_map<xcb_window_t, StoredThumbnail> thumbnail_store;
+static std::list<xcb_window_t> thumbnail_lru; // most recently used first
+static size_t thumbnail_store_bytes = 0;
+
+// Least recently used thumbnails are thrown out past this and captured again if they're needed
+static const size_t thumbnail_memory_budget = 32 * 1024 * 1024;
+
+// Captures are read and shrunk on their own thread, over their own connection to the X server, so the
+// main thread only ever swaps a finished thumbnail into the store and paints it
+struct CaptureJob {
+    xcb_window_t window = XCB_NONE;
+    xcb_drawable_t drawable = XCB_NONE;
+    int width = 0;
+    int height = 0;
+    int target_width = 0; // what size the thumbnail should come out
+    int target_height = 0;
+    int left_margin = 0;
+    int right_margin = 0;
+    int top_margin = 0;
+    int bottom_margin = 0;
+};
+
+struct CaptureResult {
+    xcb_window_t window = XCB_NONE;
+    int window_width = 0; // what size the window was when it was captured
+    int window_height = 0;
+    std::vector<uint32_t> pixels;
+    int width = 0;
+    int height = 0;
+};
+
+static std::thread capture_thread;
+static xcb_connection_t *capture_connection = nullptr;
+static int capture_ready_fd = -1;
+static std::mutex capture_mutex;
+static std::condition_variable capture_wanted;
+static std::vector<CaptureJob> capture_jobs; // at most one per window
+static std::vector<CaptureResult> capture_results;
+static bool capture_thread_stop = false;
+
+// Which WindowsData a window's finished capture belongs to
+static std::unordered_map<xcb_window_t, WindowsData *> thumbnail_owners;
+
+static void
+forget_thumbnail(xcb_window_t window) {
+    auto it = thumbnail_store.find(window);
+    if (it == thumbnail_store.end())
+        return;
+    thumbnail_store_bytes -= it->second.pixels.size() * sizeof(uint32_t);
+    thumbnail_lru.erase(it->second.lru_position);
+    thumbnail_store.erase(it);
+}
+
+static void
+store_thumbnail(xcb_window_t window, std::vector<uint32_t> &&pixels, int width, int height) {
+    forget_thumbnail(window);
+    thumbnail_lru.push_front(window);
+    StoredThumbnail &stored = thumbnail_store[window];
+    stored.pixels = std::move(pixels);
+    stored.width = width;
+    stored.height = height;
+    stored.lru_position = thumbnail_lru.begin();
+    thumbnail_store_bytes += stored.pixels.size() * sizeof(uint32_t);
+    
+    while (thumbnail_store_bytes > thumbnail_memory_budget && thumbnail_lru.back() != window)
+        forget_thumbnail(thumbnail_lru.back());
+#ifdef TRACY_ENABLE
+    TracyPlot("Thumbnail store (MB)", (double) thumbnail_store_bytes / (1024 * 1024));
+#endif
+}
+
+static void
+release_pixmap(App *app, TrackedWindow *tracked) {
+    if (tracked->pixmap != XCB_NONE) {
+        xcb_free_pixmap(app->connection, tracked->pixmap);
+        tracked->pixmap = XCB_NONE;
+    }
+}
+
+// The pixmap a compositor keeps for the window, or XCB_NONE if it isn't redirected
+// (unmapped before we named it, or unredirected because it's fullscreen)
+static xcb_pixmap_t
+composite_pixmap(App *app, TrackedWindow *tracked) {
+    if (tracked->pixmap == XCB_NONE) {
+        xcb_pixmap_t pixmap = xcb_generate_id(app->connection);
+        auto cookie = xcb_composite_name_window_pixmap_checked(app->connection, tracked->windows_data->id, pixmap);
+        if (auto error = xcb_request_check(app->connection, cookie)) {
+            free(error);
+            return XCB_NONE;
+        }
+        tracked->pixmap = pixmap;
+    }
+    return tracked->pixmap;
+}
+
+static void
+discard_error(xcb_connection_t *connection, xcb_void_cookie_t cookie) {
+    free(xcb_request_check(connection, cookie));
+}
+
+// GetImage on a window fails with BadMatch as soon as any part of it is off the screen (which is the drawable when
+// there's no compositor, or the window is unredirected). Copying it into a pixmap first, which is what cairo does,
+// works, and whatever was off the screen comes out blank.
+static xcb_get_image_reply_t *
+get_image_through_pixmap(xcb_connection_t *connection, xcb_drawable_t drawable, int width, int height) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    xcb_generic_error_t *error = nullptr;
+    auto geometry = xcb_get_geometry_reply(connection, xcb_get_geometry(connection, drawable), &error);
+    if (!geometry) {
+        free(error);
+        return nullptr;
+    }
+    uint8_t depth = geometry->depth;
+    free(geometry);
+    
+    xcb_pixmap_t pixmap = xcb_generate_id(connection);
+    xcb_gcontext_t gc = xcb_generate_id(connection);
+    uint32_t values[] = {0, XCB_SUBWINDOW_MODE_INCLUDE_INFERIORS};
+    xcb_rectangle_t everything = {0, 0, (uint16_t) width, (uint16_t) height};
+    auto pixmap_cookie = xcb_create_pixmap_checked(connection, depth, pixmap, drawable, width, height);
+    auto gc_cookie = xcb_create_gc_checked(connection, gc, pixmap, XCB_GC_FOREGROUND | XCB_GC_SUBWINDOW_MODE,
+                                           values);
+    auto fill_cookie = xcb_poly_fill_rectangle_checked(connection, pixmap, gc, 1, &everything);
+    auto copy_cookie = xcb_copy_area_checked(connection, drawable, pixmap, gc, 0, 0, 0, 0, width, height);
+    auto image_cookie = xcb_get_image(connection, XCB_IMAGE_FORMAT_Z_PIXMAP, pixmap, 0, 0, width, height, ~0u);
+    auto free_gc_cookie = xcb_free_gc_checked(connection, gc);
+    auto free_pixmap_cookie = xcb_free_pixmap_checked(connection, pixmap);
+    
+    xcb_get_image_reply_t *reply = xcb_get_image_reply(connection, image_cookie, &error);
+    free(error);
+    // Nothing reads the capture connection's event queue, so every error has to be taken here
+    for (auto cookie: {pixmap_cookie, gc_cookie, fill_cookie, copy_cookie, free_gc_cookie, free_pixmap_cookie})
+        discard_error(connection, cookie);
+    return reply;
+}
+
+// Reads the drawable and scales it down to the job's target size. Only touches what it's given, so it's safe to run on
+// any thread.
+static bool
+capture_pixels(xcb_connection_t *connection, const CaptureJob &job, CaptureResult *result) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    int width = job.width;
+    int height = job.height;
+    auto cookie = xcb_get_image(connection, XCB_IMAGE_FORMAT_Z_PIXMAP, job.drawable, 0, 0, width, height, ~0u);
+    // Nothing reads the capture connection's event queue, so errors have to be taken here or they pile up there
+    xcb_generic_error_t *error = nullptr;
+    xcb_get_image_reply_t *reply = xcb_get_image_reply(connection, cookie, &error);
+    if (!reply) {
+        bool partly_off_screen = error && error->error_code == XCB_MATCH;
+        free(error);
+        if (!partly_off_screen)
+            return false;
+        reply = get_image_through_pixmap(connection, job.drawable, width, height);
+        if (!reply)
+            return false;
+    }
+    // Only 32 bits per pixel visuals are handled, which is every depth 24 and 32 visual in practice
+    if ((reply->depth != 24 && reply->depth != 32) ||
+        xcb_get_image_data_length(reply) < (size_t) width * height * sizeof(uint32_t)) {
+        free(reply);
+        return false;
+    }
+    auto *pixels = (uint32_t *) xcb_get_image_data(reply);
+    
+    // The fourth byte of a depth 24 pixel is undefined, and client side decorations' shadows shouldn't show
+    bool opaque = reply->depth == 24;
+    bool has_margins = job.left_margin != 0 || job.right_margin != 0 || job.top_margin != 0 || job.bottom_margin != 0;
+    if (opaque || has_margins) {
+        int left = job.left_margin;
+        int right = width - job.right_margin;
+        int top = job.top_margin;
+        int bottom = height - job.bottom_margin;
+        for (int y = 0; y < height; y++) {
+            uint32_t *row = pixels + (size_t) y * width;
+            for (int x = 0; x < width; x++) {
+                if (y < top || y >= bottom || x < left || x >= right) {
+                    row[x] = 0;
+                } else if (opaque) {
+                    row[x] |= 0xff000000;
+                }
+            }
+        }
+    }
+    
+    int level_width = width;
+    int level_height = height;
+    std::vector<uint32_t> shrunk;
+    const uint32_t *level = pixels;
+    if (shrink_by_halves(pixels, &level_width, &level_height, job.target_width, job.target_height, &shrunk))
+        level = shrunk.data();
+    if (level_width == job.target_width && level_height == job.target_height) {
+        if (level == pixels) {
+            result->pixels.assign(pixels, pixels + (size_t) width * height);
+        } else {
+            result->pixels = std::move(shrunk);
+        }
+    } else {
+        scale_to(level, level_width, level_height, job.target_width, job.target_height, &result->pixels);
+    }
+    free(reply);
+    
+    result->window = job.window;
+    result->window_width = job.width;
+    result->window_height = job.height;
+    result->width = job.target_width;
+    result->height = job.target_height;
+    return true;
+}
+
+static void
+finish_capture(App *app, CaptureResult &result) {
+    auto owner = thumbnail_owners.find(result.window);
+    // The window was closed or resized while it was being captured
+    if (owner == thumbnail_owners.end() || owner->second->width != result.window_width ||
+        owner->second->height != result.window_height) {
+        return;
+    }
+    store_thumbnail(result.window, std::move(result.pixels), result.width, result.height);
+    owner->second->last_capture_timestamp = get_current_time_in_ms();
+}
+
+static void
+capture_thread_loop() {
+#ifdef TRACY_ENABLE
+    tracy::SetThreadName("Thumbnail Thread");
+#endif
+    std::unique_lock lock(capture_mutex);
+    while (true) {
+        capture_wanted.wait(lock, [] { return capture_thread_stop || !capture_jobs.empty(); });
+        if (capture_thread_stop)
+            return;
+        CaptureJob job = capture_jobs.front();
+        capture_jobs.erase(capture_jobs.begin());
+        lock.unlock();
+        
+        CaptureResult result;
+        bool captured = capture_pixels(capture_connection, job, &result);
+        
+        lock.lock();
+        if (captured) {
+            capture_results.push_back(std::move(result));
+            uint64_t one = 1;
+            write(capture_ready_fd, &one, sizeof(one));
+        }
+    }
+}
+
+static void
+captures_ready(App *app, int fd) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    uint64_t count;
+    read(fd, &count, sizeof(count));
+    
+    std::vector<CaptureResult> results;
+    {
+        std::lock_guard lock(capture_mutex);
+        results.swap(capture_results);
+    }
+    for (auto &result: results)
+        finish_capture(app, result);
+    
+    if (!results.empty()) {
+        if (auto client = client_by_name(app, "windows_selector")) {
+            request_refresh(app, client);
+        }
+    }
+}
+
+static void
+capture_stale_window(App *app, TrackedWindow &tracked) {
+    tracked.damaged = false;
+    // The damage reports at the non-empty level, so clearing it is what lets the next change notify us again
+    xcb_damage_subtract(app->connection, tracked.damage, XCB_NONE, XCB_NONE);
+    tracked.windows_data->take_screenshot();
+}
+
+static void
+capture_damaged_windows(App *app, AppClient *, Timeout *, void *) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    capture_timeout = nullptr;
+    for (auto window: damaged_windows) {
+        auto it = tracked_windows.find(window);
+        if (it != tracked_windows.end())
+            capture_stale_window(app, it->second);
+    }
+    damaged_windows.clear();
+    xcb_flush(app->connection);
+}
+
+static void
+schedule_stale_captures(App *app) {
+    bool selector_open = client_by_name(app, "windows_selector") != nullptr;
+    if (!capture_timeout) {
+        capture_timeout = app_timeout_create(app, nullptr,
+                                             selector_open ? capture_interval_ms : stale_capture_interval_ms,
+                                             capture_damaged_windows, nullptr);
+        capture_timeout_is_background = !selector_open;
+    } else if (selector_open && capture_timeout_is_background) {
+        capture_timeout = app_timeout_replace(app, nullptr, capture_timeout, capture_interval_ms,
+                                              capture_damaged_windows, nullptr);
+        capture_timeout_is_background = false;
+    }
+}
+
+static void
+mark_stale(App *app, xcb_window_t window, TrackedWindow &tracked) {
+    if (tracked.damaged)
+        return;
+    tracked.damaged = true;
+    damaged_windows.push_back(window);
+    schedule_stale_captures(app);
+}
+
+static bool
+thumbnails_event_handler(App *app, xcb_generic_event_t *event) {
+    if (!damage_present || XCB_EVENT_RESPONSE_TYPE(event) != damage_query->first_event + XCB_DAMAGE_NOTIFY)
+        return false;
+    
+    auto *e = (xcb_damage_notify_event_t *) event;
+    auto window_it = damage_to_window.find(e->damage);
+    if (window_it == damage_to_window.end())
+        return true;
+    auto it = tracked_windows.find(window_it->second);
+    if (it != tracked_windows.end())
+        mark_stale(app, window_it->second, it->second);
+    return true;
+}
+
+void thumbnails_start(App *app) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto composite_query = xcb_get_extension_data(app->connection, &xcb_composite_id);
+    damage_query = xcb_get_extension_data(app->connection, &xcb_damage_id);
+    
+    // Both extensions refuse to be used until their version has been asked for
+    xcb_composite_query_version_cookie_t composite_cookie{};
+    xcb_damage_query_version_cookie_t damage_cookie{};
+    if (composite_query && composite_query->present)
+        composite_cookie = xcb_composite_query_version(app->connection, XCB_COMPOSITE_MAJOR_VERSION,
+                                                       XCB_COMPOSITE_MINOR_VERSION);
+    if (damage_query && damage_query->present)
+        damage_cookie = xcb_damage_query_version(app->connection, XCB_DAMAGE_MAJOR_VERSION,
+                                                 XCB_DAMAGE_MINOR_VERSION);
+    
+    if (composite_query && composite_query->present) {
+        if (auto reply = xcb_composite_query_version_reply(app->connection, composite_cookie, nullptr)) {
+            // NameWindowPixmap was added in 0.2
+            composite_present = reply->major_version > 0 || reply->minor_version >= 2;
+            free(reply);
+        }
+    }
+    if (damage_query && damage_query->present) {
+        if (auto reply = xcb_damage_query_version_reply(app->connection, damage_cookie, nullptr)) {
+            damage_present = true;
+            free(reply);
+        }
+    }
+    
+    if (damage_present)
+        app_create_custom_event_handler(app, INT_MAX, thumbnails_event_handler);
+    
+    // If the capture thread can't get a connection of its own, captures happen on the main thread instead
+    capture_connection = xcb_connect(nullptr, nullptr);
+    if (xcb_connection_has_error(capture_connection)) {
+        xcb_disconnect(capture_connection);
+        capture_connection = nullptr;
+        return;
+    }
+    capture_ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    poll_descriptor(app, capture_ready_fd, EPOLLIN, captures_ready);
+    capture_thread_stop = false;
+    capture_thread = std::thread(capture_thread_loop);
+}
+
+void thumbnails_stop(App *app) {
+    if (!capture_connection)
+        return;
+    {
+        std::lock_guard lock(capture_mutex);
+        capture_thread_stop = true;
+        capture_jobs.clear();
+        capture_results.clear();
+    }
+    capture_wanted.notify_one();
+    capture_thread.join();
+    xcb_disconnect(capture_connection);
+    capture_connection = nullptr;
+    unpoll_descriptor(app, capture_ready_fd);
+    close(capture_ready_fd);
+    capture_ready_fd = -1;
+}
+
+bool thumbnails_damage_driven(App *app) {
+    return composite_present && damage_present && screen_has_transparency(app);
+}
+
+void thumbnails_track(App *app, WindowsData *windows_data) {
+    thumbnail_owners[windows_data->id] = windows_data;
+    if (!thumbnails_damage_driven(app))
+        return;
+    TrackedWindow &tracked = tracked_windows[windows_data->id];
+    if (tracked.damage != XCB_NONE)
+        damage_to_window.erase(tracked.damage);
+    tracked.windows_data = windows_data;
+    tracked.damage = xcb_generate_id(app->connection);
+    xcb_damage_create(app->connection, tracked.damage, windows_data->id, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+    damage_to_window[tracked.damage] = windows_data->id;
+    // Nothing has been captured yet
+    mark_stale(app, windows_data->id, tracked);
+}
+
+void thumbnails_refresh_if_stale(App *app, WindowsData *windows_data) {
+    auto it = tracked_windows.find(windows_data->id);
+    if (it == tracked_windows.end() || it->second.windows_data != windows_data || !it->second.damaged)
+        return;
+    // Left stale for the timeout to pick up
+    if (get_current_time_in_ms() - windows_data->last_capture_timestamp < capture_interval_ms) {
+        schedule_stale_captures(app);
+        return;
+    }
+    damaged_windows.erase(std::remove(damaged_windows.begin(), damaged_windows.end(), windows_data->id),
+                          damaged_windows.end());
+    capture_stale_window(app, it->second);
+    xcb_flush(app->connection);
+}
+
+void thumbnails_untrack(App *app, WindowsData *windows_data) {
+    auto owner = thumbnail_owners.find(windows_data->id);
+    if (owner != thumbnail_owners.end() && owner->second == windows_data) {
+        thumbnail_owners.erase(owner);
+        forget_thumbnail(windows_data->id);
+        std::lock_guard lock(capture_mutex);
+        auto window = windows_data->id;
+        capture_jobs.erase(std::remove_if(capture_jobs.begin(), capture_jobs.end(),
+                                          [window](const CaptureJob &job) { return job.window == window; }),
+                           capture_jobs.end());
+    }
+    
+    auto it = tracked_windows.find(windows_data->id);
+    if (it == tracked_windows.end() || it->second.windows_data != windows_data)
+        return;
+    TrackedWindow &tracked = it->second;
+    // If the window is already gone, so is its damage, and the error from destroying it again is harmless
+    xcb_damage_destroy(app->connection, tracked.damage);
+    damage_to_window.erase(tracked.damage);
+    release_pixmap(app, &tracked);
+    if (tracked.damaged) {
+        damaged_windows.erase(std::remove(damaged_windows.begin(), damaged_windows.end(), windows_data->id),
+                              damaged_windows.end());
+    }
+    tracked_windows.erase(it);
+}
+
+void thumbnails_window_reshaped(App *app, WindowsData *windows_data) {
+    forget_thumbnail(windows_data->id);
+    // Until the windows selector paints it again, the next capture is sized for the new shape
+    windows_data->thumbnail_width = 0;
+    windows_data->thumbnail_height = 0;
+    auto it = tracked_windows.find(windows_data->id);
+    if (it != tracked_windows.end())
+        release_pixmap(app, &it->second);
+}
+
+bool thumbnails_capture(App *app, WindowsData *windows_data) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    CaptureJob job;
+    job.window = windows_data->id;
+    job.width = windows_data->width;
+    job.height = windows_data->height;
+    job.target_width = windows_data->thumbnail_width;
+    job.target_height = windows_data->thumbnail_height;
+    job.left_margin = windows_data->gtk_left_margin;
+    job.right_margin = windows_data->gtk_right_margin;
+    job.top_margin = windows_data->gtk_top_margin;
+    job.bottom_margin = windows_data->gtk_bottom_margin;
+    if (job.width <= 0 || job.height <= 0)
+        return false;
+    if (job.target_width <= 0 || job.target_height <= 0)
+        windows_selector_thumbnail_size(windows_data, &job.target_width, &job.target_height);
+    // Thumbnails are only ever shown smaller than the window
+    job.target_width = std::min(job.target_width, job.width);
+    job.target_height = std::min(job.target_height, job.height);
+    
+    // With a compositor the window's pixmap has the contents even where it's covered or minimized
+    if (thumbnails_damage_driven(app)) {
+        auto it = tracked_windows.find(windows_data->id);
+        if (it != tracked_windows.end())
+            job.drawable = composite_pixmap(app, &it->second);
+    }
+    if (job.drawable == XCB_NONE) {
+        if (!windows_data->mapped)
+            return false;
+        job.drawable = windows_data->id;
+    }
+    
+    if (!capture_connection) {
+        CaptureResult result;
+        if (!capture_pixels(app->connection, job, &result))
+            return false;
+        finish_capture(app, result);
+        return true;
+    }
+    
+    {
+        std::lock_guard lock(capture_mutex);
+        auto queued = std::find_if(capture_jobs.begin(), capture_jobs.end(), [&job](const CaptureJob &queued) {
+            return queued.window == job.window;
+        });
+        if (queued != capture_jobs.end()) {
+            *queued = job;
+        } else {
+            capture_jobs.push_back(job);
+        }
+    }
+    capture_wanted.notify_one();
+    return true;
+}
+
+bool thumbnails_paint(App *app, WindowsData *windows_data, cairo_t *cr, double scale_w, double scale_h) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    int wanted_width = std::min(windows_data->width, std::max(1, (int) std::round(windows_data->width * scale_w)));
+    int wanted_height = std::min(windows_data->height, std::max(1, (int) std::round(windows_data->height * scale_h)));
+    bool size_changed =
+            wanted_width != windows_data->thumbnail_width || wanted_height != windows_data->thumbnail_height;
+    windows_data->thumbnail_width = wanted_width;
+    windows_data->thumbnail_height = wanted_height;
+    
+    auto it = thumbnail_store.find(windows_data->id);
+    if (it == thumbnail_store.end()) {
+        // Painted once the capture comes back
+        thumbnails_capture(app, windows_data);
+        return false;
+    }
+    StoredThumbnail &stored = it->second;
+    thumbnail_lru.splice(thumbnail_lru.begin(), thumbnail_lru, stored.lru_position);
+    bool exact = stored.width == wanted_width && stored.height == wanted_height;
+    if (!exact && size_changed)
+        thumbnails_capture(app, windows_data);
+    
+    auto surface = cairo_image_surface_create_for_data((unsigned char *) stored.pixels.data(), CAIRO_FORMAT_ARGB32,
+                                                       stored.width, stored.height,
+                                                       stored.width * sizeof(uint32_t));
+    cairo_save(cr);
+    if (!exact) {
+        // Only until the capture at the new size comes back, so it doesn't need to look good
+        cairo_scale(cr, (double) wanted_width / stored.width, (double) wanted_height / stored.height);
+    }
+    cairo_set_source_surface(cr, surface, 0, 0);
+    if (!exact)
+        cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(cr);
+    cairo_restore(cr);
+    
+    cairo_surface_destroy(surface);
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef WINBAR_THUMBNAILS_H
+#define WINBAR_THUMBNAILS_H
+
+#include "application.h"
+
+class WindowsData;
+
+// Checks for XComposite and XDamage, starts listening for damage events, and starts the capture thread
+void thumbnails_start(App *app);
+
+void thumbnails_stop(App *app);
+
+// When a compositor is running and both extensions are there, thumbnails are taken from the
+// offscreen pixmap the compositor keeps for each window, and only after the window was damaged
+bool thumbnails_damage_driven(App *app);
+
+// Only does something when thumbnails are damage driven: damage to the window then marks its thumbnail stale
+void thumbnails_track(App *app, WindowsData *windows_data);
+
+// Called by the windows selector before it shows the window, which is what captures a stale thumbnail.
+// Otherwise they are only captured every few seconds.
+void thumbnails_refresh_if_stale(App *app, WindowsData *windows_data);
+
+void thumbnails_untrack(App *app, WindowsData *windows_data);
+
+// A window gets a new pixmap when it's mapped or resized, so the old one (and its thumbnail) has to be let go of
+void thumbnails_window_reshaped(App *app, WindowsData *windows_data);
+
+// Queues the window to be copied into the thumbnail store, scaled on the capture thread to the size the windows
+// selector last painted it at (its thumbnail_width and thumbnail_height).
+// When it's there, the window's last_capture_timestamp is updated and the windows selector is repainted.
+bool thumbnails_capture(App *app, WindowsData *windows_data);
+
+// Paints the stored thumbnail at the size the whole window would be scaled to, which is a plain copy unless that size
+// just changed (then a capture at the new size is queued). Returns false (and queues a capture) if there isn't one yet.
+bool thumbnails_paint(App *app, WindowsData *windows_data, cairo_t *cr, double scale_w, double scale_h);
+
+#endif //WINBAR_THUMBNAILS_H
@@ -528,24 +528,8 @@ paint_right_thumb(AppClient *client, cairo_t *cr, Container *container) {
     cairo_fill(cr);
 }
 
-void open_volume_menu() {
-    audio_start(app);
-    if (audio_backend_data->audio_backend == Audio_Backend::NONE) {
-        connected_message = "Failed to establish connection with an audio server [PulseAudio, Alsa]. (Click anywhere on this."
-                            "window to retry)";
-    } else if (audio_backend_data->audio_backend == Audio_Backend::PULSEAUDIO ||
-               audio_backend_data->audio_backend == Audio_Backend::ALSA) {
-        audio_update_list_of_clients();
-        
-        if (audio_clients.empty()) {
-            connected_message = "Successfully established connection to PulseAudio but found no "
-                                "clients or devices running";
-        }
-    }
-    if (audio_backend_data->audio_backend != Audio_Backend::NONE) {
-        audio_state_change_callback(updates);
-    }
-    
+static Settings
+volume_menu_settings() {
     Settings settings;
     settings.decorations = false;
     settings.skip_taskbar = true;
@@ -578,6 +562,28 @@ void open_volume_menu() {
     settings.slide_data[2] = 160;
     settings.slide_data[3] = 100;
     settings.slide_data[4] = 80;
+    return settings;
+}
+
+void open_volume_menu() {
+    audio_start(app);
+    if (audio_backend_data->audio_backend == Audio_Backend::NONE) {
+        connected_message = "Failed to establish connection with an audio server [PulseAudio, Alsa]. (Click anywhere on this."
+                            "window to retry)";
+    } else if (audio_backend_data->audio_backend == Audio_Backend::PULSEAUDIO ||
+               audio_backend_data->audio_backend == Audio_Backend::ALSA) {
+        audio_update_list_of_clients();
+        
+        if (audio_clients.empty()) {
+            connected_message = "Successfully established connection to PulseAudio but found no "
+                                "clients or devices running";
+        }
+    }
+    if (audio_backend_data->audio_backend != Audio_Backend::NONE) {
+        audio_state_change_callback(updates);
+    }
+    
+    Settings settings = volume_menu_settings();
     
     if (auto taskbar = client_by_name(app, "taskbar")) {
         PopupSettings popup_settings;
@@ -623,6 +629,10 @@ void open_volume_menu() {
     }
 }
 
+void prewarm_volume_menu() {
+    client_prewarm(app, volume_menu_settings(), "volume");
+}
+
 void update_volume_menu() {
     updates();
 }
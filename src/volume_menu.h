@@ -32,6 +32,8 @@ public:
 
 void open_volume_menu();
 
+void prewarm_volume_menu();
+
 void update_volume_menu();
 
 #endif// APP_VOLUME_MENU_H
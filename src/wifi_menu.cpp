@@ -397,7 +397,8 @@ fill_root(AppClient *client) {
     root->user_data = root_animation_data;
 }
 
-void start_wifi_menu() {
+static Settings
+wifi_menu_settings() {
     Settings settings;
     settings.h = 641;
     settings.w = 360;
@@ -418,6 +419,11 @@ void start_wifi_menu() {
     settings.slide_data[2] = 160;
     settings.slide_data[3] = 100;
     settings.slide_data[4] = 80;
+    return settings;
+}
+
+void start_wifi_menu() {
+    Settings settings = wifi_menu_settings();
     
     if (auto taskbar = client_by_name(app, "taskbar")) {
         PopupSettings popup_settings;
@@ -439,3 +445,7 @@ void start_wifi_menu() {
         client_show(app, client);
     }
 }
+
+void prewarm_wifi_menu() {
+    client_prewarm(app, wifi_menu_settings(), "wifi_menu");
+}
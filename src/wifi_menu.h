@@ -7,4 +7,6 @@ void wifi_state(bool *up, bool *wired);
 
 void start_wifi_menu();
 
+void prewarm_wifi_menu();
+
 #endif// WIFI_MENU_H
@@ -11,11 +11,13 @@
 #include "config.h"
 #include "main.h"
 #include "taskbar.h"
+#include "thumbnails.h"
 
 #include <pango/pangocairo.h>
 #include <xcb/xcb_image.h>
 #include <icons.h>
 #include <cmath>
+#include <algorithm>
 
 int option_width = 217 * 1.2;
 int option_min_width = 100 * 1.2;
@@ -406,12 +408,15 @@ paint_body(AppClient *client_entity, cairo_t *cr, Container *container) {
     }
     
     long currrent_time = get_current_time_in_ms();
-    if ((currrent_time - data->last_rescale_timestamp) > 1000) {
-        if (screen_has_transparency(app)) {
-            data->take_screenshot();
-        }
+    // Without damage, windows are captured again at most once a second while the selector is open
+    if (!thumbnails_damage_driven(app) && screen_has_transparency(app) &&
+        (currrent_time - data->last_rescale_timestamp) > 1000) {
+        data->take_screenshot();
+    }
+    thumbnails_refresh_if_stale(app, data);
+    // Captures finish on the capture thread, so there's only something new to scale once one has come back
+    if (data->last_capture_timestamp >= data->last_rescale_timestamp)
         data->rescale(scale_w, scale_h);
-    }
     if (data->scaled_thumbnail_surface) {
         double width = data->width * scale_w;
         double height = data->height * scale_h;
@@ -429,6 +434,17 @@ paint_body(AppClient *client_entity, cairo_t *cr, Container *container) {
     }
 }
 
+void windows_selector_thumbnail_size(WindowsData *data, int *width, int *height) {
+    // Mirrors how fill_root sizes the option and paint_body fits the window into its body
+    double pad = option_pad;
+    double option_scale = std::min((option_width - pad * 2) / data->width, (option_height - pad) / data->height);
+    double body_width = std::max(data->width * option_scale, (double) option_min_width);
+    double body_height = option_height - close_height;
+    double scale = std::min((body_width - pad * 2) / data->width, (body_height - pad) / data->height);
+    *width = std::max(1, (int) std::round(data->width * scale));
+    *height = std::max(1, (int) std::round(data->height * scale));
+}
+
 void when_enter(AppClient *client, cairo_t *cr, Container *self) {
     auto pii = (PinnedIconInfo *) client->root->user_data;
     if (pii->data->type == selector_type::OPEN_HOVERED) {
@@ -16,6 +16,9 @@ public:
     ~PinnedIconInfo();
 };
 
+// The size paint_body will show the window's thumbnail at, before the windows selector has been laid out
+void windows_selector_thumbnail_size(WindowsData *data, int *width, int *height);
+
 void possibly_open(App *app, Container *container, LaunchableButton *data);
 
 void possibly_close(App *app, Container *container, LaunchableButton *data);